@@ -23,6 +23,7 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    trace_init(TRACE_INFO);
     strcpy(ip_addr, argv[1]);
     port = atoi(argv[2]);
     
@@ -49,10 +50,12 @@ int main(int argc, char *argv[]) {
     
     /* Initialize state */
     memset(&state, 0, sizeof(conn_state_t));
+    framer_init(&state.framer, state.recv_buffer, BUFF_SIZE);
     
-    /* Receive welcome message */
+    /* Receive welcome message, with the server's optional features */
     if (tcp_receive(sockfd, &state, buffer, BUFF_SIZE) > 0) {
         print_response(buffer);
+        set_server_features(buffer);
     }
     
     /* Main loop */
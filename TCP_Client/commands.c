@@ -2,6 +2,81 @@
 
 /* ==================== COMMAND FUNCTIONS ==================== */
 
+/* Set when the greeting says the server has a blob store (-d) */
+static int server_dedup = 0;
+
+/**
+ * @function set_server_features: Note what the server announced in its greeting
+ * @param greeting: "100 [<feature> ...]"
+ **/
+void set_server_features(const char *greeting) {
+    char copy[BUFF_SIZE];
+    snprintf(copy, sizeof(copy), "%s", greeting);
+    for (char *save, *word = strtok_r(copy, " ", &save); word != NULL; word = strtok_r(NULL, " ", &save)) {
+        if (strcmp(word, "dedup") == 0) {
+            server_dedup = 1;
+        }
+    }
+}
+
+/**
+ * @function upload_by_hash: Let the server take the file from its blob store
+ * @param sockfd: Socket descriptor
+ * @param state: Connection state
+ * @param filepath: Local file
+ * @param filename: Name on the server
+ * @param filesize: Size of the file
+ * @return: 1 when the upload is over (stored without a transfer, or an error
+ *          was reported), 0 when the file has to be sent
+ * @note: The server answers 147 <offset> <length> when it has the content and
+ *        wants the digest of that range as proof that we hold the file; the
+ *        file is only hashed when the server announced a blob store
+ **/
+static int upload_by_hash(int sockfd, conn_state_t *state, const char *filepath,
+                          const char *filename, long long filesize) {
+    char digest_text[DIGEST_TEXT_SIZE];
+    char command[BUFF_SIZE];
+    char buffer[BUFF_SIZE];
+    long long offset, length;
+
+    if (!server_dedup || hash_file(filepath, 0, filesize, DIGEST_SHA256,
+                                      digest_text, sizeof(digest_text)) == -1) {
+        return 0;
+    }
+
+    snprintf(command, sizeof(command), "UPLOAD_HASH %s %lld %s", filename, filesize, digest_text);
+    if (tcp_send(sockfd, command) <= 0 || tcp_receive(sockfd, state, buffer, BUFF_SIZE) <= 0) {
+        printf(">> Failed to receive response\n");
+        return 1;
+    }
+
+    if (sscanf(buffer, "147 %lld %lld", &offset, &length) == 2) {
+        char proof[DIGEST_TEXT_SIZE];
+        if (hash_file(filepath, offset, length, DIGEST_SHA256, proof, sizeof(proof)) == -1) {
+            strcpy(proof, "-");
+        }
+        if (tcp_send(sockfd, proof) <= 0 || tcp_receive(sockfd, state, buffer, BUFF_SIZE) <= 0) {
+            printf(">> Failed to receive response\n");
+            return 1;
+        }
+    }
+
+    if (strncmp(buffer, "140", 3) == 0) {
+        print_response(buffer);
+        printf(">> Server already stores this content: nothing was transferred\n");
+        return 1;
+    }
+    if (strncmp(buffer, "506", 3) == 0) {
+        server_dedup = 0;
+        return 0;
+    }
+    if (strncmp(buffer, "146", 3) == 0) {
+        return 0;
+    }
+    print_response(buffer);
+    return 1;
+}
+
 void do_register(int sockfd, conn_state_t *state) {
     char username[100];
     char password[100];
@@ -154,37 +229,59 @@ void do_upload(int sockfd, conn_state_t *state) {
         filename++;  /* Skip the separator */
     }
     
-    /* Send UPLOAD command */
+    /* A server with a blob store (-d) may already have the content */
+    if (upload_by_hash(sockfd, state, filepath, filename, filesize)) {
+        return;
+    }
+    
+    /* Send UPLOAD_RESUME: the server keeps what arrived of an interrupted
+     * upload of this version of the file, named by its mtime */
     char command[BUFF_SIZE];
-    snprintf(command, sizeof(command), "UPLOAD %s %lld", filename, filesize);
+    struct stat st;
+    if (stat(filepath, &st) == 0) {
+        snprintf(command, sizeof(command), "UPLOAD_RESUME %s %lld %lld.%09ld", filename, filesize,
+                 (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+    } else {
+        snprintf(command, sizeof(command), "UPLOAD_RESUME %s %lld", filename, filesize);
+    }
     if (tcp_send(sockfd, command) <= 0) {
         printf(">> Failed to send command\n");
         return;
     }
     
-    /* Wait for 141 (ready to receive) */
+    /* Wait for 142 <offset> (ready to receive from offset) */
     if (tcp_receive(sockfd, state, buffer, BUFF_SIZE) <= 0) {
         printf(">> Failed to receive response\n");
         return;
     }
     
-    if (strcmp(buffer, "141") != 0) {
+    long long offset;
+    if (sscanf(buffer, "142 %lld", &offset) != 1 || offset < 0 || offset > filesize) {
         print_response(buffer);
         return;
     }
     
-    printf(">> Server is ready. Uploading...\n");
+    if (offset > 0) {
+        printf(">> Server already has %lld / %lld bytes. Resuming...\n", offset, filesize);
+    } else {
+        printf(">> Server is ready. Uploading...\n");
+    }
     
-    /* Open and send file */
+    /* Open and send the part of the file the server is missing */
     FILE *fp = fopen(filepath, "rb");
     if (fp == NULL) {
         printf(">> Cannot open file\n");
         return;
     }
+    if (fseeko(fp, offset, SEEK_SET) != 0) {
+        printf(">> Cannot seek in file\n");
+        fclose(fp);
+        return;
+    }
     
     char file_buf[65536];
     size_t n_read;
-    long long total_sent = 0;
+    long long total_sent = offset;
     
     while ((n_read = fread(file_buf, 1, sizeof(file_buf), fp)) > 0) {
         if (send_all(sockfd, file_buf, n_read) < 0) {
@@ -193,14 +290,17 @@ void do_upload(int sockfd, conn_state_t *state) {
             return;
         }
         total_sent += n_read;
-        printf("\rSent %lld / %lld bytes", total_sent, filesize);
+        TRACE_EVERY(TRACE_INFO, 100, "\rSent %lld / %lld bytes", total_sent, filesize);
     }
-    printf("\n");
+    TRACE(TRACE_INFO, "\rSent %lld / %lld bytes\n", total_sent, filesize);
     fclose(fp);
     
-    /* Wait for final response */
+    /* Wait for final response; 140 carries the digest of the stored file */
     if (tcp_receive(sockfd, state, buffer, BUFF_SIZE) > 0) {
         print_response(buffer);
+        if (strncmp(buffer, "140", 3) == 0 && verify_digest(filepath, 0, filesize, buffer) == 0) {
+            printf(">> WARNING: server copy does not match the local file (%s)\n", buffer + 4);
+        }
     }
 }
 
@@ -219,9 +319,32 @@ void do_download(int sockfd, conn_state_t *state) {
         return;
     }
     
-    /* Send DOWNLOAD command */
+    /* The file is received into Downloads/<name>.part and renamed once
+     * complete; a part left by an interrupted download is resumed if the
+     * server still has the version it was started from */
+    char download_path[MAX_PATH], part_path[MAX_PATH];
+    if (snprintf(download_path, sizeof(download_path), "Downloads/%s", filename) >= (int)sizeof(download_path) ||
+        snprintf(part_path, sizeof(part_path), "%s.part", download_path) >= (int)sizeof(part_path)) {
+        printf(">> Filename is too long\n");
+        return;
+    }
+    
+    long long offset = 0;
+    char version[FILE_VERSION_SIZE] = "";
+    struct stat st;
+    if (stat(part_path, &st) == 0 && S_ISREG(st.st_mode)) {
+        ssize_t n = getxattr(part_path, VERSION_XATTR, version, sizeof(version) - 1);
+        version[n > 0 ? n : 0] = '\0';
+        offset = n > 0 ? st.st_size : 0;
+    }
+    
+    /* Send DOWNLOAD command; a range past the end is clamped by the server */
     char command[BUFF_SIZE];
-    snprintf(command, sizeof(command), "DOWNLOAD %s", filename);
+    if (offset > 0) {
+        snprintf(command, sizeof(command), "DOWNLOAD %s %lld %lld %s", filename, offset, LLONG_MAX, version);
+    } else {
+        snprintf(command, sizeof(command), "DOWNLOAD %s", filename);
+    }
     if (tcp_send(sockfd, command) <= 0) {
         printf(">> Failed to send command\n");
         return;
@@ -233,6 +356,17 @@ void do_download(int sockfd, conn_state_t *state) {
         return;
     }
     
+    /* The file changed on the server since the part was started: start over */
+    if (offset > 0 && (strncmp(buffer, "507", 3) == 0 || strncmp(buffer, "300", 3) == 0)) {
+        printf(">> File changed on the server since the last attempt. Downloading again...\n");
+        offset = 0;
+        snprintf(command, sizeof(command), "DOWNLOAD %s", filename);
+        if (tcp_send(sockfd, command) <= 0 || tcp_receive(sockfd, state, buffer, BUFF_SIZE) <= 0) {
+            printf(">> Failed to receive response\n");
+            return;
+        }
+    }
+    
     /* Check if it's 151 (ready to send) */
     int code;
     if (sscanf(buffer, "%d", &code) != 1) {
@@ -241,28 +375,36 @@ void do_download(int sockfd, conn_state_t *state) {
     }
     
     if (code == 151) {
-        /* Parse filesize from "151 <size>" */
-        if (sscanf(buffer, "151 %lld", &filesize) != 1) {
+        /* Parse range size and version from "151 <size> <version>" */
+        if (sscanf(buffer, "151 %lld %63s", &filesize, version) < 1) {
             printf(">> Invalid response format\n");
             return;
         }
         
-        printf(">> File found. Size: %lld bytes. Downloading...\n", filesize);
-        
-        /* Build download path */
-        char download_path[512];
-        snprintf(download_path, sizeof(download_path), "Downloads/%s", filename);
+        if (offset > 0) {
+            printf(">> Resuming from %lld bytes. %lld bytes left. Downloading...\n", offset, filesize);
+        } else {
+            printf(">> File found. Size: %lld bytes. Downloading...\n", filesize);
+        }
         
         /* Receive file content */
-        if (receive_file_content_client(sockfd, state, download_path, filesize) == 0) {
-            printf(">> File saved as: %s\n", download_path);
-            
-            /* Wait for final 150 response */
+        if (receive_file_content_client(sockfd, state, part_path, offset, filesize, version) == 0) {
+            /* Wait for final 150 response, with the digest of the whole file */
             if (tcp_receive(sockfd, state, buffer, BUFF_SIZE) > 0) {
+                if (strncmp(buffer, "150", 3) == 0 &&
+                    verify_digest(part_path, 0, offset + filesize, buffer) == 0) {
+                    /* Corrupt bytes must not be resumed from either */
+                    remove(part_path);
+                    printf(">> Downloaded data does not match %s, discarded. Try again.\n", buffer + 4);
+                    return;
+                }
+                if (strncmp(buffer, "150", 3) == 0 && rename(part_path, download_path) == 0) {
+                    printf(">> File saved as: %s\n", download_path);
+                }
                 print_response(buffer);
             }
         } else {
-            printf(">> Error during download.\n");
+            printf(">> Error during download. Run DOWNLOAD again to resume.\n");
         }
     } else {
         print_response(buffer);
@@ -5,24 +5,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/xattr.h>
+
+#include "framer.h"
+#include "trace.h"
+#include "digest.h"
 
 /* ==================== CONSTANTS ==================== */
 
 #define BUFF_SIZE 8192
 #define MAX_PATH 256
 #define CHUNK_SIZE 4096
+#define VERSION_XATTR "user.fs.version"    /* Server version a .part file was downloaded from */
+#define FILE_VERSION_SIZE 64
 
 /* ==================== DATA STRUCTURES ==================== */
 
 /* Connection state */
 typedef struct {
     char recv_buffer[BUFF_SIZE];
-    int buffer_pos;
+    framer_t framer;        /* Splits recv_buffer into response lines */
 } conn_state_t;
 
 /* ==================== FUNCTION PROTOTYPES ==================== */
@@ -32,7 +40,11 @@ int tcp_send(int sockfd, char *msg);
 int tcp_receive(int sockfd, conn_state_t *state, char *buffer, int max_len);
 int send_all(int sockfd, const void *buffer, int length);
 long long get_file_size(const char *filename);
-int receive_file_content_client(int sockfd, conn_state_t *state, const char *filepath, long long filesize);
+int hash_file(const char *filepath, long long offset, long long length, int algo,
+              char *text, size_t size);
+int verify_digest(const char *filepath, long long offset, long long length, const char *response);
+int receive_file_content_client(int sockfd, conn_state_t *state, const char *filepath,
+                                long long offset, long long filesize, const char *version);
 
 /* ui.c - UI functions */
 void print_main_menu();
@@ -42,6 +54,7 @@ void print_response(char *response);
 void do_register(int sockfd, conn_state_t *state);
 void do_login(int sockfd, conn_state_t *state, int *is_logged_in);
 void do_logout(int sockfd, conn_state_t *state, int *is_logged_in);
+void set_server_features(const char *greeting);
 void do_upload(int sockfd, conn_state_t *state);
 void do_download(int sockfd, conn_state_t *state);
 void do_create_group(int sockfd, conn_state_t *state);
@@ -37,41 +37,33 @@ int tcp_send(int sockfd, char *msg) {
  * @return: Length of received message on success, -1 on error
  **/
 int tcp_receive(int sockfd, conn_state_t *state, char *buffer, int max_len) {
-    int bytes_received, i;
+    int bytes_received, msg_len, avail;
+    char *line;
     
     while (1) {
         /* Check if we have \r\n in recv_buffer */
-        for (i = 0; i < state->buffer_pos - 1; i++) {
-            if (state->recv_buffer[i] == '\r' && state->recv_buffer[i + 1] == '\n') {
-                /* Found complete message */
-                int msg_len = i;
-                if (msg_len >= max_len) {
-                    msg_len = max_len - 1;
-                }
-                
-                memcpy(buffer, state->recv_buffer, msg_len);
-                buffer[msg_len] = '\0';
-                
-                /* Remove message from buffer */
-                state->buffer_pos -= (i + 2);
-                memmove(state->recv_buffer, state->recv_buffer + i + 2, state->buffer_pos);
-                
-                return msg_len;
+        msg_len = framer_next(&state->framer, &line);
+        if (msg_len >= 0) {
+            if (msg_len >= max_len) {
+                msg_len = max_len - 1;
             }
+            memcpy(buffer, line, msg_len);
+            buffer[msg_len] = '\0';
+            return msg_len;
         }
         
         /* Receive more data */
-        if (state->buffer_pos >= BUFF_SIZE - 1) {
+        char *space = framer_space(&state->framer, &avail);
+        if (avail == 0) {
             return -1; /* Buffer full */
         }
         
-        bytes_received = recv(sockfd, state->recv_buffer + state->buffer_pos, 
-                            BUFF_SIZE - state->buffer_pos - 1, 0);
+        bytes_received = recv(sockfd, space, avail, 0);
         if (bytes_received <= 0) {
             return -1;
         }
         
-        state->buffer_pos += bytes_received;
+        framer_commit(&state->framer, bytes_received);
     }
 }
 
@@ -124,39 +116,118 @@ long long get_file_size(const char *filename) {
     return -1; /* File does not exist */
 }
 
+/**
+ * @function hash_file: Digest a byte range of a local file
+ * @param filepath: Local file
+ * @param offset: First byte to hash
+ * @param length: Number of bytes to hash
+ * @param algo: DIGEST_CRC32C or DIGEST_SHA256
+ * @param text: Receives the digest text
+ * @param size: Size of text
+ * @return: 0 on success, -1 if the file cannot be read or is too short
+ **/
+int hash_file(const char *filepath, long long offset, long long length, int algo,
+              char *text, size_t size) {
+    FILE *fp = fopen(filepath, "rb");
+    if (fp == NULL || fseeko(fp, offset, SEEK_SET) != 0) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        return -1;
+    }
+
+    digest_t digest;
+    digest_init(&digest, algo);
+    char file_buf[65536];
+    while (length > 0) {
+        size_t n = fread(file_buf, 1, length < (long long)sizeof(file_buf) ? length : sizeof(file_buf), fp);
+        if (n == 0) {
+            break;
+        }
+        digest_update(&digest, file_buf, n);
+        length -= n;
+    }
+    fclose(fp);
+    if (length > 0) {
+        return -1;
+    }
+
+    digest_final(&digest, text, size);
+    return 0;
+}
+
+/**
+ * @function verify_digest: Check a local byte range against the server's digest
+ * @param filepath: Local file
+ * @param offset: First byte the digest covers
+ * @param length: Number of bytes it covers
+ * @param response: Completion response, "140 <digest>" or "150 <digest>"
+ * @return: 1 if the digests match, 0 if they differ, -1 if the response
+ *          carries no digest or the file cannot be read
+ **/
+int verify_digest(const char *filepath, long long offset, long long length, const char *response) {
+    const char *expected = strchr(response, ' ');
+    if (expected == NULL) {
+        return -1;
+    }
+    expected++;
+    int algo = digest_parse_algo(expected);
+    if (algo == -1 || algo == DIGEST_NONE) {
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(filepath, &st) != 0) {
+        return -1;
+    }
+
+    /* A local file shorter than what the digest covers cannot match */
+    char actual[DIGEST_TEXT_SIZE];
+    if (hash_file(filepath, offset, length, algo, actual, sizeof(actual)) == -1) {
+        return 0;
+    }
+    return strcmp(actual, expected) == 0;
+}
+
 /**
  * @function receive_file_content_client: Receive binary data from server and save to file
  * @param sockfd: Socket descriptor
  * @param state: Connection state
  * @param filepath: Full path to save the received file
- * @param filesize: Total size of the file to receive
+ * @param offset: Where the received bytes go in the file (0 truncates it)
+ * @param filesize: Number of bytes to receive
+ * @param version: Server's version of the file, recorded in VERSION_XATTR when
+ *                 the file is started (offset 0) so a resume can be checked
  * @return: 0 on success, -1 on file error, -2 on connection error
  **/
-int receive_file_content_client(int sockfd, conn_state_t *state, const char *filepath, long long filesize) {
-    FILE *fp = fopen(filepath, "wb");
-    if (fp == NULL) {
+int receive_file_content_client(int sockfd, conn_state_t *state, const char *filepath,
+                                long long offset, long long filesize, const char *version) {
+    FILE *fp = fopen(filepath, offset > 0 ? "r+b" : "wb");
+    if (fp != NULL && offset == 0) {
+        /* Without it the part is never resumed, only downloaded again */
+        fsetxattr(fileno(fp), VERSION_XATTR, version, strlen(version), 0);
+    }
+    if (fp == NULL || fseeko(fp, offset, SEEK_SET) != 0) {
         printf("Error: Cannot open file %s for writing.\n", filepath);
+        if (fp != NULL) {
+            fclose(fp);
+        }
         return -1;
     }
 
     long long total_received = 0;
     
     
-    if (state->buffer_pos > 0) {
-        long long to_write = state->buffer_pos;
+    if (framer_pending(&state->framer) > 0) {
+        long long to_write = framer_pending(&state->framer);
         
         if (to_write > filesize) {
             to_write = filesize;
         }
 
-        fwrite(state->recv_buffer, 1, to_write, fp);
+        fwrite(framer_data(&state->framer), 1, to_write, fp);
         total_received += to_write;
-
-        int remaining = state->buffer_pos - to_write;
-        if (remaining > 0) {
-            memmove(state->recv_buffer, state->recv_buffer + to_write, remaining);
-        }
-        state->buffer_pos = remaining;
+        framer_consume(&state->framer, to_write);
     }
 
     /* Receive remaining file data */
@@ -178,10 +249,12 @@ int receive_file_content_client(int sockfd, conn_state_t *state, const char *fil
         fwrite(file_buf, 1, n, fp);
         total_received += n;
         
-        printf("\rDownloading... %lld / %lld bytes", total_received, filesize);
+        TRACE_EVERY(TRACE_INFO, 100, "\rDownloading... %lld / %lld bytes",
+                    offset + total_received, offset + filesize);
     }
 
-    printf("\n");
+    TRACE(TRACE_INFO, "\rDownloading... %lld / %lld bytes\n",
+          offset + total_received, offset + filesize);
     fclose(fp);
     return 0;
 }
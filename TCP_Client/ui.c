@@ -64,11 +64,11 @@ void print_response(char *response) {
     } else if (strcmp(code, "130") == 0) {
         printf(">> Logout successful\n");
     } else if (strcmp(code, "140") == 0) {
-        printf(">> Upload successful\n");
+        printf(">> Upload successful%s\n", response + strlen(code));
     } else if (strcmp(code, "141") == 0) {
         printf(">> Server ready to receive file\n");
     } else if (strcmp(code, "150") == 0) {
-        printf(">> Download successful\n");
+        printf(">> Download successful%s\n", response + strlen(code));
     } else if (strcmp(code, "151") == 0) {
         printf(">> Server ready to send file\n");
     } else if (strcmp(code, "160") == 0) {
@@ -99,7 +99,7 @@ void print_response(char *response) {
     } else if (strcmp(code, "211") == 0) {
         printf(">> File deleted successfully\n");
     } else if (strcmp(code, "212") == 0) {
-        printf(">> File copied successfully\n");
+        printf(">> File copied successfully%s\n", response + strlen(code));
     } else if (strcmp(code, "213") == 0) {
         printf(">> File moved successfully\n");
     } else if (strcmp(code, "220") == 0) {
@@ -109,7 +109,13 @@ void print_response(char *response) {
     } else if (strcmp(code, "222") == 0) {
         printf(">> Folder deleted successfully\n");
     } else if (strcmp(code, "223") == 0) {
-        printf(">> Folder copied successfully\n");
+        long files;
+        long long bytes;
+        if (sscanf(response, "223 %ld %lld", &files, &bytes) == 2) {
+            printf(">> Folder copied successfully (%ld files, %lld bytes)\n", files, bytes);
+        } else {
+            printf(">> Folder copied successfully\n");
+        }
     } else if (strcmp(code, "224") == 0) {
         printf(">> Folder moved successfully\n");
     } else if (strcmp(code, "225") == 0) {
@@ -147,6 +153,10 @@ void print_response(char *response) {
         printf(">> Error: Internal server error\n");
     } else if (strcmp(code, "505") == 0) {
         printf(">> Error: File is being used (uploading/downloading)\n");
+    } else if (strcmp(code, "507") == 0) {
+        printf(">> Error: File changed on the server\n");
+    } else if (strcmp(code, "508") == 0) {
+        printf(">> Error: Server busy, connection closed. Try again later\n");
     } else {
         printf(">> Response: %s\n", response);
     }
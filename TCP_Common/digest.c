@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <string.h>
+#include "digest.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+/* ==================== CRC32C ==================== */
+
+#define CRC32C_POLY 0x82f63b78u     /* Castagnoli, reflected */
+
+/**
+ * @function crc32c_soft: Bitwise CRC32C for CPUs without SSE4.2
+ * @param crc: Running value
+ * @param p: Data
+ * @param len: Number of bytes
+ * @return: Updated running value
+ **/
+static uint32_t crc32c_soft(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * @function crc32c_sse42: CRC32C with the SSE4.2 crc32 instruction, 8 bytes per step
+ * @param crc: Running value
+ * @param p: Data
+ * @param len: Number of bytes
+ * @return: Updated running value
+ **/
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+/**
+ * @function crc32c_update: CRC32C over a buffer, with the fastest code the CPU runs
+ * @param crc: Running value
+ * @param p: Data
+ * @param len: Number of bytes
+ * @return: Updated running value
+ **/
+static uint32_t crc32c_update(uint32_t crc, const unsigned char *p, size_t len) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return crc32c_sse42(crc, p, len);
+    }
+#endif
+    return crc32c_soft(crc, p, len);
+}
+
+/* ==================== SHA-256 ==================== */
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * @function sha256_block: Fold one 64-byte block into the chaining value
+ * @param state: Chaining value
+ * @param p: Block
+ **/
+static void sha256_block(uint32_t state[8], const unsigned char *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+               (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) +
+                      sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+#if defined(__x86_64__)
+/**
+ * @function sha256_blocks_shani: Fold blocks with the SHA extensions (SHA-NI)
+ * @param state: Chaining value
+ * @param p: Blocks
+ * @param blocks: Number of 64-byte blocks
+ * @note: The instructions want the state as ABEF/CDGH halves and the message
+ *        words big-endian; each round group does 4 rounds with two sha256rnds2
+ **/
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t state[8], const unsigned char *p, size_t blocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);      /* ABEF */
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);            /* CDGH */
+
+    while (blocks--) {
+        __m128i abef = state0, cdgh = state1;
+        __m128i w[4];
+
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * i)), bswap);
+            } else {
+                /* w[i & 3] holds W[i-4..i-1] and becomes W[i..i+3] */
+                __m128i w7 = _mm_alignr_epi8(w[(i - 1) & 3], w[(i - 2) & 3], 4);
+                w[i & 3] = _mm_sha256msg2_epu32(
+                    _mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i - 3) & 3]), w7),
+                    w[(i - 1) & 3]);
+            }
+            __m128i m = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)&sha256_k[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(m, 0x0e));
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        p += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);                  /* FEBA */
+    state1 = _mm_shuffle_epi32(state1, 0xb1);               /* DCHG */
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xf0));    /* DCBA */
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));       /* HGFE */
+}
+
+/**
+ * @function cpu_has_sha: Whether the CPU has the SHA extensions
+ * @return: Non-zero if it does
+ **/
+static int cpu_has_sha() {
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (ebx & bit_SHA) != 0 && __builtin_cpu_supports("sse4.1");
+}
+#endif
+
+/**
+ * @function sha256_blocks: Fold whole blocks, with SHA-NI when the CPU has it
+ * @param state: Chaining value
+ * @param p: Blocks
+ * @param blocks: Number of 64-byte blocks
+ **/
+static void sha256_blocks(uint32_t state[8], const unsigned char *p, size_t blocks) {
+#if defined(__x86_64__)
+    static int has_sha = -1;    /* Same answer from every thread, so the race is harmless */
+    if (has_sha == -1) {
+        has_sha = cpu_has_sha();
+    }
+    if (has_sha) {
+        sha256_blocks_shani(state, p, blocks);
+        return;
+    }
+#endif
+    while (blocks--) {
+        sha256_block(state, p);
+        p += 64;
+    }
+}
+
+/**
+ * @function sha256_update: Feed bytes into a SHA-256 computation
+ * @param d: Digest
+ * @param p: Data
+ * @param len: Number of bytes
+ **/
+static void sha256_update(digest_t *d, const unsigned char *p, size_t len) {
+    d->bytes += len;
+    if (d->used > 0) {
+        size_t take = 64 - (size_t)d->used < len ? 64 - (size_t)d->used : len;
+        memcpy(d->block + d->used, p, take);
+        d->used += take;
+        p += take;
+        len -= take;
+        if (d->used < 64) {
+            return;
+        }
+        sha256_blocks(d->state, d->block, 1);
+        d->used = 0;
+    }
+    sha256_blocks(d->state, p, len / 64);
+    p += len & ~(size_t)63;
+    len &= 63;
+    memcpy(d->block, p, len);
+    d->used = len;
+}
+
+/* ==================== DIGEST API ==================== */
+
+/**
+ * @function digest_init: Start a digest
+ * @param d: Digest
+ * @param algo: DIGEST_* (DIGEST_NONE makes every call a no-op)
+ **/
+void digest_init(digest_t *d, int algo) {
+    static const uint32_t sha256_iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memset(d, 0, sizeof(*d));
+    d->algo = algo;
+    d->crc = 0xffffffffu;
+    memcpy(d->state, sha256_iv, sizeof(sha256_iv));
+}
+
+/**
+ * @function digest_update: Feed the next bytes of the content
+ * @param d: Digest, or NULL when nothing is being hashed
+ * @param data: Data
+ * @param len: Number of bytes
+ **/
+void digest_update(digest_t *d, const void *data, size_t len) {
+    if (d == NULL) {
+        return;
+    }
+    if (d->algo == DIGEST_CRC32C) {
+        d->crc = crc32c_update(d->crc, data, len);
+    } else if (d->algo == DIGEST_SHA256) {
+        sha256_update(d, data, len);
+    }
+}
+
+/**
+ * @function digest_final: Finish a digest and format it as "<algo>:<hex>"
+ * @param d: Digest (cannot be updated afterwards)
+ * @param text: Buffer, DIGEST_TEXT_SIZE bytes is always enough
+ * @param size: Size of text
+ * @return: 0 on success, -1 for DIGEST_NONE (text is set to "")
+ **/
+int digest_final(digest_t *d, char *text, size_t size) {
+    if (d->algo == DIGEST_CRC32C) {
+        snprintf(text, size, "crc32c:%08x", ~d->crc);
+        return 0;
+    }
+    if (d->algo != DIGEST_SHA256) {
+        if (size > 0) {
+            text[0] = '\0';
+        }
+        return -1;
+    }
+
+    /* Padding: 0x80, zeros, then the bit length big-endian */
+    uint64_t bits = d->bytes * 8;
+    d->block[d->used++] = 0x80;
+    if (d->used > 56) {
+        memset(d->block + d->used, 0, 64 - d->used);
+        sha256_blocks(d->state, d->block, 1);
+        d->used = 0;
+    }
+    memset(d->block + d->used, 0, 56 - d->used);
+    for (int i = 0; i < 8; i++) {
+        d->block[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    sha256_blocks(d->state, d->block, 1);
+
+    int n = snprintf(text, size, "sha256:");
+    for (int i = 0; i < 8 && n >= 0 && (size_t)n < size; i++) {
+        n += snprintf(text + n, size - n, "%08x", d->state[i]);
+    }
+    return 0;
+}
+
+/**
+ * @function digest_parse_algo: Algorithm named by "crc32c", "sha256" or "none"
+ * @param name: Name, may be followed by ":<hex>"
+ * @return: DIGEST_*, -1 if not understood
+ **/
+int digest_parse_algo(const char *name) {
+    size_t len = strcspn(name, ":");
+    for (int algo = DIGEST_NONE; algo <= DIGEST_SHA256; algo++) {
+        const char *known = digest_algo_name(algo);
+        if (strlen(known) == len && strncmp(name, known, len) == 0) {
+            return algo;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @function digest_algo_name: Name of an algorithm
+ * @param algo: DIGEST_*
+ * @return: "none", "crc32c" or "sha256"
+ **/
+const char *digest_algo_name(int algo) {
+    switch (algo) {
+        case DIGEST_CRC32C: return "crc32c";
+        case DIGEST_SHA256: return "sha256";
+        default: return "none";
+    }
+}
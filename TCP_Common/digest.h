@@ -0,0 +1,44 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ==================== CONTENT DIGESTS ==================== */
+
+/*
+ * Streaming checksums of file bodies, shared by the server and the client.
+ *
+ *   digest_t d;
+ *   digest_init(&d, DIGEST_CRC32C);
+ *   digest_update(&d, buf, n);          ...for every piece, in order
+ *   digest_final(&d, text, sizeof(text));   -> "crc32c:1a2b3c4d"
+ *
+ * CRC32C (Castagnoli) uses the SSE4.2 crc32 instruction when the CPU has it
+ * and a bitwise loop otherwise; it catches truncation and corruption in
+ * transit. SHA-256 is for when a cryptographic digest is wanted; it uses the
+ * SHA extensions (SHA-NI) when present and is several times slower without.
+ */
+
+#define DIGEST_NONE 0
+#define DIGEST_CRC32C 1
+#define DIGEST_SHA256 2
+
+#define DIGEST_TEXT_SIZE 80     /* "sha256:" + 64 hex digits + NUL, rounded up */
+
+typedef struct {
+    int algo;
+    uint32_t crc;               /* CRC32C: running value (inverted) */
+    uint32_t state[8];          /* SHA-256: chaining value */
+    uint64_t bytes;             /* SHA-256: total length */
+    unsigned char block[64];    /* SHA-256: partial block */
+    int used;                   /* SHA-256: bytes in block */
+} digest_t;
+
+void digest_init(digest_t *d, int algo);
+void digest_update(digest_t *d, const void *data, size_t len);
+int digest_final(digest_t *d, char *text, size_t size);
+int digest_parse_algo(const char *name);
+const char *digest_algo_name(int algo);
+
+#endif /* DIGEST_H */
@@ -0,0 +1,129 @@
+#include <string.h>
+#include "framer.h"
+
+/**
+ * @function framer_init: Attach storage to a framer and empty it
+ * @param f: Framer
+ * @param storage: Buffer of capacity bytes, owned by the caller
+ * @param capacity: Size of storage; also the longest accepted line
+ **/
+void framer_init(framer_t *f, char *storage, int capacity) {
+    f->buf = storage;
+    f->capacity = capacity;
+    f->read_pos = 0;
+    f->scan_pos = 0;
+    f->write_pos = 0;
+}
+
+/**
+ * @function framer_relocate: Switch to new storage, carrying the pending bytes over
+ * @param f: Framer
+ * @param storage: New buffer (may be NULL when nothing is pending)
+ * @param capacity: Size of storage, at least framer_pending()
+ * @note: The old storage is not referenced afterwards; the caller frees it
+ **/
+void framer_relocate(framer_t *f, char *storage, int capacity) {
+    int pending = f->write_pos - f->read_pos;
+    if (pending > 0) {
+        memcpy(storage, f->buf + f->read_pos, pending);
+    }
+
+    f->buf = storage;
+    f->capacity = capacity;
+    f->scan_pos -= f->read_pos;
+    f->write_pos = pending;
+    f->read_pos = 0;
+}
+
+/**
+ * @function framer_next: Pop the next complete line
+ * @param f: Framer
+ * @param line: Receives the start of the line, NUL-terminated, inside f->buf
+ * @return: Length of the line, -1 if no complete line is buffered yet
+ * @note: Only bytes received since the last call are scanned, with memchr
+ *        (vectorized by libc), so bursty input costs O(bytes) overall
+ **/
+int framer_next(framer_t *f, char **line) {
+    while (f->scan_pos < f->write_pos) {
+        char *nl = memchr(f->buf + f->scan_pos, '\n', f->write_pos - f->scan_pos);
+        if (nl == NULL) {
+            f->scan_pos = f->write_pos;
+            return -1;
+        }
+
+        int pos = nl - f->buf;
+        f->scan_pos = pos + 1;
+        if (pos > f->read_pos && f->buf[pos - 1] == '\r') {
+            int len = pos - 1 - f->read_pos;
+            f->buf[pos - 1] = '\0';
+            *line = f->buf + f->read_pos;
+            f->read_pos = pos + 1;
+            return len;
+        }
+        /* Bare \n inside a line: keep scanning */
+    }
+    return -1;
+}
+
+/**
+ * @function framer_space: Get the free tail to recv() into
+ * @param f: Framer
+ * @param avail: Receives the number of free bytes (0 when a single line fills the buffer)
+ * @return: Write position inside f->buf
+ * @note: Invalidates slices returned by framer_next
+ **/
+char *framer_space(framer_t *f, int *avail) {
+    if (f->read_pos == f->write_pos) {
+        /* Everything consumed: rewind for free */
+        f->read_pos = f->scan_pos = f->write_pos = 0;
+    } else if (f->write_pos == f->capacity && f->read_pos > 0) {
+        /* Out of tail room: move the partial line to the front, once */
+        int pending = f->write_pos - f->read_pos;
+        memmove(f->buf, f->buf + f->read_pos, pending);
+        f->scan_pos -= f->read_pos;
+        f->write_pos = pending;
+        f->read_pos = 0;
+    }
+
+    *avail = f->capacity - f->write_pos;
+    return f->buf + f->write_pos;
+}
+
+/**
+ * @function framer_commit: Account bytes written into the space from framer_space
+ * @param f: Framer
+ * @param n: Number of bytes received
+ **/
+void framer_commit(framer_t *f, int n) {
+    f->write_pos += n;
+}
+
+/**
+ * @function framer_pending: Number of received bytes not handed out yet
+ * @param f: Framer
+ * @return: Byte count
+ **/
+int framer_pending(const framer_t *f) {
+    return f->write_pos - f->read_pos;
+}
+
+/**
+ * @function framer_data: Start of the pending bytes (raw, e.g. a file body)
+ * @param f: Framer
+ * @return: Pointer inside f->buf
+ **/
+char *framer_data(const framer_t *f) {
+    return f->buf + f->read_pos;
+}
+
+/**
+ * @function framer_consume: Drop pending bytes taken as raw data
+ * @param f: Framer
+ * @param n: Number of bytes, at most framer_pending()
+ **/
+void framer_consume(framer_t *f, int n) {
+    f->read_pos += n;
+    if (f->scan_pos < f->read_pos) {
+        f->scan_pos = f->read_pos;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef FRAMER_H
+#define FRAMER_H
+
+/* ==================== LINE FRAMER ==================== */
+
+/*
+ * Receive buffer that splits a TCP byte stream into \r\n terminated lines.
+ * Shared by the server and the client.
+ *
+ *   buf: [ consumed | pending (scanned | unscanned) | free ]
+ *                   ^read_pos          ^scan_pos    ^write_pos
+ *
+ * Lines are handed out as slices of buf, NUL-terminated in place of the \r,
+ * so nothing is copied. A slice stays valid until the next framer_space()
+ * call, which is the only place data moves (and only when the free tail
+ * has run out). Storage may be NULL while nothing is pending, so idle
+ * connections need not hold a buffer.
+ */
+typedef struct {
+    char *buf;
+    int capacity;
+    int read_pos;       /* First byte not yet handed out */
+    int scan_pos;       /* Bytes before this hold no \n of the pending line */
+    int write_pos;      /* End of received data */
+} framer_t;
+
+void framer_init(framer_t *f, char *storage, int capacity);
+void framer_relocate(framer_t *f, char *storage, int capacity);
+int framer_next(framer_t *f, char **line);
+char *framer_space(framer_t *f, int *avail);
+void framer_commit(framer_t *f, int n);
+int framer_pending(const framer_t *f);
+char *framer_data(const framer_t *f);
+void framer_consume(framer_t *f, int n);
+
+#endif /* FRAMER_H */
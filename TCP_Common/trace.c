@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "trace.h"
+
+int trace_level = TRACE_INFO;
+
+/**
+ * @function trace_init: Set the run-time trace level
+ * @param default_level: Level used when FS_TRACE is unset or not understood
+ * @note: Call once from main, before any thread starts
+ **/
+void trace_init(int default_level) {
+    static const char *names[] = { "off", "error", "warn", "info", "debug" };
+    const char *env = getenv("FS_TRACE");
+
+    trace_level = default_level;
+    if (env == NULL || env[0] == '\0') {
+        return;
+    }
+    if (env[0] >= '0' && env[0] <= '4' && env[1] == '\0') {
+        trace_level = env[0] - '0';
+        return;
+    }
+    for (int i = 0; i <= TRACE_DEBUG; i++) {
+        if (strcmp(env, names[i]) == 0) {
+            trace_level = i;
+            return;
+        }
+    }
+    fprintf(stderr, "FS_TRACE=%s not understood (off|error|warn|info|debug)\n", env);
+}
+
+/**
+ * @function trace_now_ns: Coarse monotonic clock
+ * @return: Nanoseconds, to within a few milliseconds
+ **/
+static long long trace_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @function trace_allow: Take one line from a site's per-second budget
+ * @param site: Call site
+ * @return: 1 if the line may be printed, 0 if it is held back
+ * @note: Racing threads may let a line or two past the budget at a second
+ *        boundary; that is fine for console output
+ **/
+int trace_allow(trace_site_t *site) {
+    long long second = trace_now_ns() / 1000000000LL;
+    long long window = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+
+    if (window != second &&
+        __atomic_compare_exchange_n(&site->window, &window, second, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+    }
+    if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) < TRACE_SITE_BURST) {
+        return 1;
+    }
+    __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * @function trace_allow_every: Let a site print at most once per interval
+ * @param site: Call site
+ * @param interval_ms: Minimum time between two lines
+ * @return: 1 if the line may be printed, 0 if it is dropped
+ **/
+int trace_allow_every(trace_site_t *site, int interval_ms) {
+    long long now = trace_now_ns();
+    long long next = __atomic_load_n(&site->window, __ATOMIC_RELAXED);
+
+    return now >= next &&
+           __atomic_compare_exchange_n(&site->window, &next, now + interval_ms * 1000000LL, 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/**
+ * @function trace_emit: Print one trace line
+ * @param site: Call site whose held-back lines are reported, or NULL
+ * @param fmt: printf format
+ **/
+void trace_emit(trace_site_t *site, const char *fmt, ...) {
+    char line[1024];
+    int len = 0;
+    va_list ap;
+
+    if (site != NULL) {
+        int suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+        if (suppressed > 0) {
+            len = snprintf(line, sizeof(line), "(%d similar lines suppressed)\n", suppressed);
+        }
+    }
+
+    va_start(ap, fmt);
+    int n = vsnprintf(line + len, sizeof(line) - len, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return;
+    }
+    len += n;
+    if (len >= (int)sizeof(line)) {
+        len = sizeof(line) - 1;
+    }
+
+    fwrite(line, 1, len, stdout);
+}
@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* ==================== CONSOLE TRACING ==================== */
+
+/*
+ * printf-style console messages with two level gates and a per-site budget.
+ * Shared by the server and the client.
+ *
+ *   TRACE(TRACE_INFO, "Upload complete: %s\n", name);
+ *
+ * - Compile time: sites above TRACE_LEVEL_MAX are removed by the compiler,
+ *   arguments included. Build with TRACE=off (-DTRACE_LEVEL_MAX=0) for a
+ *   binary without any trace code.
+ * - Run time: sites above trace_level cost one load and a branch. The level
+ *   comes from the FS_TRACE environment variable (off, error, warn, info,
+ *   debug or 0-4), read once by trace_init.
+ * - Each TRACE site prints at most TRACE_SITE_BURST lines per second; the
+ *   number it held back is reported with its next line. TRACE_EVERY prints
+ *   at most once per interval and drops the rest silently, for progress
+ *   displays where only the latest value matters.
+ *
+ * A line is formatted into a local buffer and handed to stdio in a single
+ * call, so threads do not interleave inside a line.
+ */
+
+#define TRACE_OFF 0
+#define TRACE_ERROR 1
+#define TRACE_WARN 2
+#define TRACE_INFO 3
+#define TRACE_DEBUG 4
+
+#ifndef TRACE_LEVEL_MAX
+#define TRACE_LEVEL_MAX TRACE_DEBUG
+#endif
+
+#define TRACE_SITE_BURST 20     /* Lines per second per TRACE site */
+
+/* Per call site budget, one static instance per macro expansion */
+typedef struct {
+    long long window;       /* TRACE: current second; TRACE_EVERY: next allowed time (ns) */
+    int count;              /* Lines printed in the current second */
+    int suppressed;         /* Lines held back since the last printed one */
+} trace_site_t;
+
+extern int trace_level;
+
+void trace_init(int default_level);
+int trace_allow(trace_site_t *site);
+int trace_allow_every(trace_site_t *site, int interval_ms);
+void trace_emit(trace_site_t *site, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define TRACE_ENABLED(level) ((level) <= TRACE_LEVEL_MAX && (level) <= trace_level)
+
+#define TRACE(level, ...) do { \
+    if (TRACE_ENABLED(level)) { \
+        static trace_site_t trace_site_; \
+        if (trace_allow(&trace_site_)) { \
+            trace_emit(&trace_site_, __VA_ARGS__); \
+        } \
+    } \
+} while (0)
+
+#define TRACE_EVERY(level, interval_ms, ...) do { \
+    if (TRACE_ENABLED(level)) { \
+        static trace_site_t trace_site_; \
+        if (trace_allow_every(&trace_site_, (interval_ms))) { \
+            trace_emit(NULL, __VA_ARGS__); \
+        } \
+    } \
+} while (0)
+
+#endif /* TRACE_H */
@@ -42,32 +42,23 @@ void handle_register(conn_state_t *state, char *command) {
     pthread_mutex_lock(&account_mutex);
     
     /* Check if username already exists */
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, username) == 0) {
-            pthread_mutex_unlock(&account_mutex);
-            tcp_send(state->sockfd, "501");
-            write_log_detailed(state->client_addr, command, "-ERR Username already exists");
-            return;
-        }
+    if (store_find_account(username) != -1) {
+        pthread_mutex_unlock(&account_mutex);
+        tcp_send(state->sockfd, "501");
+        write_log_detailed(state->client_addr, command, "-ERR Username already exists");
+        return;
     }
     
-    /* Check if account limit reached */
-    if (account_count >= MAX_ACCOUNTS) {
+    /* Create new account (fails only when out of memory) */
+    if (store_add_account(username, password) == -1) {
         pthread_mutex_unlock(&account_mutex);
         tcp_send(state->sockfd, "504");
-        write_log_detailed(state->client_addr, command, "-ERR Server full");
+        write_log_detailed(state->client_addr, command, "-ERR Out of memory");
         return;
     }
     
-    /* Create new account */
-    strcpy(accounts[account_count].username, username);
-    strcpy(accounts[account_count].password, password);
-    accounts[account_count].group_id = -1;  /* Not in any group */
-    accounts[account_count].is_logged_in = 0;
-    account_count++;
-    
-    /* Save to file */
-    save_accounts();
+    /* Record the new account */
+    journal_write("ACC %s %s", username, password);
     
     pthread_mutex_unlock(&account_mutex);
     
@@ -75,7 +66,7 @@ void handle_register(conn_state_t *state, char *command) {
     
     /* Log the registration */
     write_log_detailed(state->client_addr, command, "+OK New user registered");
-    printf("New user registered: %s\n", username);
+    TRACE(TRACE_INFO, "New user registered: %s\n", username);
 }
 
 /**
@@ -110,13 +101,7 @@ void handle_login(conn_state_t *state, char *command) {
     pthread_mutex_lock(&account_mutex);
     
     /* Find account */
-    int found = -1;
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, username) == 0) {
-            found = i;
-            break;
-        }
-    }
+    int found = store_find_account(username);
     
     /* Account does not exist */
     if (found == -1) {
@@ -127,7 +112,7 @@ void handle_login(conn_state_t *state, char *command) {
     }
     
     /* Check password */
-    if (strcmp(accounts[found].password, password) != 0) {
+    if (strcmp(ACCOUNT(found).password, password) != 0) {
         pthread_mutex_unlock(&account_mutex);
         tcp_send(state->sockfd, "401");
         write_log_detailed(state->client_addr, command, "-ERR Wrong password");
@@ -135,7 +120,7 @@ void handle_login(conn_state_t *state, char *command) {
     }
     
     /* Check if already logged in on another client */
-    if (accounts[found].is_logged_in) {
+    if (ACCOUNT(found).is_logged_in) {
         pthread_mutex_unlock(&account_mutex);
         tcp_send(state->sockfd, "403");
         write_log_detailed(state->client_addr, command, "-ERR Already logged in on another client");
@@ -143,10 +128,14 @@ void handle_login(conn_state_t *state, char *command) {
     }
     
     /* Login successful */
-    accounts[found].is_logged_in = 1;
+    ACCOUNT(found).is_logged_in = 1;
     strcpy(state->logged_user, username);
     state->is_logged_in = 1;
-    state->user_group_id = accounts[found].group_id;
+    state->account_idx = found;
+    state->membership_version = store_membership_version(found);
+    state->user_group_id = ACCOUNT(found).group_id;
+    state->is_group_leader = state->user_group_id != -1 &&
+                             is_group_leader(username, state->user_group_id);
     
     pthread_mutex_unlock(&account_mutex);
     
@@ -154,7 +143,7 @@ void handle_login(conn_state_t *state, char *command) {
     
     /* Log the login */
     write_log_detailed(state->client_addr, command, "+OK User logged in");
-    printf("User logged in: %s\n", username);
+    TRACE(TRACE_INFO, "User logged in: %s\n", username);
 }
 
 /**
@@ -167,26 +156,14 @@ void handle_login(conn_state_t *state, char *command) {
  *   300: Syntax error
  **/
 void handle_logout(conn_state_t *state, char *command) {
-    /* Role-based access control */
-    char *rbac_result = role_based_access_control("LOGOUT", state);
-    if (rbac_result != NULL) {
-        tcp_send(state->sockfd, rbac_result);
-        return;
-    }
-    
     pthread_mutex_lock(&account_mutex);
     
-    /* Find account and mark as logged out */
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, state->logged_user) == 0) {
-            accounts[i].is_logged_in = 0;
-            break;
-        }
-    }
+    /* Mark account as logged out */
+    ACCOUNT(state->account_idx).is_logged_in = 0;
     
     pthread_mutex_unlock(&account_mutex);
     
-    printf("User logged out: %s\n", state->logged_user);
+    TRACE(TRACE_INFO, "User logged out: %s\n", state->logged_user);
     
     tcp_send(state->sockfd, "130");
     
@@ -195,7 +172,9 @@ void handle_logout(conn_state_t *state, char *command) {
     
     /* Clear state */
     state->is_logged_in = 0;
+    state->account_idx = -1;
     state->user_group_id = -1;
+    state->is_group_leader = 0;
     state->logged_user[0] = '\0';
 }
 
@@ -1,6 +1,10 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* accept4, splice, sendfile and friends */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,20 +18,69 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <time.h>
+#include <signal.h>
+
+#include "framer.h"
+#include "trace.h"
+#include "digest.h"
 
 /* ==================== CONSTANTS ==================== */
 
 #define BUFF_SIZE 65536
-#define MAX_ACCOUNTS 100
-#define MAX_GROUPS 50
-#define MAX_REQUESTS 200
-#define MAX_INVITES 200
 #define MAX_USERNAME 50
 #define MAX_PASSWORD 50
 #define MAX_GROUPNAME 50
 #define MAX_PATH 256
-#define BACKLOG 20
+#define BACKLOG 1024           /* Per listener; absorbs reconnect storms */
 #define CHUNK_SIZE 4096
+#define MAX_EVENTS 256          /* epoll events handled per wakeup */
+#define MAX_REACTORS 256        /* Upper bound for -r */
+#define TABLE_CHUNK_SHIFT 10    /* 1024 records per table chunk */
+#define TABLE_CHUNK_RECORDS (1 << TABLE_CHUNK_SHIFT)
+#define TABLE_MAX_CHUNKS 65536  /* Up to 64M records per table */
+#define TABLE_MAX_RECORDS (TABLE_CHUNK_RECORDS * TABLE_MAX_CHUNKS)
+#define IO_TIMEOUT_MS 60000     /* Max wait for a stalled peer mid-transfer */
+#define TCP_WOULD_BLOCK -2      /* tcp_receive: no complete message yet */
+#define POOL_QUEUE_SIZE 1024    /* Default bound of the command queue */
+#define TRANSFER_UNSUPPORTED -3 /* Transfer engine cannot run, use the copy engine */
+#define SPLICE_PIPE_SIZE (1024 * 1024)  /* Requested size of each worker's splice pipe */
+#define RECV_BUF_MIN 4096       /* First receive buffer of a connection, grown x4 up to BUFF_SIZE */
+#define BUFFER_CLASSES 3        /* Buffer pool size classes: 4 KB, 16 KB, BUFF_SIZE */
+#define JOURNAL_COMPACT_BYTES (4 * 1024 * 1024)  /* Journal size that triggers compaction */
+#define DIGEST_XATTR "user.fs.digest"  /* Extended attribute holding a file's digest */
+#define FILE_VERSION_SIZE 64    /* "<inode>-<size>-<mtime>" in hex, as sent in 151 */
+
+/* I/O backend for file bodies (-b) */
+#define IO_BACKEND_COPY 0       /* Blocking loops; sendfile/splice when possible */
+#define IO_BACKEND_URING 1      /* Batched io_uring with registered buffers */
+
+/* When an upload is flushed to disk before it is published (-F) */
+#define SYNC_NONE 0             /* Leave it to the kernel's writeback */
+#define SYNC_FILE 1             /* fdatasync the file before the rename */
+#define SYNC_FULL 2             /* ...and fsync the directory after it */
+
+/* COPY_FILE strategies, cheapest first (copy_file) */
+#define COPY_LINK 0             /* -d: hard link to the same body */
+#define COPY_REFLINK 1          /* ioctl(FICLONE), copy-on-write extents */
+#define COPY_RANGE 2            /* copy_file_range(2) in the kernel */
+#define COPY_BUFFERED 3         /* pread/pwrite loop */
+#define COPY_STRATEGIES 4
+#define COPY_ERR_SOURCE -1      /* copy_file: source cannot be read */
+#define COPY_ERR_DEST -2        /* copy_file: destination cannot be created */
+#define COPY_ERR_IO -3          /* copy_file: copying failed */
+
+/* Transfer engines, indexes into the transfer statistics */
+#define ENGINE_COPY 0
+#define ENGINE_URING 1
+#define ENGINE_SENDFILE 2
+#define ENGINE_SPLICE 3
+#define ENGINE_COUNT 4
+
+/* Roles a command can require, checked by the dispatcher */
+#define ROLE_ANONYMOUS 0        /* Anyone, even before LOGIN */
+#define ROLE_LOGGED_IN 1
+#define ROLE_MEMBER 2           /* Logged in and in a group */
+#define ROLE_LEADER 3           /* Logged in and leader of their group */
 
 /* ==================== DATA STRUCTURES ==================== */
 
@@ -58,66 +111,210 @@ typedef struct {
     int group_id;
 } invite_t;
 
+/* Growable table of fixed-size records (table.c); records never move */
+typedef struct {
+    void *chunk[TABLE_MAX_CHUNKS];
+    int chunks;             /* Chunks allocated */
+} table_t;
+
+/* Record idx of a table, as an lvalue */
+#define TABLE_AT(t, type, idx) \
+    (((type *)(t).chunk[(idx) >> TABLE_CHUNK_SHIFT])[(idx) & (TABLE_CHUNK_RECORDS - 1)])
+#define ACCOUNT(idx) TABLE_AT(accounts, account_t, idx)
+#define GROUP(idx) TABLE_AT(groups, group_t, idx)
+#define REQUEST(idx) TABLE_AT(requests, request_t, idx)
+#define INVITE(idx) TABLE_AT(invites, invite_t, idx)
+
 /* Connection state for each client */
 typedef struct {
-    char recv_buffer[BUFF_SIZE];
-    int buffer_pos;
+    framer_t framer;        /* Splits received bytes into command lines; its
+                             * buffer is borrowed only while bytes are pending */
     int sockfd;
     char logged_user[MAX_USERNAME];
     int is_logged_in;
+    int account_idx;        /* Index into accounts[] while logged in */
+    unsigned membership_version;    /* Account version the two caches below match */
     int user_group_id;      /* Cache of user's group_id */
+    int is_group_leader;    /* Cache: user leads user_group_id */
     char client_addr[50];   /* Client IP:Port for logging */
+    int epfd;               /* epoll instance that owns this socket */
 } conn_state_t;
 
+/* Task run by a worker thread */
+typedef void (*task_fn_t)(void *arg);
+
+typedef struct {
+    task_fn_t fn;
+    void *arg;
+    long long enqueued_ns;  /* Monotonic time the task was queued */
+} task_t;
+
+/* Fixed-size worker pool fed by a bounded MPMC queue */
+typedef struct {
+    task_t *queue;          /* Ring of capacity slots */
+    int capacity;
+    int head;
+    int tail;
+    int count;
+    int shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_t *threads;
+    int thread_count;
+    /* Sizing statistics, protected by lock */
+    int depth_max;
+    long long submitted;
+    long long started;
+    long long full_waits;   /* Submits that blocked on a full queue */
+    long long rejected;     /* Try-submits turned away by a full queue */
+    long long wait_ns_total;
+    long long wait_ns_max;
+} thread_pool_t;
+
 /* ==================== GLOBAL VARIABLES ==================== */
 
-extern account_t accounts[MAX_ACCOUNTS];
+extern table_t accounts;
 extern int account_count;
 extern pthread_mutex_t account_mutex;
 
-extern group_t groups[MAX_GROUPS];
+extern table_t groups;
 extern int group_count;
 extern pthread_mutex_t group_mutex;
 
-extern request_t requests[MAX_REQUESTS];
+extern table_t requests;
 extern int request_count;
 extern pthread_mutex_t request_mutex;
 
-extern invite_t invites[MAX_INVITES];
+extern table_t invites;
 extern int invite_count;
 extern pthread_mutex_t invite_mutex;
 
 extern pthread_mutex_t file_mutex;
 
+extern thread_pool_t command_pool;
+extern thread_pool_t copy_pool;
+extern volatile sig_atomic_t stats_requested;
+extern int io_backend;
+extern int digest_algo;
+
 /* ==================== FUNCTION PROTOTYPES ==================== */
 
-/* utils.c - Data loading/saving functions */
+/* utils.c - Legacy text import and group helpers */
 void load_accounts();
 void load_groups();
 void load_requests();
 void load_invites();
-void save_accounts();
-void save_groups();
-void save_requests();
-void save_invites();
-void write_log(const char *message);
-void write_log_detailed(const char *client_addr, const char *request, const char *result);
-void get_log_filename(char *filename, size_t size);
-int get_next_group_id();
 char* get_group_folder_path(int group_id, char *buffer, int buf_size);
 int is_group_leader(const char *username, int group_id);
 int count_group_members(int group_id);
 void sync_user_group_id(conn_state_t *state);
-char* role_based_access_control(const char *command, conn_state_t *state);
+char* role_based_access_control(int role, conn_state_t *state);
+
+/* table.c - Growable record tables */
+int table_reserve(table_t *t, size_t record_size, int count);
+void table_copy_out(const table_t *t, size_t record_size, void *dst, int count);
+int table_copy_in(table_t *t, size_t record_size, const void *src, int count);
+
+/* store.c - Hash indexes over the metadata tables (caller holds the table's mutex) */
+int store_build_indexes();
+int store_find_account(const char *username);
+int store_add_account(const char *username, const char *password);
+int store_set_account_group(int idx, int group_id);
+unsigned store_membership_version(int idx);
+int store_first_member(int group_id);
+int store_next_member(int idx);
+int store_find_group(int group_id);
+int store_find_group_by_name(const char *group_name);
+int store_add_group(const char *group_name, const char *leader);
+int store_restore_group(int group_id, const char *group_name, const char *leader);
+void store_remove_group(int group_id);
+int store_group_name(int group_id, char *name);
+int store_group_leader_is(int group_id, const char *username);
+int store_find_request(const char *username, int group_id);
+int store_add_request(const char *username, int group_id);
+void store_remove_request(int idx);
+int store_purge_requests(int group_id);
+int store_first_request(int group_id);
+int store_next_request(int idx);
+int store_find_invite(const char *username, int group_id);
+int store_add_invite(const char *username, int group_id);
+void store_remove_invite(int idx);
+int store_purge_invites(int group_id);
+
+/* snapshot.c - Binary snapshot of the metadata tables */
+int snapshot_load();
+int snapshot_save(const account_t *acc, int n_acc, const group_t *grp, int n_grp,
+                  const request_t *req, int n_req, const invite_t *inv, int n_inv);
+
+/* rcu.c - Epoch-based reclamation for lock-free readers */
+void rcu_read_lock();
+void rcu_read_unlock();
+void rcu_retire(void *ptr, void (*free_fn)(void *ptr));
+void rcu_print_stats();
+
+/* journal.c - Append-only log of metadata mutations */
+int journal_replay();
+int journal_start(int force_compact);
+void journal_write(const char *fmt, ...);
+void journal_print_stats();
+
+/* logger.c - Asynchronous activity log */
+void write_log_detailed(const char *client_addr, const char *request, const char *result);
+void get_log_filename(char *filename, size_t size, const struct tm *t);
+int logger_start();
+void logger_print_stats();
+
+/* server.c - Command routing and connection lifecycle */
+void process_command(conn_state_t *state, char *command);
+void client_connected(conn_state_t *state);
+void client_disconnected(conn_state_t *state);
+void print_server_stats();
+
+/* reactor.c - epoll event loop */
+int reactor_run(int listenfd);
+int reactor_start(int listenfd, int cpu, pthread_t *tid);
+void reactor_print_stats();
+
+/* thread_pool.c - Worker pool for command handlers */
+int thread_pool_init(thread_pool_t *pool, int thread_count, int queue_size);
+int thread_pool_submit(thread_pool_t *pool, task_fn_t fn, void *arg);
+int thread_pool_try_submit(thread_pool_t *pool, task_fn_t fn, void *arg);
+void thread_pool_shutdown(thread_pool_t *pool);
+void thread_pool_print_stats(thread_pool_t *pool, const char *name);
+long long now_ns();
+
+/* pool.c - Connection slab and size-classed buffer pool */
+void *buffer_get(int size);
+void buffer_put(void *buf, int size);
+conn_state_t *conn_alloc();
+void conn_free(conn_state_t *state);
+void pool_print_stats();
 
 /* network.c - Network I/O functions */
 int file_lock(int fd, int type);
+int wait_socket(int sockfd, short events);
 int tcp_send(int sockfd, char *msg);
-int tcp_receive(int sockfd, conn_state_t *state, char *buffer, int max_len);
+int tcp_receive(int sockfd, conn_state_t *state, char **msg);
+int tcp_receive_buffered(conn_state_t *state, char **msg);
+void tcp_release_buffer(conn_state_t *state, int force);
 int send_all(int sockfd, const void *buffer, int length);
-long long get_file_size(const char *filename);
-int send_file_content(int sockfd, const char *filepath);
-int receive_file_content(int sockfd, conn_state_t *state, const char *filepath, long long filesize);
+int recv_all(int sockfd, void *buffer, int length);
+int send_file_content(int sockfd, int fd, long long offset, long long length, digest_t *digest);
+int receive_file_content(int sockfd, conn_state_t *state, int fd, long long offset, long long filesize,
+                         digest_t *digest);
+int digest_file(int fd, long long offset, long long length, digest_t *digest);
+void digest_store(int fd, const char *text);
+int digest_stored(int fd, char *text, size_t size);
+int tcp_send_digest(int sockfd, const char *code, const char *text);
+void transfer_print_stats();
+
+/* uring.c - io_uring transfer engine (compiled in with USE_IO_URING) */
+int uring_available();
+int uring_send_file(int sockfd, int fd, long long offset, long long length, digest_t *digest,
+                    long long *syscalls);
+int uring_receive_file(int sockfd, int fd, long long offset, long long length, digest_t *digest,
+                       long long *syscalls);
 
 /* auth.c - Authentication command handlers */
 void handle_register(conn_state_t *state, char *command);
@@ -137,13 +334,42 @@ void handle_list_members(conn_state_t *state, char *command);
 void handle_list_requests(conn_state_t *state, char *command);
 
 /* file_ops.c - File operation command handlers */
+extern int sync_policy;
+int upload_preallocate(int fd, long long size, int keep_size);
+int upload_publish(int fd, const char *part_path, const char *filepath, const char *digest_text);
+int is_temp_name(const char *name);
+int upload_sweeper_start();
 void handle_upload(conn_state_t *state, char *command);
+void handle_upload_resume(conn_state_t *state, char *command);
 void handle_download(conn_state_t *state, char *command);
 void handle_rename_file(conn_state_t *state, char *command);
 void handle_delete_file(conn_state_t *state, char *command);
 void handle_copy_file(conn_state_t *state, char *command);
 void handle_move_file(conn_state_t *state, char *command);
 
+/* upload_session.c - Chunked, multi-connection uploads */
+void handle_upload_begin(conn_state_t *state, char *command);
+void handle_upload_chunk(conn_state_t *state, char *command);
+void handle_upload_commit(conn_state_t *state, char *command);
+void upload_sessions_expire();
+void upload_print_stats();
+
+/* dedup.c - Content-addressed blob store (-d) */
+extern int dedup_enabled;
+int dedup_init();
+int dedup_publish(const char *part_path, const char *filepath, const char *digest_text);
+int dedup_link(const char *src, const char *filepath);
+int dedup_rename(const char *from, const char *filepath);
+void dedup_collect_later();
+void handle_upload_hash(conn_state_t *state, char *command);
+void dedup_print_stats();
+
+/* copy.c - Server-side file and folder copies (reflink, copy_file_range, buffered) */
+int copy_file(const char *src_path, const char *dest_path);
+int copy_folder(const char *src_path, const char *dest_path, long *files, long long *bytes);
+const char *copy_strategy_name(int strategy);
+void copy_print_stats();
+
 /* folder_ops.c - Folder operation command handlers */
 void handle_mkdir(conn_state_t *state, char *command);
 void handle_rename_folder(conn_state_t *state, char *command);
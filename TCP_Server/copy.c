@@ -0,0 +1,594 @@
+#include "common.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+/*
+ * Server-side file copies (COPY_FILE, and every file of COPY_FOLDER),
+ * cheapest strategy first:
+ *
+ *   link             -d only: the copy is another name of the same body
+ *   reflink          ioctl(FICLONE): the copy shares the source's extents
+ *                    copy-on-write; instant on btrfs and XFS
+ *   copy_file_range  the kernel copies COPY_EXTENT bytes per call without
+ *                    going through user space (offloaded on NFS and SMB)
+ *   buffered         pread/pwrite through a COPY_BUFFER_SIZE buffer
+ *
+ * A strategy the filesystem does not support fails on its first call and
+ * the next one is tried; a filesystem without reflinks is remembered so the
+ * ioctl is not retried on every file. The copy is written to a hidden
+ * "<dir>/.<name>.<n>.copy" file and renamed over the destination, so readers
+ * of an existing destination see the old file or the complete copy, and a
+ * body shared by several paths (-d) is never rewritten in place.
+ */
+
+#define COPY_EXTENT (1LL << 30)             /* Bytes per copy_file_range call */
+#define COPY_BUFFER_SIZE (1024 * 1024)      /* Buffer of the buffered strategy */
+#define COPY_PREALLOC_MIN (1024 * 1024)     /* Smaller copies are not preallocated */
+
+static const char *copy_strategy_names[COPY_STRATEGIES] = {
+    "link", "reflink", "copy_file_range", "buffered"
+};
+
+/* Statistics, updated with atomics from the workers */
+static long copy_count[COPY_STRATEGIES];
+static long long copy_bytes[COPY_STRATEGIES];
+
+/* Last device FICLONE was refused on; (dev_t)-1 while reflinks work */
+static dev_t no_reflink_dev = (dev_t)-1;
+
+/**
+ * @function copy_strategy_name: Name of a copy strategy, as sent in the 212 reply
+ * @param strategy: COPY_LINK .. COPY_BUFFERED
+ * @return: Static string
+ **/
+const char *copy_strategy_name(int strategy) {
+    return copy_strategy_names[strategy];
+}
+
+/**
+ * @function copy_range: Copy with copy_file_range(2)
+ * @param in_fd: Source
+ * @param out_fd: Destination, empty
+ * @param size: Bytes to copy
+ * @return: 0 on success, TRANSFER_UNSUPPORTED if the kernel or the filesystems
+ *          cannot do it (nothing copied yet), -1 on error
+ **/
+static int copy_range(int in_fd, int out_fd, long long size) {
+    loff_t off_in = 0, off_out = 0;
+
+    while (off_in < size) {
+        long long want = size - off_in < COPY_EXTENT ? size - off_in : COPY_EXTENT;
+        ssize_t n = copy_file_range(in_fd, &off_in, out_fd, &off_out, want, 0);
+        if (n > 0) {
+            continue;
+        }
+        if (n == 0) {
+            return -1;      /* Source shorter than its size */
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (off_in == 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                            errno == EOPNOTSUPP || errno == EBADF)) {
+            return TRANSFER_UNSUPPORTED;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @function copy_buffered: Copy through a user-space buffer
+ * @param in_fd: Source
+ * @param out_fd: Destination, empty
+ * @param size: Bytes to copy
+ * @return: 0 on success, -1 on error
+ **/
+static int copy_buffered(int in_fd, int out_fd, long long size) {
+    char *buf = malloc(COPY_BUFFER_SIZE);
+    if (buf == NULL) {
+        return -1;
+    }
+
+    long long off = 0;
+    int ret = 0;
+    while (off < size && ret == 0) {
+        ssize_t n = pread(in_fd, buf, size - off < COPY_BUFFER_SIZE ? size - off : COPY_BUFFER_SIZE, off);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ret = -1;
+            break;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = pwrite(out_fd, buf + done, n - done, off + done);
+            if (w == -1 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                ret = -1;
+                break;
+            }
+            done += w;
+        }
+        off += n;
+    }
+    free(buf);
+    return ret;
+}
+
+/**
+ * @function copy_file_data: Copy the contents of one open file into another
+ * @param in_fd: Source
+ * @param out_fd: Destination, empty
+ * @param size: Size of the source
+ * @param dev: Device of the source
+ * @return: Strategy used (COPY_REFLINK, COPY_RANGE or COPY_BUFFERED), -1 on error
+ **/
+static int copy_file_data(int in_fd, int out_fd, long long size, dev_t dev) {
+    if (__atomic_load_n(&no_reflink_dev, __ATOMIC_RELAXED) != dev) {
+        if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+            return COPY_REFLINK;
+        }
+        if (errno == EOPNOTSUPP || errno == ENOTTY) {
+            __atomic_store_n(&no_reflink_dev, dev, __ATOMIC_RELAXED);
+        }
+    }
+
+    /* A real copy of a big file: allocate it in one go, and fail early on a full disk */
+    if (size >= COPY_PREALLOC_MIN && upload_preallocate(out_fd, size, 1) == -1) {
+        return -1;
+    }
+    int ret = copy_range(in_fd, out_fd, size);
+    if (ret != TRANSFER_UNSUPPORTED) {
+        return ret == 0 ? COPY_RANGE : -1;
+    }
+    return copy_buffered(in_fd, out_fd, size) == 0 ? COPY_BUFFERED : -1;
+}
+
+/**
+ * @function copy_one: Copy a file to a new or existing path
+ * @param src_path: Source file
+ * @param dest_path: Destination; an existing file there is replaced
+ * @param direct: Create a destination that does not exist yet in place,
+ *                without a temporary file (folder copies)
+ * @return: Same as copy_file()
+ **/
+static int copy_one(const char *src_path, const char *dest_path, int direct) {
+    static unsigned int tmp_seq = 0;
+
+    int in_fd = open(src_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (in_fd == -1) {
+        return COPY_ERR_SOURCE;
+    }
+    if (file_lock(in_fd, LOCK_SH) == -1 || fstat(in_fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(in_fd);
+        return COPY_ERR_SOURCE;
+    }
+
+    int strategy;
+    if (dedup_enabled && dedup_link(src_path, dest_path) == 0) {
+        strategy = COPY_LINK;
+    } else {
+        char tmp_path[MAX_PATH];
+        const char *slash = strrchr(dest_path, '/');
+        int dir_len = slash ? slash - dest_path + 1 : 0;
+        int out_fd = -1, in_place = 0;
+        if (direct && (out_fd = open(dest_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666)) != -1) {
+            snprintf(tmp_path, sizeof(tmp_path), "%s", dest_path);
+            in_place = 1;
+        } else if (snprintf(tmp_path, sizeof(tmp_path), "%.*s.%s.%u.copy", dir_len, dest_path, dest_path + dir_len,
+                     __atomic_fetch_add(&tmp_seq, 1, __ATOMIC_RELAXED)) < MAX_PATH) {
+            out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        }
+        if (out_fd == -1) {
+            file_lock(in_fd, LOCK_UN);
+            close(in_fd);
+            return COPY_ERR_DEST;
+        }
+
+        strategy = copy_file_data(in_fd, out_fd, st.st_size, st.st_dev);
+        if (strategy != -1) {
+            char digest_text[DIGEST_TEXT_SIZE];
+            if (digest_stored(in_fd, digest_text, sizeof(digest_text)) == 0) {
+                digest_store(out_fd, digest_text);
+            }
+        }
+        if (close(out_fd) == -1 || strategy == -1) {
+            strategy = COPY_ERR_IO;
+        } else if (!in_place && dedup_rename(tmp_path, dest_path) == -1) {
+            strategy = COPY_ERR_DEST;   /* A folder in the way */
+        }
+        if (strategy < 0) {
+            unlink(tmp_path);
+        }
+    }
+    file_lock(in_fd, LOCK_UN);
+    close(in_fd);
+
+    if (strategy < 0) {
+        return strategy;
+    }
+    __atomic_fetch_add(&copy_count[strategy], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&copy_bytes[strategy], (long long)st.st_size, __ATOMIC_RELAXED);
+    return strategy;
+}
+
+/**
+ * @function copy_file: Copy a file to a new or existing path
+ * @param src_path: Source file
+ * @param dest_path: Destination; an existing file there is replaced
+ * @return: Strategy used (COPY_LINK .. COPY_BUFFERED) on success,
+ *          COPY_ERR_SOURCE if the source cannot be read,
+ *          COPY_ERR_DEST if the destination cannot be created,
+ *          COPY_ERR_IO if copying failed
+ * @note: The source is held under LOCK_SH, so an upload cannot replace it
+ *        halfway; its digest xattr is carried over to the copy
+ **/
+int copy_file(const char *src_path, const char *dest_path) {
+    return copy_one(src_path, dest_path, 0);
+}
+
+/* ==================== FOLDER COPIES ==================== */
+
+/*
+ * COPY_FOLDER runs in-process in two phases. The walk recreates every
+ * directory of the source under the destination and lists the regular files
+ * with their sizes. The files are then copied with copy_file() on copy_pool,
+ * in batches of up to COPY_BATCH_FILES files / COPY_BATCH_BYTES bytes, with
+ * at most COPY_MAX_IN_FLIGHT batches of one job queued or running, so a big
+ * tree neither floods the pool queue nor starves other jobs.
+ *
+ * Names starting with '.' are skipped: LIST_CONTENT hides them and they are
+ * the server's own temporaries (part files, upload sessions), some of which
+ * stay locked for the length of an upload. Symlinks and special files are
+ * skipped as well; uploads never create them. Files new to the destination
+ * are created in place, like cp -r does, which saves a rename per file; an
+ * existing one is still replaced through a temporary file.
+ */
+
+#define COPY_BATCH_FILES 64
+#define COPY_BATCH_BYTES (8LL * 1024 * 1024)
+#define COPY_MAX_IN_FLIGHT 16
+#define COPY_ARENA_SIZE 65536               /* Path strings are carved from chunks this big */
+
+/* Workers running folder copy batches (-c) */
+thread_pool_t copy_pool;
+
+/* One COPY_FOLDER */
+typedef struct copy_job {
+    char src[MAX_PATH];
+    char dest[MAX_PATH];
+    char **files;                   /* Paths relative to src/dest */
+    long long *sizes;
+    int file_count;
+    int file_capacity;
+    char *arena;                    /* Current chunk; its first bytes link the previous one */
+    int arena_used;
+    long dirs;
+    pthread_mutex_t lock;           /* Protects the fields below */
+    pthread_cond_t idle;
+    int in_flight;                  /* Batches queued or running */
+    long files_done;
+    long long bytes_done;
+    long errors;
+    struct copy_job *next;          /* Running jobs, for the statistics */
+} copy_job_t;
+
+/* Files of one job copied by one task */
+typedef struct {
+    copy_job_t *job;
+    int first;
+    int count;
+} copy_batch_t;
+
+static copy_job_t *running_jobs = NULL;
+static pthread_mutex_t running_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Statistics of finished jobs, protected by running_lock */
+static long folder_jobs = 0;
+static long folder_files = 0;
+static long long folder_bytes = 0;
+static long long folder_ns = 0;
+
+/**
+ * @function job_strdup: Keep a path for the length of a job
+ * @param job: Folder copy job
+ * @param s: Path
+ * @return: Copy that never moves, NULL if out of memory
+ **/
+static char *job_strdup(copy_job_t *job, const char *s) {
+    int len = strlen(s) + 1;
+    if (job->arena == NULL || job->arena_used + len > COPY_ARENA_SIZE) {
+        char *chunk = malloc(COPY_ARENA_SIZE);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        *(char **)chunk = job->arena;
+        job->arena = chunk;
+        job->arena_used = sizeof(char *);
+    }
+    char *copy = job->arena + job->arena_used;
+    memcpy(copy, s, len);
+    job->arena_used += len;
+    return copy;
+}
+
+/**
+ * @function job_add_file: Put a file on a job's list
+ * @param job: Folder copy job
+ * @param rel: Path relative to the job's roots
+ * @param size: Size of the file
+ * @return: 0 on success, -1 if out of memory
+ **/
+static int job_add_file(copy_job_t *job, const char *rel, long long size) {
+    if (job->file_count == job->file_capacity) {
+        int capacity = job->file_capacity ? job->file_capacity * 2 : 1024;
+        char **files = realloc(job->files, capacity * sizeof(char *));
+        if (files == NULL) {
+            return -1;
+        }
+        job->files = files;
+        long long *sizes = realloc(job->sizes, capacity * sizeof(long long));
+        if (sizes == NULL) {
+            return -1;
+        }
+        job->sizes = sizes;
+        job->file_capacity = capacity;
+    }
+    char *copy = job_strdup(job, rel);
+    if (copy == NULL) {
+        return -1;
+    }
+    job->files[job->file_count] = copy;
+    job->sizes[job->file_count] = size;
+    job->file_count++;
+    return 0;
+}
+
+/**
+ * @function copy_walk: Recreate the directories of a job and list its files
+ * @param job: Folder copy job, its destination root already created
+ * @return: 0 on success, -1 if out of memory
+ * @note: Directories or files that cannot be read or created count as errors
+ *        and the walk goes on, like cp -r
+ **/
+static int copy_walk(copy_job_t *job) {
+    char **stack = malloc(64 * sizeof(char *));
+    int depth = 0, capacity = 64;
+    if (stack == NULL) {
+        return -1;
+    }
+    stack[depth++] = "";
+
+    char path[MAX_PATH], rel[MAX_PATH];
+    while (depth > 0) {
+        const char *dir_rel = stack[--depth];
+        DIR *dir = NULL;
+        if (snprintf(path, sizeof(path), "%s%s%s", job->src, dir_rel[0] ? "/" : "", dir_rel) < MAX_PATH) {
+            dir = opendir(path);
+        }
+        if (dir == NULL) {
+            job->errors++;
+            continue;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            struct stat st;
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+                is_temp_name(entry->d_name)) {
+                continue;
+            }
+            if (snprintf(rel, sizeof(rel), "%s%s%s", dir_rel, dir_rel[0] ? "/" : "", entry->d_name) >= MAX_PATH ||
+                snprintf(path, sizeof(path), "%s/%s", job->dest, rel) >= MAX_PATH ||
+                fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+                job->errors++;
+                continue;
+            }
+
+            if (S_ISREG(st.st_mode)) {
+                if (job_add_file(job, rel, st.st_size) == -1) {
+                    closedir(dir);
+                    free(stack);
+                    return -1;
+                }
+            } else if (S_ISDIR(st.st_mode)) {
+                if (mkdir(path, 0755) == -1 && (errno != EEXIST || stat(path, &st) == -1 || !S_ISDIR(st.st_mode))) {
+                    job->errors++;
+                    continue;
+                }
+                job->dirs++;
+                char *copy = job_strdup(job, rel);
+                if (depth == capacity) {
+                    char **grown = realloc(stack, capacity * 2 * sizeof(char *));
+                    if (grown != NULL) {
+                        stack = grown;
+                        capacity *= 2;
+                    }
+                }
+                if (copy == NULL || depth == capacity) {
+                    closedir(dir);
+                    free(stack);
+                    return -1;
+                }
+                stack[depth++] = copy;
+            }
+        }
+        closedir(dir);
+    }
+    free(stack);
+    return 0;
+}
+
+/**
+ * @function copy_batch_task: Copy one batch of files (runs on copy_pool)
+ * @param arg: copy_batch_t, freed here
+ **/
+static void copy_batch_task(void *arg) {
+    copy_batch_t *batch = (copy_batch_t *)arg;
+    copy_job_t *job = batch->job;
+    char src[MAX_PATH], dest[MAX_PATH];
+
+    for (int i = batch->first; i < batch->first + batch->count; i++) {
+        int ret = COPY_ERR_DEST;     /* Path too long: counted as an error */
+        if (snprintf(src, sizeof(src), "%s/%s", job->src, job->files[i]) < MAX_PATH &&
+            snprintf(dest, sizeof(dest), "%s/%s", job->dest, job->files[i]) < MAX_PATH) {
+            ret = copy_one(src, dest, 1);
+        }
+
+        pthread_mutex_lock(&job->lock);
+        if (ret >= 0) {
+            job->files_done++;
+            job->bytes_done += job->sizes[i];
+        } else {
+            job->errors++;
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->in_flight--;
+    pthread_cond_signal(&job->idle);
+    pthread_mutex_unlock(&job->lock);
+    free(batch);
+}
+
+/**
+ * @function copy_folder: Copy a folder tree, files in parallel
+ * @param src_path: Source folder
+ * @param dest_path: Destination; if it is an existing folder the copy goes
+ *                   inside it under the source's name, as with cp -r
+ * @param files: Set to the number of files copied
+ * @param bytes: Set to the number of bytes copied
+ * @return: 0 on success, COPY_ERR_DEST if the destination folder cannot be
+ *          created, COPY_ERR_IO if some directory or file was not copied
+ * @note: Runs on a command worker and waits for its batches; the batches run
+ *        on copy_pool, never on command_pool, so the wait cannot deadlock
+ **/
+int copy_folder(const char *src_path, const char *dest_path, long *files, long long *bytes) {
+    copy_job_t *job = calloc(1, sizeof(copy_job_t));
+    if (job == NULL) {
+        return COPY_ERR_IO;
+    }
+    struct stat st;
+    snprintf(job->src, sizeof(job->src), "%s", src_path);
+    snprintf(job->dest, sizeof(job->dest), "%s", dest_path);
+    if (stat(dest_path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        const char *name = strrchr(src_path, '/');
+        if (snprintf(job->dest, sizeof(job->dest), "%s/%s", dest_path, name ? name + 1 : src_path) >= MAX_PATH) {
+            free(job);
+            return COPY_ERR_DEST;
+        }
+    }
+    if (mkdir(job->dest, 0755) == -1 && (errno != EEXIST || stat(job->dest, &st) == -1 || !S_ISDIR(st.st_mode))) {
+        free(job);
+        return COPY_ERR_DEST;
+    }
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->idle, NULL);
+    long long started = now_ns();
+
+    pthread_mutex_lock(&running_lock);
+    job->next = running_jobs;
+    running_jobs = job;
+    pthread_mutex_unlock(&running_lock);
+
+    /* Phase 1: every directory exists before any file is copied into it */
+    if (copy_walk(job) == -1) {
+        job->errors++;
+        job->file_count = 0;
+    }
+
+    /* Phase 2: batches on the copy pool, a bounded number at a time */
+    for (int i = 0; i < job->file_count; ) {
+        copy_batch_t *batch = malloc(sizeof(copy_batch_t));
+        if (batch == NULL) {
+            pthread_mutex_lock(&job->lock);
+            job->errors += job->file_count - i;
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        long long batch_bytes = 0;
+        batch->job = job;
+        batch->first = i;
+        batch->count = 0;
+        while (i < job->file_count && batch->count < COPY_BATCH_FILES &&
+               (batch->count == 0 || batch_bytes + job->sizes[i] <= COPY_BATCH_BYTES)) {
+            batch_bytes += job->sizes[i++];
+            batch->count++;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        while (job->in_flight >= COPY_MAX_IN_FLIGHT) {
+            pthread_cond_wait(&job->idle, &job->lock);
+        }
+        job->in_flight++;
+        pthread_mutex_unlock(&job->lock);
+        if (thread_pool_submit(&copy_pool, copy_batch_task, batch) == -1) {
+            copy_batch_task(batch);
+        }
+    }
+
+    pthread_mutex_lock(&job->lock);
+    while (job->in_flight > 0) {
+        pthread_cond_wait(&job->idle, &job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    pthread_mutex_lock(&running_lock);
+    copy_job_t **link = &running_jobs;
+    while (*link != job) {
+        link = &(*link)->next;
+    }
+    *link = job->next;
+    folder_jobs++;
+    folder_files += job->files_done;
+    folder_bytes += job->bytes_done;
+    folder_ns += now_ns() - started;
+    pthread_mutex_unlock(&running_lock);
+
+    *files = job->files_done;
+    *bytes = job->bytes_done;
+    int ret = job->errors > 0 ? COPY_ERR_IO : 0;
+    while (job->arena != NULL) {
+        char *prev = *(char **)job->arena;
+        free(job->arena);
+        job->arena = prev;
+    }
+    free(job->files);
+    free(job->sizes);
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->idle);
+    free(job);
+    return ret;
+}
+
+/**
+ * @function copy_print_stats: Print how many copies each strategy made, and
+ *           the progress of running folder copies
+ **/
+void copy_print_stats() {
+    printf("[copy]");
+    for (int i = 0; i < COPY_STRATEGIES; i++) {
+        printf(" %s=%ld (%lld bytes)", copy_strategy_names[i],
+               __atomic_load_n(&copy_count[i], __ATOMIC_RELAXED),
+               __atomic_load_n(&copy_bytes[i], __ATOMIC_RELAXED));
+    }
+    printf("\n");
+
+    pthread_mutex_lock(&running_lock);
+    printf("[copy] folders=%ld files=%ld bytes=%lld avg_ms=%.1f\n", folder_jobs, folder_files, folder_bytes,
+           folder_jobs ? folder_ns / 1e6 / folder_jobs : 0.0);
+    for (copy_job_t *job = running_jobs; job != NULL; job = job->next) {
+        pthread_mutex_lock(&job->lock);
+        printf("[copy]   %s -> %s: %ld/%d files, %lld bytes, %ld errors\n", job->src, job->dest,
+               job->files_done, job->file_count, job->bytes_done, job->errors);
+        pthread_mutex_unlock(&job->lock);
+    }
+    pthread_mutex_unlock(&running_lock);
+}
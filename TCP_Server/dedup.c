@@ -0,0 +1,459 @@
+#include "common.h"
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/random.h>
+
+/*
+ * Content-addressed blob store (-d): identical file bodies are kept once.
+ *
+ * Every file published by an upload gets a second name in the store,
+ * "blobs/<first 2 hex>/<sha256 hex>", as a hard link: the group folders
+ * still hold ordinary files, the path-to-blob mapping is the shared inode
+ * (the SHA-256 is also in the file's DIGEST_XATTR). When an upload turns out
+ * to carry content the store already has, the new path is linked to the
+ * existing blob and the received copy is dropped. Every other operation
+ * (DOWNLOAD, RENAME, MOVE, DELETE, ...) works on paths and needs no change;
+ * the server never rewrites a published file in place, so shared bodies
+ * cannot be modified through one of their names.
+ *
+ * UPLOAD_HASH lets a client skip the transfer altogether:
+ *
+ *   UPLOAD_HASH <path> <size> <digest>  -> 146               send it with UPLOAD
+ *                                       -> 147 <off> <len>   the store has it
+ *   <digest of bytes [off, off+len)>    -> 140 <digest>      linked, no transfer
+ *
+ * The random range is a proof of possession: knowing a file's SHA-256 (it is
+ * shown to every member of the group that holds it) is not enough to pull
+ * the file into another group. The 146/147 answer itself still tells whether
+ * the content exists somewhere on the server.
+ *
+ * A blob whose only remaining link is the store entry is garbage. Deleting
+ * or replacing a shared file schedules a sweep of the store on copy_pool,
+ * which removes garbage and counts what is left for the report; one sweep
+ * also runs at startup.
+ */
+
+#define BLOB_ROOT "blobs"
+#define DEDUP_PROOF_SIZE 65536      /* Bytes covered by a proof of possession */
+
+int dedup_enabled = 0;
+
+/* Statistics, updated with atomics from the workers */
+static long blobs_created = 0;
+static long upload_duplicates = 0;      /* Received, then linked to a stored blob */
+static long long upload_duplicate_bytes = 0;
+static long hash_linked = 0;            /* UPLOAD_HASH answered without a transfer */
+static long long hash_linked_bytes = 0;
+static long hash_missed = 0;
+static long proofs_failed = 0;
+
+/* ==================== BLOB STORE ==================== */
+
+/**
+ * @function dedup_init: Create the blob store directory
+ * @return: 0 on success, -1 on error
+ **/
+int dedup_init() {
+    if (mkdir(BLOB_ROOT, 0755) == -1 && errno != EEXIST) {
+        perror("mkdir(" BLOB_ROOT ") error");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @function blob_path: Name of the blob holding some content
+ * @param path: Buffer of MAX_PATH bytes
+ * @param digest_text: "sha256:<64 hex digits>"
+ * @param make_dir: Non-zero to create the fan-out directory
+ * @return: 0 on success, -1 if the digest is not a SHA-256
+ **/
+static int blob_path(char *path, const char *digest_text, int make_dir) {
+    if (strncmp(digest_text, "sha256:", 7) != 0) {
+        return -1;
+    }
+    const char *hex = digest_text + 7;
+    if (strlen(hex) != 64 || strspn(hex, "0123456789abcdef") != 64) {
+        return -1;
+    }
+
+    snprintf(path, MAX_PATH, "%s/%.2s", BLOB_ROOT, hex);
+    if (make_dir && mkdir(path, 0755) == -1 && errno != EEXIST) {
+        return -1;
+    }
+    snprintf(path, MAX_PATH, "%s/%.2s/%s", BLOB_ROOT, hex, hex);
+    return 0;
+}
+
+/**
+ * @function dedup_rename: rename() a file over a path, collecting the store
+ *           afterwards if the file replaced there was shared
+ * @param from: File to move
+ * @param filepath: Target path
+ * @return: 0 on success, -1 on error (errno set)
+ **/
+int dedup_rename(const char *from, const char *filepath) {
+    struct stat st;
+    int shared = dedup_enabled && lstat(filepath, &st) == 0 && st.st_nlink > 1;
+    if (rename(from, filepath) == -1) {
+        return -1;
+    }
+    if (shared) {
+        dedup_collect_later();
+    }
+    return 0;
+}
+
+/**
+ * @function link_over: Make a path another name of an existing file
+ * @param src: Existing file
+ * @param filepath: Name to (re)place
+ * @return: 0 on success, -1 on error
+ * @note: link() cannot replace a name, so the link is made under a hidden
+ *        temporary name next to filepath and renamed over it
+ **/
+static int link_over(const char *src, const char *filepath) {
+    static unsigned int tmp_seq = 0;
+    char tmp_path[MAX_PATH];
+    const char *slash = strrchr(filepath, '/');
+    int dir_len = slash ? slash - filepath + 1 : 0;
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%.*s.%s.%u.link", dir_len, filepath,
+                 filepath + dir_len, __atomic_fetch_add(&tmp_seq, 1, __ATOMIC_RELAXED)) >= MAX_PATH) {
+        return -1;
+    }
+    if (link(src, tmp_path) == -1) {
+        return -1;
+    }
+    if (dedup_rename(tmp_path, filepath) == -1) {
+        unlink(tmp_path);
+        return -1;
+    }
+    /* Already the same file: rename() did nothing and left the temporary name */
+    unlink(tmp_path);
+    return 0;
+}
+
+/**
+ * @function dedup_publish: Put a completely received upload in place
+ * @param part_path: Hidden file holding the upload
+ * @param filepath: Target path
+ * @param digest_text: Digest of the content
+ * @return: 0 on success, -1 on error (errno set)
+ * @note: Without -d this is rename(). With it, new content also becomes a
+ *        blob, and content already stored replaces the received copy.
+ *        Whenever sharing fails (another filesystem, link limit, a damaged
+ *        blob) the upload is kept as a private file
+ **/
+int dedup_publish(const char *part_path, const char *filepath, const char *digest_text) {
+    char blob[MAX_PATH];
+    if (!dedup_enabled || blob_path(blob, digest_text, 1) == -1) {
+        return rename(part_path, filepath);
+    }
+
+    if (link(part_path, blob) == 0) {
+        __atomic_fetch_add(&blobs_created, 1, __ATOMIC_RELAXED);
+        return dedup_rename(part_path, filepath);
+    }
+
+    struct stat st_part, st_blob;
+    if (errno == EEXIST && stat(part_path, &st_part) == 0 && stat(blob, &st_blob) == 0 &&
+        st_part.st_size == st_blob.st_size && link_over(blob, filepath) == 0) {
+        unlink(part_path);
+        __atomic_fetch_add(&upload_duplicates, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&upload_duplicate_bytes, (long long)st_blob.st_size, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    TRACE(TRACE_WARN, "Not deduplicating %s: %s\n", filepath, strerror(errno));
+    return dedup_rename(part_path, filepath);
+}
+
+/**
+ * @function dedup_link: Make a path share the body of another file
+ * @param src: Existing file
+ * @param filepath: Path to (re)place
+ * @return: 0 on success, -1 on error
+ * @note: COPY_FILE with -d; safe because published files are never
+ *        rewritten in place
+ **/
+int dedup_link(const char *src, const char *filepath) {
+    return link_over(src, filepath);
+}
+
+/* ==================== PRE-UPLOAD HASH CHECK ==================== */
+
+/**
+ * @function receive_proof: Read the client's answer to a proof challenge
+ * @param state: Connection state
+ * @param answer: Buffer of DIGEST_TEXT_SIZE bytes
+ * @return: 0 on success, -1 if the connection failed
+ * @note: Leaves anything pipelined after the answer in the receive buffer,
+ *        and invalidates the command line the handler was given
+ **/
+static int receive_proof(conn_state_t *state, char *answer) {
+    char *msg;
+    int len;
+
+    while ((len = tcp_receive(state->sockfd, state, &msg)) == TCP_WOULD_BLOCK) {
+        if (wait_socket(state->sockfd, POLLIN) == -1) {
+            return -1;
+        }
+    }
+    if (len < 0) {
+        return -1;
+    }
+    snprintf(answer, DIGEST_TEXT_SIZE, "%s", msg);
+    return 0;
+}
+
+/**
+ * @function handle_upload_hash: Handle UPLOAD_HASH command
+ * @param state: Connection state
+ * @param command: Command string "UPLOAD_HASH <path> <size> <sha256 digest>"
+ * Response codes:
+ *   147 <offset> <length>: The content is stored; answer with the digest of
+ *                          bytes [<offset>, <offset>+<length>) of the file
+ *   140 <digest>: (after the answer) Upload successful, nothing transferred
+ *   146: Content not stored, or wrong answer: send the file with UPLOAD
+ *   506: Deduplication is off (server started without -d)
+ *   400: Not logged in
+ *   404: Not in any group
+ *   502: File write error
+ *   300: Syntax error, or path too long
+ **/
+void handle_upload_hash(conn_state_t *state, char *command) {
+    char filename[MAX_PATH];
+    char digest_text[DIGEST_TEXT_SIZE];
+    char request[MAX_PATH + DIGEST_TEXT_SIZE + 64];
+    char blob[MAX_PATH];
+    char group_folder[MAX_PATH];
+    char filepath[MAX_PATH];
+    long long filesize;
+
+    get_group_folder_path(state->user_group_id, group_folder, sizeof(group_folder));
+    if (sscanf(command, "UPLOAD_HASH %s %lld %79s", filename, &filesize, digest_text) != 3 ||
+        filesize <= 0 || blob_path(blob, digest_text, 0) == -1 ||
+        snprintf(filepath, sizeof(filepath), "%s/%s", group_folder, filename) >= (int)sizeof(filepath)) {
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Syntax error");
+        return;
+    }
+    if (!dedup_enabled) {
+        tcp_send(state->sockfd, "506");
+        write_log_detailed(state->client_addr, command, "-ERR Deduplication disabled");
+        return;
+    }
+    /* The command lives in the receive buffer, which the answer may reuse */
+    snprintf(request, sizeof(request), "%s", command);
+
+    int fd = open(blob, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd != -1 && (fstat(fd, &st) == -1 || st.st_size != filesize)) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd == -1) {
+        __atomic_fetch_add(&hash_missed, 1, __ATOMIC_RELAXED);
+        tcp_send(state->sockfd, "146");
+        write_log_detailed(state->client_addr, request, "+OK Content not stored");
+        return;
+    }
+
+    /* Challenge: a random range of DEDUP_PROOF_SIZE bytes (the whole file
+     * if smaller), always fully inside the file */
+    unsigned long long r;
+    long long length = filesize < DEDUP_PROOF_SIZE ? filesize : DEDUP_PROOF_SIZE;
+    int ret = getrandom(&r, sizeof(r), 0) == sizeof(r) ? 0 : -1;
+    long long offset = r % (unsigned long long)(filesize - length + 1);
+
+    digest_t digest;
+    char expected[DIGEST_TEXT_SIZE];
+    digest_init(&digest, DIGEST_SHA256);
+    if (ret == 0) {
+        ret = digest_file(fd, offset, length, &digest);
+    }
+    close(fd);
+    if (ret == -1) {
+        tcp_send(state->sockfd, "146");
+        write_log_detailed(state->client_addr, request, "-ERR Cannot set a challenge");
+        return;
+    }
+    digest_final(&digest, expected, sizeof(expected));
+
+    char msg[64];
+    char answer[DIGEST_TEXT_SIZE];
+    snprintf(msg, sizeof(msg), "147 %lld %lld", offset, length);
+    tcp_send(state->sockfd, msg);
+    if (receive_proof(state, answer) == -1) {
+        write_log_detailed(state->client_addr, request, "-ERR Connection lost");
+        return;
+    }
+    if (strcmp(answer, expected) != 0) {
+        __atomic_fetch_add(&proofs_failed, 1, __ATOMIC_RELAXED);
+        tcp_send(state->sockfd, "146");
+        write_log_detailed(state->client_addr, request, "-ERR Proof of possession failed");
+        return;
+    }
+
+    /* The blob may have been collected since it was opened: then upload it */
+    if (link_over(blob, filepath) == -1) {
+        tcp_send(state->sockfd, errno == ENOENT && access(blob, F_OK) == -1 ? "146" : "502");
+        write_log_detailed(state->client_addr, request, "-ERR Cannot link stored content");
+        return;
+    }
+
+    __atomic_fetch_add(&hash_linked, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hash_linked_bytes, filesize, __ATOMIC_RELAXED);
+    tcp_send_digest(state->sockfd, "140", digest_text);
+    write_log_detailed(state->client_addr, request, "+OK Successful upload (deduplicated)");
+    TRACE(TRACE_INFO, "Upload complete: %s by %s (%lld bytes, deduplicated) %s\n",
+          filename, state->logged_user, filesize, digest_text);
+}
+
+/* ==================== COLLECTION ==================== */
+
+/* Result of the last sweep, and sweep scheduling; protected by collect_lock */
+static pthread_mutex_t collect_lock = PTHREAD_MUTEX_INITIALIZER;
+static int collect_queued = 0;          /* A sweep is queued or running */
+static int collect_again = 0;           /* More garbage since the running sweep started */
+static long sweeps = 0;
+static long last_blobs = 0, last_refs = 0;
+static long long last_stored = 0, last_logical = 0;
+static long collected = 0;
+static long long collected_bytes = 0;
+
+/**
+ * @function dedup_sweep: Walk the store, collect blobs no path refers to any
+ *           more and count the others
+ * @note: The link count of a blob is its number of paths plus one. A blob
+ *        linked to a new path while it is being collected only loses its
+ *        store entry; the path keeps the body
+ **/
+static void dedup_sweep() {
+    long blobs = 0, refs = 0, freed = 0;
+    long long stored = 0, logical = 0, freed_bytes = 0;
+    DIR *root = opendir(BLOB_ROOT);
+    struct dirent *fan;
+
+    while (root != NULL && (fan = readdir(root)) != NULL) {
+        if (fan->d_name[0] == '.') {
+            continue;
+        }
+        int dfd = openat(dirfd(root), fan->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR *dir = dfd == -1 ? NULL : fdopendir(dfd);
+        if (dir == NULL) {
+            if (dfd != -1) {
+                close(dfd);
+            }
+            continue;
+        }
+
+        struct dirent *entry;
+        struct stat st;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.' || fstatat(dirfd(dir), entry->d_name, &st, 0) == -1) {
+                continue;
+            }
+            if (st.st_nlink <= 1) {
+                if (unlinkat(dirfd(dir), entry->d_name, 0) == 0) {
+                    freed++;
+                    freed_bytes += st.st_size;
+                }
+                continue;
+            }
+            blobs++;
+            refs += st.st_nlink - 1;
+            stored += st.st_size;
+            logical += (long long)st.st_size * (st.st_nlink - 1);
+        }
+        closedir(dir);
+    }
+    if (root != NULL) {
+        closedir(root);
+    }
+
+    pthread_mutex_lock(&collect_lock);
+    sweeps++;
+    last_blobs = blobs;
+    last_refs = refs;
+    last_stored = stored;
+    last_logical = logical;
+    collected += freed;
+    collected_bytes += freed_bytes;
+    pthread_mutex_unlock(&collect_lock);
+    if (freed > 0) {
+        TRACE(TRACE_INFO, "Collected %ld unreferenced blobs (%lld bytes)\n", freed, freed_bytes);
+    }
+}
+
+/**
+ * @function collect_task: Sweep until no more garbage was announced (runs on copy_pool)
+ * @param arg: Unused
+ **/
+static void collect_task(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&collect_lock);
+    do {
+        collect_again = 0;
+        pthread_mutex_unlock(&collect_lock);
+        dedup_sweep();
+        pthread_mutex_lock(&collect_lock);
+    } while (collect_again);
+    collect_queued = 0;
+    pthread_mutex_unlock(&collect_lock);
+}
+
+/**
+ * @function dedup_collect_later: Collect unreferenced blobs in the background
+ * @note: Called once a name of a file that may share its body with the store
+ *        (link count above one) was deleted or replaced. Requests made while
+ *        a sweep is queued or running fold into one more sweep
+ **/
+void dedup_collect_later() {
+    if (!dedup_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&collect_lock);
+    if (collect_queued) {
+        collect_again = 1;
+        pthread_mutex_unlock(&collect_lock);
+        return;
+    }
+    collect_queued = 1;
+    pthread_mutex_unlock(&collect_lock);
+
+    if (thread_pool_submit(&copy_pool, collect_task, NULL) == -1) {
+        pthread_mutex_lock(&collect_lock);
+        collect_queued = 0;
+        pthread_mutex_unlock(&collect_lock);
+    }
+}
+
+/* ==================== REPORT ==================== */
+
+/**
+ * @function dedup_print_stats: Print the dedup ratio and the bytes saved
+ * @note: Read-only: the store figures are those of the last sweep
+ **/
+void dedup_print_stats() {
+    if (!dedup_enabled) {
+        return;
+    }
+
+    pthread_mutex_lock(&collect_lock);
+    printf("[dedup] blobs=%ld paths=%ld stored_bytes=%lld logical_bytes=%lld ratio=%.2f saved_bytes=%lld collected=%ld (%lld bytes) sweeps=%ld\n",
+           last_blobs, last_refs, last_stored, last_logical,
+           last_stored > 0 ? (double)last_logical / last_stored : 1.0,
+           last_logical - last_stored, collected, collected_bytes, sweeps);
+    pthread_mutex_unlock(&collect_lock);
+    printf("[dedup] created=%ld duplicate_uploads=%ld (%lld bytes) hash_skipped=%ld (%lld bytes not sent) hash_missed=%ld proofs_failed=%ld\n",
+           __atomic_load_n(&blobs_created, __ATOMIC_RELAXED),
+           __atomic_load_n(&upload_duplicates, __ATOMIC_RELAXED),
+           __atomic_load_n(&upload_duplicate_bytes, __ATOMIC_RELAXED),
+           __atomic_load_n(&hash_linked, __ATOMIC_RELAXED),
+           __atomic_load_n(&hash_linked_bytes, __ATOMIC_RELAXED),
+           __atomic_load_n(&hash_missed, __ATOMIC_RELAXED),
+           __atomic_load_n(&proofs_failed, __ATOMIC_RELAXED));
+}
@@ -2,6 +2,7 @@
 #include <fcntl.h>
 #include <sys/file.h>
 #include <libgen.h>
+#include <ftw.h>
 #include <sys/stat.h>
 
 #define STORAGE_ROOT "groups"
@@ -29,13 +30,8 @@ static void resolve_path(char *full_path, int group_id, const char *user_path) {
     }
 
     // Find group name from group_id
-    char group_name[MAX_GROUPNAME] = "";
-    for (int i = 0; i < group_count; i++) {
-        if (groups[i].group_id == group_id) {
-            strcpy(group_name, groups[i].group_name);
-            break;
-        }
-    }
+    char group_name[MAX_GROUPNAME];
+    store_group_name(group_id, group_name);
 
     snprintf(full_path, MAX_PATH, "%s/%s/%s", STORAGE_ROOT, group_name, clean_path);
 
@@ -46,6 +42,394 @@ static void resolve_path(char *full_path, int group_id, const char *user_path) {
     }
 }
 
+/* ==================== PARTIAL UPLOADS ==================== */
+
+/*
+ * An upload is written to a hidden "<dir>/.<name>.<size>[.<id>].part" file
+ * next to its target and renamed over the target once every byte is there,
+ * so a half-received file never shows up under its real name. When the
+ * connection drops, the part file stays: UPLOAD_RESUME reopens it and the
+ * client sends only the missing tail. The part is keyed by the size and by
+ * a content id the client picks for its local file (its mtime), so another
+ * file uploaded to the same path never resumes a stale prefix; without an
+ * id there is nothing to tell contents apart and the upload starts over, so
+ * such a part is deleted as soon as its connection drops. A resumable part
+ * nobody has written to for UPLOAD_PART_MAX_AGE seconds is deleted by a
+ * sweep of the group folders at startup and every UPLOAD_SWEEP_INTERVAL.
+ *
+ * The part file's blocks are allocated for the whole size up front, so a big
+ * upload is laid out in few extents, and a full disk fails the upload before
+ * any byte is sent. Before the rename the data is flushed as -F says: with
+ * the default (file) a crash can lose a just-published upload, but never
+ * leave a torn one under the real name.
+ */
+
+#define UPLOAD_PART_MAX_AGE (24 * 3600)    /* Idle seconds before a part file is swept */
+#define UPLOAD_SWEEP_INTERVAL 3600          /* Seconds between sweeps */
+#define UPLOAD_EXPIRE_INTERVAL 60           /* Seconds between idle session checks */
+
+int sync_policy = SYNC_FILE;
+
+/**
+ * @function upload_preallocate: Allocate the disk blocks of an upload
+ * @param fd: Upload file
+ * @param size: Size of the complete file
+ * @param keep_size: Non-zero to leave the file size alone (a part file's size
+ *                   is the number of bytes received)
+ * @return: 0 on success, -1 on error (ENOSPC: the file does not fit)
+ * @note: Where fallocate() is not supported the blocks are left to be
+ *        allocated as the data arrives
+ **/
+int upload_preallocate(int fd, long long size, int keep_size) {
+    if (size == 0) {
+        return 0;
+    }
+    if (fallocate(fd, keep_size ? FALLOC_FL_KEEP_SIZE : 0, 0, size) == 0) {
+        return 0;
+    }
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        return -1;
+    }
+    return keep_size ? 0 : ftruncate(fd, size);
+}
+
+/**
+ * @function upload_publish: Make a completely received upload durable and visible
+ * @param fd: Upload file
+ * @param part_path: Hidden name of the upload
+ * @param filepath: Target path
+ * @param digest_text: Digest of the content
+ * @return: 0 on success, -1 on error
+ * @note: The rename replaces the target atomically: readers see the old file
+ *        or the new one. SYNC_FULL also fsyncs the directory so the new name
+ *        survives a crash
+ **/
+int upload_publish(int fd, const char *part_path, const char *filepath, const char *digest_text) {
+    if (sync_policy != SYNC_NONE && fdatasync(fd) == -1) {
+        return -1;
+    }
+    if (dedup_publish(part_path, filepath, digest_text) == -1) {
+        return -1;
+    }
+    if (sync_policy == SYNC_FULL) {
+        char dir[MAX_PATH];
+        snprintf(dir, sizeof(dir), "%s", filepath);
+        int dfd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dfd == -1 || fsync(dfd) == -1) {
+            if (dfd != -1) {
+                close(dfd);
+            }
+            return -1;
+        }
+        close(dfd);
+    }
+    return 0;
+}
+
+/**
+ * @function is_temp_name: Check whether a directory entry is one of the
+ *           server's own temporary files
+ * @param name: Entry name
+ * @return: 1 for ".<name>...part" (uploads), ".upload" (chunked uploads),
+ *          ".copy" (copies) and ".link" (dedup) files, 0 for anything else,
+ *          including the user's own dotfiles
+ **/
+int is_temp_name(const char *name) {
+    static const char *suffixes[] = { ".part", ".upload", ".copy", ".link" };
+    size_t len = strlen(name);
+    if (name[0] != '.') {
+        return 0;
+    }
+    for (int i = 0; i < 4; i++) {
+        size_t n = strlen(suffixes[i]);
+        if (len > n + 1 && strcmp(name + len - n, suffixes[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#define UPLOAD_ID_MAX 64                  /* Longest content id of UPLOAD_RESUME */
+
+/**
+ * @function upload_content_id_valid: Check a client's content id
+ * @param id: Content id of UPLOAD_RESUME
+ * @return: 1 if it is 1..UPLOAD_ID_MAX letters, digits, '.', '_' or '-'
+ **/
+static int upload_content_id_valid(const char *id) {
+    size_t len = strlen(id);
+    return len > 0 && len <= UPLOAD_ID_MAX &&
+           strspn(id, "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ._-") == len;
+}
+
+/**
+ * @function upload_part_path: Name of the part file of an upload
+ * @param part_path: Buffer of MAX_PATH bytes
+ * @param filepath: Target file
+ * @param filesize: Size of the complete file
+ * @param content_id: Client's id of the content, NULL if none
+ * @return: 0 on success, -1 if the name does not fit
+ **/
+static int upload_part_path(char *part_path, const char *filepath, long long filesize, const char *content_id) {
+    const char *slash = strrchr(filepath, '/');
+    int dir_len = slash ? slash - filepath + 1 : 0;
+    int n = snprintf(part_path, MAX_PATH, "%.*s.%s.%lld%s%s.part", dir_len, filepath, filepath + dir_len,
+                     filesize, content_id ? "." : "", content_id ? content_id : "");
+    return n >= 0 && n < MAX_PATH ? 0 : -1;
+}
+
+/**
+ * @function upload_open_part: Open and exclusively lock the part file of an upload
+ * @param part_path: Part file
+ * @param filesize: Size of the complete file
+ * @param restart: Discard the bytes already held (plain UPLOAD)
+ * @param offset: Set to the number of bytes already held
+ * @return: Locked file descriptor, -1 on error
+ * @note: If the upload we waited for published or replaced the part file,
+ *        the name no longer leads to the locked file; open it again
+ **/
+static int upload_open_part(const char *part_path, long long filesize, int restart, long long *offset) {
+    for (;;) {
+        int fd = open(part_path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        if (fd == -1) {
+            perror("File open failed");
+            return -1;
+        }
+        if (file_lock(fd, LOCK_EX) == -1) {
+            close(fd);
+            return -1;
+        }
+
+        struct stat st, st_path;
+        if (fstat(fd, &st) == -1) {
+            file_lock(fd, LOCK_UN);
+            close(fd);
+            return -1;
+        }
+        if (stat(part_path, &st_path) == -1 || st_path.st_ino != st.st_ino || st_path.st_dev != st.st_dev) {
+            file_lock(fd, LOCK_UN);
+            close(fd);
+            continue;
+        }
+
+        if ((restart || st.st_size > filesize) && st.st_size > 0) {
+            if (ftruncate(fd, 0) == -1) {
+                file_lock(fd, LOCK_UN);
+                close(fd);
+                return -1;
+            }
+            st.st_size = 0;
+        }
+        *offset = st.st_size;
+        return fd;
+    }
+}
+
+/**
+ * @function upload_receive: Receive an upload into its part file and publish it
+ * @param state: Connection state
+ * @param command: Command string, for the log
+ * @param filename: Path inside the group folder
+ * @param filesize: Size of the complete file
+ * @param resume: 0: UPLOAD (start at byte 0, reply 141),
+ *                1: UPLOAD_RESUME (keep held bytes, reply 142 <offset>)
+ * @param content_id: Client's id of the content (UPLOAD_RESUME), NULL if none;
+ *                    held bytes are only kept for a matching id
+ * @note: The digest in the 140 reply covers the whole file; bytes held from
+ *        an earlier connection are read back from the part file
+ **/
+static void upload_receive(conn_state_t *state, char *command, const char *filename,
+                           long long filesize, int resume, const char *content_id) {
+    char group_folder[MAX_PATH];
+    get_group_folder_path(state->user_group_id, group_folder, sizeof(group_folder));
+    
+    char filepath[MAX_PATH];
+    char part_path[MAX_PATH];
+    int n = snprintf(filepath, sizeof(filepath), "%s/%s", group_folder, filename);
+    if (n < 0 || n >= (int)sizeof(filepath) || upload_part_path(part_path, filepath, filesize, content_id) == -1) {
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Path too long");
+        return;
+    }
+    
+    long long offset = 0;
+    digest_t digest;
+    digest_init(&digest, digest_algo);
+    int fd = upload_open_part(part_path, filesize, !resume || content_id == NULL, &offset);
+    if (fd != -1 && (upload_preallocate(fd, filesize, 1) == -1 ||
+                     digest_file(fd, 0, offset, &digest) == -1)) {
+        perror("Preparing upload failed");
+        if (offset == 0) {
+            unlink(part_path);
+        }
+        file_lock(fd, LOCK_UN);
+        close(fd);
+        fd = -1;
+    }
+    if (fd == -1) {
+        tcp_send(state->sockfd, "502");
+        write_log_detailed(state->client_addr, command, "-ERR File write error");
+        return;
+    }
+    
+    /* Send ready signal */
+    if (resume) {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "142 %lld", offset);
+        tcp_send(state->sockfd, msg);
+    } else {
+        tcp_send(state->sockfd, "141");
+    }
+    
+    /* Part file becomes the target only once complete, still under the lock */
+    char digest_text[DIGEST_TEXT_SIZE];
+    int ret = receive_file_content(state->sockfd, state, fd, offset, filesize, &digest);
+    if (ret == 0) {
+        digest_final(&digest, digest_text, sizeof(digest_text));
+        digest_store(fd, digest_text);
+        if (upload_publish(fd, part_path, filepath, digest_text) == -1) {
+            perror("Publishing upload failed");
+            ret = -1;
+        }
+    } else if (content_id == NULL) {
+        /* Nothing can resume it; give its preallocated blocks back now */
+        unlink(part_path);
+    }
+    file_lock(fd, LOCK_UN);
+    close(fd);
+    
+    if (ret == 0) {
+        tcp_send_digest(state->sockfd, "140", digest_text);
+        write_log_detailed(state->client_addr, command, "+OK Successful upload");
+        
+        TRACE(TRACE_INFO, "Upload complete: %s by %s (%lld bytes, %lld resumed) %s\n",
+              filename, state->logged_user, filesize, offset, digest_text);
+    } else if (ret == -1) {
+        tcp_send(state->sockfd, "502");
+        write_log_detailed(state->client_addr, command, "-ERR File write error");
+    } else {
+        write_log_detailed(state->client_addr, command, "-ERR Connection lost");
+    }
+}
+
+/* Sweep state; only one sweep runs at a time (startup, then the sweeper thread) */
+static time_t sweep_cutoff;
+static int sweep_sessions;              /* Also remove chunked upload files */
+static long sweep_removed;
+static long long sweep_removed_bytes;
+
+/**
+ * @function sweep_entry: nftw() callback removing one stale part file, or an
+ *           orphaned chunked upload file at startup
+ * @param path: Entry path
+ * @param st: Entry status (not followed through symlinks)
+ * @param type: nftw() entry type
+ * @param ftw: Position of the entry
+ * @return: 0 to go on walking
+ * @note: A part an upload holds is locked; the lock is tried without
+ *        waiting, and an upload that opened the part before it was unlinked
+ *        notices the name changed and opens a new one (upload_open_part)
+ **/
+static int sweep_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    const char *name = path + ftw->base;
+    size_t len = strlen(name);
+    if (type != FTW_F || !is_temp_name(name)) {
+        return 0;
+    }
+    if (sweep_sessions && strcmp(name + len - 7, ".upload") == 0) {
+        /* Sessions live in memory only: no session of this run owns it */
+        if (unlink(path) == 0) {
+            sweep_removed++;
+            sweep_removed_bytes += (long long)st->st_blocks * 512;
+        }
+        return 0;
+    }
+    if (strcmp(name + len - 5, ".part") != 0 || st->st_mtime >= sweep_cutoff) {
+        return 0;
+    }
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    struct stat st_fd, st_path;
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+        if (fstat(fd, &st_fd) == 0 && st_fd.st_mtime < sweep_cutoff && stat(path, &st_path) == 0 &&
+            st_path.st_ino == st_fd.st_ino && st_path.st_dev == st_fd.st_dev && unlink(path) == 0) {
+            sweep_removed++;
+            sweep_removed_bytes += (long long)st_fd.st_blocks * 512;
+        }
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+    return 0;
+}
+
+/**
+ * @function upload_sweep: Delete the part files nobody has written to for
+ *           UPLOAD_PART_MAX_AGE seconds
+ * @param startup: Also delete every chunked upload file, left by an earlier run
+ **/
+static void upload_sweep(int startup) {
+    sweep_cutoff = time(NULL) - UPLOAD_PART_MAX_AGE;
+    sweep_sessions = startup;
+    sweep_removed = 0;
+    sweep_removed_bytes = 0;
+    nftw(STORAGE_ROOT, sweep_entry, 16, FTW_PHYS);
+    if (sweep_removed > 0) {
+        TRACE(TRACE_INFO, "Removed %ld stale upload files (%lld bytes)\n", sweep_removed, sweep_removed_bytes);
+    }
+}
+
+/**
+ * @function upload_sweeper: Background thread that expires idle chunked upload
+ *           sessions and sweeps stale part files
+ * @param arg: Unused
+ * @return: NULL
+ **/
+static void *upload_sweeper(void *arg) {
+    (void)arg;
+    for (int ticks = 1; ; ticks++) {
+        sleep(UPLOAD_EXPIRE_INTERVAL);
+        upload_sessions_expire();
+        if (ticks % (UPLOAD_SWEEP_INTERVAL / UPLOAD_EXPIRE_INTERVAL) == 0) {
+            upload_sweep(0);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @function upload_sweeper_start: Sweep stale upload files now and start the
+ *           background expiry and sweeps
+ * @return: 0 on success, -1 if the thread cannot be started
+ * @note: Called before the listener opens, so no session exists yet
+ **/
+int upload_sweeper_start() {
+    upload_sweep(1);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, upload_sweeper, NULL) != 0) {
+        perror("pthread_create() error");
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+/**
+ * @function file_version: Validator of a file's current contents
+ * @param st: Status of the file
+ * @param version: Buffer of FILE_VERSION_SIZE bytes
+ * @note: A published file is never rewritten in place, so any new contents
+ *        come with a new inode or at least a new mtime
+ **/
+static void file_version(const struct stat *st, char *version) {
+    snprintf(version, FILE_VERSION_SIZE, "%llx-%llx-%llx.%lx", (unsigned long long)st->st_ino,
+             (unsigned long long)st->st_size, (unsigned long long)st->st_mtim.tv_sec,
+             (unsigned long)st->st_mtim.tv_nsec);
+}
+
 /* ==================== FILE OPERATION COMMAND HANDLERS ==================== */
 
 /**
@@ -54,25 +438,17 @@ static void resolve_path(char *full_path, int group_id, const char *user_path) {
  * @param command: Command string "UPLOAD <path> <size>"
  * Response codes:
  *   141: Ready to receive file
- *   140: Upload successful
+ *   140 [<digest>]: Upload successful, digest of the file unless -H none
  *   400: Not logged in
  *   404: Not in any group
  *   502: File write error
- 
- *   300: Syntax error
+ *   300: Syntax error, or path too long
  **/
 void handle_upload(conn_state_t *state, char *command) {
     char filename[MAX_PATH];
     long long filesize;
     
     
-    char *access_error = role_based_access_control("UPLOAD", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        return;
-    }
-    
-    
     if (sscanf(command, "UPLOAD %s %lld", filename, &filesize) != 2) {
         tcp_send(state->sockfd, "300");
         write_log_detailed(state->client_addr, command, "-ERR Syntax error");
@@ -86,59 +462,70 @@ void handle_upload(conn_state_t *state, char *command) {
         return;
     }
     
-    
-    char group_folder[MAX_PATH];
-    get_group_folder_path(state->user_group_id, group_folder, sizeof(group_folder));
-    
-    char filepath[MAX_PATH];
-    snprintf(filepath, sizeof(filepath), "%s/%s", group_folder, filename);
-    
+    upload_receive(state, command, filename, filesize, 0, NULL);
+}
 
+/**
+ * @function handle_upload_resume: Handle UPLOAD_RESUME command
+ * @param state: Connection state
+ * @param command: Command string "UPLOAD_RESUME <path> <size> [<content id>]"
+ * Response codes:
+ *   142 <offset>: Ready to receive the file from byte <offset> on
+ *   140 [<digest>]: Upload successful, digest of the whole file unless -H none
+ *   400: Not logged in
+ *   404: Not in any group
+ *   502: File write error
+ *   300: Syntax error, or path too long
+ * @note: The content id names the local file's version (e.g. its mtime); only
+ *        bytes received under the same path, size and id are resumed, and
+ *        without an id the offset is always 0
+ **/
+void handle_upload_resume(conn_state_t *state, char *command) {
+    char filename[MAX_PATH];
+    char content_id[UPLOAD_ID_MAX + 2];
+    long long filesize;
     
-    /* Send ready signal */
-    tcp_send(state->sockfd, "141");
-    
-    
-    int ret = receive_file_content(state->sockfd, state, filepath, filesize);
-    
-    if (ret == 0) {
-        tcp_send(state->sockfd, "140");
-        write_log_detailed(state->client_addr, command, "+OK Successful upload");
-        
-        printf("Upload complete: %s by %s\n", filename, state->logged_user);
-    } else if (ret == -1) {
-        tcp_send(state->sockfd, "502");
-        write_log_detailed(state->client_addr, command, "-ERR File write error");
-    } else {
-        write_log_detailed(state->client_addr, command, "-ERR Connection lost");
+    /* One character more than an id may have, so a longer one is rejected */
+    int args = sscanf(command, "UPLOAD_RESUME %s %lld %65s", filename, &filesize, content_id);
+    if (args < 2 || filesize <= 0 || (args == 3 && !upload_content_id_valid(content_id))) {
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Syntax error");
+        return;
     }
+    
+    upload_receive(state, command, filename, filesize, 1, args == 3 ? content_id : NULL);
 }
 
 /**
  * @function handle_download: Handle DOWNLOAD command
  * @param state: Connection state
- * @param command: Command string "DOWNLOAD <path>"
+ * @param command: Command string "DOWNLOAD <path> [<offset> <length> [<version>]]"
  * Response codes:
- *   151 <size>: Ready to send file
- *   150: Download successful
+ *   151 <size> <version>: Ready to send <size> bytes (the whole file or the
+ *                         range); <version> identifies the file's contents
+ *   150 [<digest>]: Download successful, digest of the whole file as stored
+ *                   at upload (none under -H none or if nothing is stored)
  *   400: Not logged in
  *   404: Not in any group
  *   500: File does not exist
  *   504: Cannot download folder
- *   300: Syntax error
+ *   507: File is no longer <version>: download it again from the start
+ *   300: Syntax error, or offset past the end of the file
+ * @note: A range is clamped to the end of the file, so a length larger than
+ * the file fetches everything from offset on (resuming a download); the
+ * version from the first 151 makes sure the bytes held are of the same file
+ * @note: The digest is read from DIGEST_XATTR, not computed over the bytes
+ * sent, so sendfile stays zero-copy; the client checks it against the whole
+ * file it ends up holding
  **/
 void handle_download(conn_state_t *state, char *command) {
     char filename[MAX_PATH];
+    char version[FILE_VERSION_SIZE], expected[FILE_VERSION_SIZE];
+    long long offset = 0, length = -1;
     
-    
-    char *access_error = role_based_access_control("DOWNLOAD", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        return;
-    }
-    
-    /* Parse command: DOWNLOAD <filename> */
-    if (sscanf(command, "DOWNLOAD %s", filename) != 1) {
+    /* Parse command: DOWNLOAD <filename> [<offset> <length> [<version>]] */
+    int args = sscanf(command, "DOWNLOAD %s %lld %lld %63s", filename, &offset, &length, expected);
+    if (args == 2 || args < 1 || offset < 0 || (args >= 3 && length < 0)) {
         tcp_send(state->sockfd, "300");
         write_log_detailed(state->client_addr, command, "-ERR Syntax error");
         return;
@@ -151,36 +538,71 @@ void handle_download(conn_state_t *state, char *command) {
     char filepath[MAX_PATH];
     snprintf(filepath, sizeof(filepath), "%s/%s", group_folder, filename);
     
-    /* Get file size */
-    long long filesize = get_file_size(filepath);
-    
-    if (filesize == -1) {
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+        if (fd != -1) {
+            close(fd);
+        }
         tcp_send(state->sockfd, "500");
         write_log_detailed(state->client_addr, command, "-ERR File does not exist");
         return;
     }
     
-    if (filesize == -2) {
+    if (S_ISDIR(st.st_mode)) {
+        close(fd);
         tcp_send(state->sockfd, "504");
         write_log_detailed(state->client_addr, command, "-ERR Cannot download folder");
         return;
     }
     
+    /* Lock file for reading; the size is read under the lock so the range
+     * matches what is sent */
+    if (file_lock(fd, LOCK_SH) == -1 || fstat(fd, &st) == -1) {
+        close(fd);
+        tcp_send(state->sockfd, "500");
+        write_log_detailed(state->client_addr, command, "-ERR File does not exist");
+        return;
+    }
+    
+    file_version(&st, version);
+    if (args == 4 && strcmp(version, expected) != 0) {
+        file_lock(fd, LOCK_UN);
+        close(fd);
+        tcp_send(state->sockfd, "507");
+        write_log_detailed(state->client_addr, command, "-ERR File changed");
+        return;
+    }
+    if (offset > st.st_size) {
+        file_lock(fd, LOCK_UN);
+        close(fd);
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Offset past end of file");
+        return;
+    }
+    if (length == -1 || length > st.st_size - offset) {
+        length = st.st_size - offset;
+    }
 
-
-    /* Send file size */
+    /* Send range size */
     char msg[100];
-    snprintf(msg, sizeof(msg), "151 %lld", filesize);
+    snprintf(msg, sizeof(msg), "151 %lld %s", length, version);
     tcp_send(state->sockfd, msg);
     
-    /* Send file content with file lock */
-    int ret = send_file_content(state->sockfd, filepath);
+    /* The digest was taken once at upload; sending it back costs no hashing */
+    char digest_text[DIGEST_TEXT_SIZE] = "";
+    if (digest_algo != DIGEST_NONE) {
+        digest_stored(fd, digest_text, sizeof(digest_text));
+    }
+    int ret = send_file_content(state->sockfd, fd, offset, length, NULL);
+    file_lock(fd, LOCK_UN);
+    close(fd);
     
     if (ret == 0) {
-        tcp_send(state->sockfd, "150");
+        tcp_send_digest(state->sockfd, "150", digest_text);
         write_log_detailed(state->client_addr, command, "+OK Successful download");
         
-        printf("Download complete: %s by %s\n", filename, state->logged_user);
+        TRACE(TRACE_INFO, "Download complete: %s by %s %s\n", filename, state->logged_user, digest_text);
     } else {
         write_log_detailed(state->client_addr, command, "-ERR Download failed");
     }
@@ -202,14 +624,6 @@ void handle_download(conn_state_t *state, char *command) {
 void handle_rename_file(conn_state_t *state, char *command) {
     char old_name[MAX_PATH], new_name[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("RENAME_FILE", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "RENAME_FILE %s %s", old_name, new_name) != 2) {
         tcp_send(state->sockfd, "300");
@@ -294,14 +708,6 @@ void handle_rename_file(conn_state_t *state, char *command) {
 void handle_delete_file(conn_state_t *state, char *command) {
     char path[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("DELETE_FILE", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "DELETE_FILE %s", path) != 1) {
         tcp_send(state->sockfd, "300");
@@ -339,6 +745,9 @@ void handle_delete_file(conn_state_t *state, char *command) {
     if (unlink(phys_path) == 0) {
         tcp_send(state->sockfd, "211");
         write_log_detailed(state->client_addr, command, "+OK File deleted successfully");
+        if (st_check.st_nlink > 1) {
+            dedup_collect_later();  /* Its blob may have no other path now */
+        }
     } else {
         tcp_send(state->sockfd, "500"); /* File not found */
         write_log_detailed(state->client_addr, command, "-ERR File not found");
@@ -354,24 +763,18 @@ void handle_delete_file(conn_state_t *state, char *command) {
  * @param state: Connection state
  * @param command: Command string "COPY_FILE <src> <dest>"
  * Response codes:
- *   212: Copy successful
+ *   212 <strategy>: Copy successful, made by link (-d), reflink,
+ *                   copy_file_range or buffered
  *   400: Not logged in
  *   404: Not in any group
- *   500: Source file does not exist
+ *   500: Source file does not exist, or copying failed
  *   503: Invalid destination path
+ *   504: Source is a folder
  *   300: Syntax error
  **/
 void handle_copy_file(conn_state_t *state, char *command) {
     char src_path[MAX_PATH], dest_path[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("COPY_FILE", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "COPY_FILE %s %s", src_path, dest_path) != 2) {
         tcp_send(state->sockfd, "300");
@@ -398,55 +801,23 @@ void handle_copy_file(conn_state_t *state, char *command) {
         return;
     }
 
-    FILE *in = fopen(src_phys, "rb");
-
-    // Lock source file
-    if (file_lock(fileno(in), LOCK_SH) == -1) {
-        fclose(in);
+    // Copy file: reflink or in-kernel copy when the filesystem can
+    int strategy = copy_file(src_phys, dest_phys);
+    if (strategy == COPY_ERR_SOURCE) {
         tcp_send(state->sockfd, "500");
-        write_log_detailed(state->client_addr, command, "-ERR Cannot lock source file");
-        return;
-    }
-
-    // Open destination file
-    FILE *out = fopen(dest_phys, "wb");
-    if (!out) {
-        fclose(in);
+        write_log_detailed(state->client_addr, command, "-ERR Cannot read source file");
+    } else if (strategy == COPY_ERR_DEST) {
         tcp_send(state->sockfd, "503"); // Invalid destination
         write_log_detailed(state->client_addr, command, "-ERR Invalid destination path");
-        return;
-    }
-
-    // Lock destination file for writing
-    if (file_lock(fileno(out), LOCK_EX) == -1) {
-        fclose(out);
-        fclose(in);
-        tcp_send(state->sockfd, "500");
-        write_log_detailed(state->client_addr, command, "-ERR Cannot lock destination file");
-        return;
-    }
-
-    //Copy file
-    char buf[CHUNK_SIZE];
-    size_t n;
-    int success = 1;
-
-    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
-        if (fwrite(buf, 1, n, out) != n) {
-            success = 0;
-            break;
-        }
-    }
-
-    fclose(in);
-    fclose(out);
-
-    if (success) {
-        tcp_send(state->sockfd, "212");
-        write_log_detailed(state->client_addr, command, "+OK File copied successfully");
-    } else {
+    } else if (strategy < 0) {
         tcp_send(state->sockfd, "500"); // Copy failed
         write_log_detailed(state->client_addr, command, "-ERR Copy operation failed");
+    } else {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "212 %s", copy_strategy_name(strategy));
+        tcp_send(state->sockfd, msg);
+        write_log_detailed(state->client_addr, command, "+OK File copied successfully");
+        TRACE(TRACE_DEBUG, "Copied %s to %s (%s)\n", src_phys, dest_phys, copy_strategy_name(strategy));
     }
 }
 
@@ -465,14 +836,6 @@ void handle_copy_file(conn_state_t *state, char *command) {
 void handle_move_file(conn_state_t *state, char *command) {
     char src_path[MAX_PATH], dest_dir[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("MOVE_FILE", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "MOVE_FILE %s %s", src_path, dest_dir) != 2) {
         tcp_send(state->sockfd, "300");
@@ -530,7 +893,7 @@ void handle_move_file(conn_state_t *state, char *command) {
     snprintf(final_dest_phys, sizeof(final_dest_phys), "%s/%s", dest_folder_phys, filename);
 
     // Move file
-    if (rename(src_phys, final_dest_phys) == 0) {
+    if (dedup_rename(src_phys, final_dest_phys) == 0) {
         tcp_send(state->sockfd, "213");
         write_log_detailed(state->client_addr, command, "+OK File moved successfully");
     } else {
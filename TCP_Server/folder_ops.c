@@ -25,13 +25,8 @@ static void resolve_path(char *full_path, int group_id, const char *user_path) {
     }
 
     // Find group name from group_id
-    char group_name[MAX_GROUPNAME] = "";
-    for (int i = 0; i < group_count; i++) {
-        if (groups[i].group_id == group_id) {
-            strcpy(group_name, groups[i].group_name);
-            break;
-        }
-    }
+    char group_name[MAX_GROUPNAME];
+    store_group_name(group_id, group_name);
 
     snprintf(full_path, MAX_PATH, "%s/%s/%s", STORAGE_ROOT, group_name, clean_path);
 
@@ -58,14 +53,6 @@ static void resolve_path(char *full_path, int group_id, const char *user_path) {
 void handle_mkdir(conn_state_t *state, char *command) {
     char path[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("MKDIR", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "MKDIR %s", path) != 1) {
         tcp_send(state->sockfd, "300");
@@ -109,14 +96,6 @@ void handle_mkdir(conn_state_t *state, char *command) {
 void handle_rename_folder(conn_state_t *state, char *command) {
     char old_name[MAX_PATH], new_name[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("RENAME_FOLDER", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "RENAME_FOLDER %s %s", old_name, new_name) != 2) {
         tcp_send(state->sockfd, "300");
@@ -185,14 +164,6 @@ void handle_rename_folder(conn_state_t *state, char *command) {
 void handle_rmdir(conn_state_t *state, char *command) {
     char path[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("RMDIR", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "RMDIR %s", path) != 1) {
         tcp_send(state->sockfd, "300");
@@ -223,6 +194,7 @@ void handle_rmdir(conn_state_t *state, char *command) {
     if (system(cmd) == 0) {
         tcp_send(state->sockfd, "222");
         write_log_detailed(state->client_addr, command, "+OK Folder removed successfully");
+        dedup_collect_later();      /* Blobs of the files removed may have no path left */
     } else {
         tcp_send(state->sockfd, "500"); // Folder not found
         write_log_detailed(state->client_addr, command, "-ERR Folder not found or system error");
@@ -234,24 +206,18 @@ void handle_rmdir(conn_state_t *state, char *command) {
  * @param state: Connection state
  * @param command: Command string "COPY_FOLDER <src> <dest>"
  * Response codes:
- *   223: Copy successful
+ *   223 <files> <bytes>: Copy successful, number of files and bytes copied
  *   400: Not logged in
  *   404: Not in any group
  *   500: Source folder does not exist
- *   503: Invalid destination path
+ *   503: Invalid destination path, or the source folder itself or inside it
  *   300: Syntax error
+ * @note: An existing destination folder receives the copy under the
+ * source's name, as with cp -r
  **/
 void handle_copy_folder(conn_state_t *state, char *command) {
     char src_path[MAX_PATH], dest_path[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("COPY_FOLDER", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "COPY_FOLDER %s %s", src_path, dest_path) != 2) {
         tcp_send(state->sockfd, "300");
@@ -272,6 +238,7 @@ void handle_copy_folder(conn_state_t *state, char *command) {
         write_log_detailed(state->client_addr, command, "-ERR Source folder not found");
         return;
     }
+    struct stat st_src = st;
 
     // Check if destination parent exists
     char dest_parent[MAX_PATH];
@@ -286,13 +253,47 @@ void handle_copy_folder(conn_state_t *state, char *command) {
         }
     }
 
-    // Copy folder recursively
-    char cmd[MAX_PATH * 2 + 20];
-    snprintf(cmd, sizeof(cmd), "cp -r \"%s\" \"%s\"", src_phys, dest_phys);
+    // A folder cannot be copied onto itself, into itself or into one of its
+    // subfolders. An existing destination folder receives the copy under the
+    // source's name, so the check applies to that effective destination
+    char ancestor[MAX_PATH];
+    strcpy(ancestor, dest_phys);
+    if (stat(dest_phys, &st) == 0 && S_ISDIR(st.st_mode)) {
+        const char *name = strrchr(src_phys, '/');
+        if (snprintf(ancestor, sizeof(ancestor), "%s/%s", dest_phys, name ? name + 1 : src_phys) >= MAX_PATH) {
+            tcp_send(state->sockfd, "503");
+            write_log_detailed(state->client_addr, command, "-ERR Invalid destination path");
+            return;
+        }
+    }
+    while (1) {
+        struct stat st_anc;
+        if (stat(ancestor, &st_anc) == 0 && st_anc.st_dev == st_src.st_dev && st_anc.st_ino == st_src.st_ino) {
+            tcp_send(state->sockfd, "503");
+            write_log_detailed(state->client_addr, command, "-ERR Cannot copy folder into itself");
+            return;
+        }
+        char *slash = strrchr(ancestor, '/');
+        if (slash == NULL) {
+            break;
+        }
+        *slash = '\0';
+    }
 
-    if (system(cmd) == 0) {
-        tcp_send(state->sockfd, "223");
+    // Copy folder recursively: directories first, then the files in parallel
+    long files = 0;
+    long long bytes = 0;
+    int ret = copy_folder(src_phys, dest_phys, &files, &bytes);
+
+    if (ret == 0) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "223 %ld %lld", files, bytes);
+        tcp_send(state->sockfd, msg);
         write_log_detailed(state->client_addr, command, "+OK Folder copied successfully");
+        TRACE(TRACE_INFO, "Folder copied: %s to %s (%ld files, %lld bytes)\n", src_phys, dest_phys, files, bytes);
+    } else if (ret == COPY_ERR_DEST) {
+        tcp_send(state->sockfd, "503"); // Invalid destination
+        write_log_detailed(state->client_addr, command, "-ERR Invalid destination path");
     } else {
         tcp_send(state->sockfd, "500"); // Copy failed
         write_log_detailed(state->client_addr, command, "-ERR Copy operation failed");
@@ -314,14 +315,6 @@ void handle_copy_folder(conn_state_t *state, char *command) {
 void handle_move_folder(conn_state_t *state, char *command) {
     char src_path[MAX_PATH], dest_dir[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("MOVE_FOLDER", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     if (sscanf(command, "MOVE_FOLDER %s %s", src_path, dest_dir) != 2) {
         tcp_send(state->sockfd, "300");
@@ -394,14 +387,6 @@ void handle_move_folder(conn_state_t *state, char *command) {
 void handle_list_content(conn_state_t *state, char *command) {
     char path[MAX_PATH];
 
-    // Check access control
-    char *access_error = role_based_access_control("LIST_CONTENT", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     // Parse command
     char *space = strchr(command, ' ');
     if (space) {
@@ -425,40 +410,49 @@ void handle_list_content(conn_state_t *state, char *command) {
         return;
     }
 
-    // Build result list
-    char result_buf[BUFF_SIZE];
-    result_buf[0] = '\0';
+    // Build "225\n<entries>" directly in a pooled buffer
+    char *response = buffer_get(BUFF_SIZE);
+    if (response == NULL) {
+        closedir(d);
+        tcp_send(state->sockfd, "500");
+        write_log_detailed(state->client_addr, command, "-ERR Out of memory");
+        return;
+    }
+    int len = snprintf(response, BUFF_SIZE, "225\n");
+    int header_len = len;
 
     struct dirent *dir;
     while ((dir = readdir(d)) != NULL) {
-        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0) {
+        /* ".", ".." and the server's temporaries such as unfinished uploads (.name.size.part) */
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0 || is_temp_name(dir->d_name)) {
             continue;
         }
 
         // Prevent buffer overflow
-        if (strlen(result_buf) + strlen(dir->d_name) + 10 >= BUFF_SIZE) {
+        int name_len = strlen(dir->d_name);
+        if (len + name_len + 10 >= BUFF_SIZE) {
             break;
         }
 
-        strcat(result_buf, dir->d_name);
+        memcpy(response + len, dir->d_name, name_len);
+        len += name_len;
 
         // Add / for directories
         if (dir->d_type == DT_DIR) {
-            strcat(result_buf, "/");
+            response[len++] = '/';
         }
 
-        strcat(result_buf, "\n");
+        response[len++] = '\n';
     }
     closedir(d);
 
     // Send response
-    char response[BUFF_SIZE];
-    if (strlen(result_buf) > 0) {
-        snprintf(response, sizeof(response), "225\n%s", result_buf);
-    } else {
-        snprintf(response, sizeof(response), "225\n(empty)");
+    if (len == header_len) {
+        len += snprintf(response + len, BUFF_SIZE - len, "(empty)");
     }
+    response[len] = '\0';
 
     tcp_send(state->sockfd, response);
+    buffer_put(response, BUFF_SIZE);
     write_log_detailed(state->client_addr, command, "+OK Content listed successfully");
 }
@@ -2,6 +2,23 @@
 
 /* ==================== GROUP MANAGEMENT COMMAND HANDLERS ==================== */
 
+/**
+ * @function list_append: Append an item to a list reply while it fits
+ * @param response: Reply being built, BUFF_SIZE bytes
+ * @param len: Current length of the reply
+ * @param sep: Separator to put before the item ("" for the first one)
+ * @param item: Item text
+ * @return: New length, -1 if the item did not fit (the reply then ends in "...")
+ **/
+static int list_append(char *response, int len, const char *sep, const char *item) {
+    int n = snprintf(response + len, BUFF_SIZE - len, "%s%s", sep, item);
+    if (len + n + 4 >= BUFF_SIZE) {
+        strcpy(response + len, sep[0] != '\0' ? " ..." : "...");
+        return -1;
+    }
+    return len + n;
+}
+
 /**
  * @function handle_create_group: Handle CREATE command
  * @param state: Connection state
@@ -16,13 +33,6 @@
 void handle_create_group(conn_state_t *state, char *command) {
     char group_name[MAX_GROUPNAME];
     
-    /* Role-based access control */
-    char *rbac_result = role_based_access_control("CREATE", state);
-    if (rbac_result != NULL) {
-        tcp_send(state->sockfd, rbac_result);
-        return;
-    }
-    
     /* Parse command */
     if (sscanf(command, "CREATE %s", group_name) != 1) {
         tcp_send(state->sockfd, "300");
@@ -47,47 +57,35 @@ void handle_create_group(conn_state_t *state, char *command) {
     pthread_mutex_lock(&group_mutex);
     
     /* Check if group name already exists */
-    for (int i = 0; i < group_count; i++) {
-        if (strcmp(groups[i].group_name, group_name) == 0) {
-            pthread_mutex_unlock(&group_mutex);
-            tcp_send(state->sockfd, "501");
-            write_log_detailed(state->client_addr, command, "-ERR Group name already exists");
-            return;
-        }
+    if (store_find_group_by_name(group_name) != -1) {
+        pthread_mutex_unlock(&group_mutex);
+        tcp_send(state->sockfd, "501");
+        write_log_detailed(state->client_addr, command, "-ERR Group name already exists");
+        return;
     }
     
-    /* Check if group limit reached */
-    if (group_count >= MAX_GROUPS) {
+    /* Create new group (fails only when out of memory) */
+    int new_group_id = store_add_group(group_name, state->logged_user);
+    if (new_group_id == -1) {
         pthread_mutex_unlock(&group_mutex);
         tcp_send(state->sockfd, "504");
-        write_log_detailed(state->client_addr, command, "-ERR Server full");
+        write_log_detailed(state->client_addr, command, "-ERR Out of memory");
         return;
     }
     
-    /* Get next group ID */
-    int new_group_id = get_next_group_id();
-    
-    /* Create new group */
-    groups[group_count].group_id = new_group_id;
-    strcpy(groups[group_count].group_name, group_name);
-    strcpy(groups[group_count].leader, state->logged_user);
-    group_count++;
-    
-    /* Save groups to file */
-    save_groups();
+    /* Record the new group */
+    journal_write("GRP %d %s %s", new_group_id, group_name, state->logged_user);
     
     pthread_mutex_unlock(&group_mutex);
     
     /* Update user's group_id in accounts */
     pthread_mutex_lock(&account_mutex);
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, state->logged_user) == 0) {
-            accounts[i].group_id = new_group_id;
-            state->user_group_id = new_group_id;
-            break;
-        }
+    int idx = store_find_account(state->logged_user);
+    if (idx != -1) {
+        store_set_account_group(idx, new_group_id);
+        state->user_group_id = new_group_id;
+        journal_write("MEM %s %d", state->logged_user, new_group_id);
     }
-    save_accounts();
     pthread_mutex_unlock(&account_mutex);
     
     /* Create group folder */
@@ -99,7 +97,7 @@ void handle_create_group(conn_state_t *state, char *command) {
     
     /* Log the group creation */
     write_log_detailed(state->client_addr, command, "+OK Group created successfully");
-    printf("Group created: %s by %s (ID: %d)\n", group_name, state->logged_user, new_group_id);
+    TRACE(TRACE_INFO, "Group created: %s by %s (ID: %d)\n", group_name, state->logged_user, new_group_id);
 }
 
 /**
@@ -111,19 +109,12 @@ void handle_create_group(conn_state_t *state, char *command) {
  *   400: Not logged in
  *   407: User already in a group
  *   500: Group does not exist
- *   504: Request list full
+ *   504: Internal server error
  *   300: Syntax error
  **/
 void handle_join_group(conn_state_t *state, char *command) {
     char group_name[MAX_GROUPNAME];
     
-    /* Role-based access control */
-    char *rbac_result = role_based_access_control("JOIN", state);
-    if (rbac_result != NULL) {
-        tcp_send(state->sockfd, rbac_result);
-        return;
-    }
-    
     /* Parse command */
     if (sscanf(command, "JOIN %s", group_name) != 1) {
         tcp_send(state->sockfd, "300");
@@ -142,11 +133,9 @@ void handle_join_group(conn_state_t *state, char *command) {
     
     /* Find group by name */
     int target_group_id = -1;
-    for (int i = 0; i < group_count; i++) {
-        if (strcmp(groups[i].group_name, group_name) == 0) {
-            target_group_id = groups[i].group_id;
-            break;
-        }
+    int group_index = store_find_group_by_name(group_name);
+    if (group_index != -1) {
+        target_group_id = GROUP(group_index).group_id;
     }
     
     /* Group does not exist */
@@ -162,30 +151,22 @@ void handle_join_group(conn_state_t *state, char *command) {
     pthread_mutex_lock(&request_mutex);
     
     /* Check if request already exists */
-    for (int i = 0; i < request_count; i++) {
-        if (strcmp(requests[i].username, state->logged_user) == 0 &&
-            requests[i].group_id == target_group_id) {
-            pthread_mutex_unlock(&request_mutex);
-            tcp_send(state->sockfd, "160");  /* Already sent, but return success */
-            return;
-        }
+    if (store_find_request(state->logged_user, target_group_id) != -1) {
+        pthread_mutex_unlock(&request_mutex);
+        tcp_send(state->sockfd, "160");  /* Already sent, but return success */
+        return;
     }
     
-    /* Check if request limit reached */
-    if (request_count >= MAX_REQUESTS) {
+    /* Add join request (fails only when out of memory) */
+    if (store_add_request(state->logged_user, target_group_id) == -1) {
         pthread_mutex_unlock(&request_mutex);
         tcp_send(state->sockfd, "504");
-        write_log_detailed(state->client_addr, command, "-ERR Request list full");
+        write_log_detailed(state->client_addr, command, "-ERR Out of memory");
         return;
     }
     
-    /* Add join request */
-    strcpy(requests[request_count].username, state->logged_user);
-    requests[request_count].group_id = target_group_id;
-    request_count++;
-    
-    /* Save requests to file */
-    save_requests();
+    /* Record the join request */
+    journal_write("REQ %s %d", state->logged_user, target_group_id);
     
     pthread_mutex_unlock(&request_mutex);
     
@@ -193,7 +174,7 @@ void handle_join_group(conn_state_t *state, char *command) {
     
     /* Log the join request */
     write_log_detailed(state->client_addr, command, "+OK Join request sent");
-    printf("Join request: %s -> %s\n", state->logged_user, group_name);
+    TRACE(TRACE_INFO, "Join request: %s -> %s\n", state->logged_user, group_name);
 }
 
 /**
@@ -210,13 +191,6 @@ void handle_join_group(conn_state_t *state, char *command) {
 void handle_approve(conn_state_t *state, char *command) {
     char username[MAX_USERNAME];
     
-    /* Role-based access control */
-    char *rbac_result = role_based_access_control("APPROVE", state);
-    if (rbac_result != NULL) {
-        tcp_send(state->sockfd, rbac_result);
-        return;
-    }
-    
     /* Parse command */
     if (sscanf(command, "APPROVE %s", username) != 1) {
         tcp_send(state->sockfd, "300");
@@ -227,14 +201,7 @@ void handle_approve(conn_state_t *state, char *command) {
     /* Find the request */
     pthread_mutex_lock(&request_mutex);
     
-    int request_index = -1;
-    for (int i = 0; i < request_count; i++) {
-        if (strcmp(requests[i].username, username) == 0 &&
-            requests[i].group_id == state->user_group_id) {
-            request_index = i;
-            break;
-        }
-    }
+    int request_index = store_find_request(username, state->user_group_id);
     
     /* Request not found */
     if (request_index == -1) {
@@ -245,24 +212,19 @@ void handle_approve(conn_state_t *state, char *command) {
     }
     
     /* Remove the request */
-    for (int i = request_index; i < request_count - 1; i++) {
-        requests[i] = requests[i + 1];
-    }
-    request_count--;
-    save_requests();
+    store_remove_request(request_index);
+    journal_write("UNREQ %s %d", username, state->user_group_id);
     
     pthread_mutex_unlock(&request_mutex);
     
     /* Add user to group */
     pthread_mutex_lock(&account_mutex);
     
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, username) == 0) {
-            accounts[i].group_id = state->user_group_id;
-            break;
-        }
+    int idx = store_find_account(username);
+    if (idx != -1) {
+        store_set_account_group(idx, state->user_group_id);
+        journal_write("MEM %s %d", username, state->user_group_id);
     }
-    save_accounts();
     
     pthread_mutex_unlock(&account_mutex);
     
@@ -270,7 +232,7 @@ void handle_approve(conn_state_t *state, char *command) {
     
     /* Log the approval */
     write_log_detailed(state->client_addr, command, "+OK Member approved successfully");
-    printf("User %s approved %s to join group %d\n", state->logged_user, username, state->user_group_id);
+    TRACE(TRACE_INFO, "User %s approved %s to join group %d\n", state->logged_user, username, state->user_group_id);
 }
 
 /**
@@ -287,14 +249,6 @@ void handle_approve(conn_state_t *state, char *command) {
 void handle_invite(conn_state_t *state, char *command) {
     char username[MAX_USERNAME];
 
-    /* Check access control */
-    char *access_error = role_based_access_control("INVITE", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     /* Parse command */
     if (sscanf(command, "INVITE %s", username) != 1) {
         tcp_send(state->sockfd, "300");
@@ -307,12 +261,10 @@ void handle_invite(conn_state_t *state, char *command) {
     int target_user_group_id = -1;
 
     pthread_mutex_lock(&account_mutex);
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, username) == 0) {
-            user_found = 1;
-            target_user_group_id = accounts[i].group_id;
-            break;
-        }
+    int idx = store_find_account(username);
+    if (idx != -1) {
+        user_found = 1;
+        target_user_group_id = ACCOUNT(idx).group_id;
     }
     pthread_mutex_unlock(&account_mutex);
 
@@ -331,24 +283,13 @@ void handle_invite(conn_state_t *state, char *command) {
     // Add to invites
     pthread_mutex_lock(&invite_mutex);
     // Check if invite already exists
-    int invite_exists = 0;
-    for (int i = 0; i < invite_count; i++) {
-        if (strcmp(invites[i].username, username) == 0 && invites[i].group_id == state->user_group_id) {
-            invite_exists = 1;
-            break;
-        }
-    }
-
-    if (!invite_exists) {
-        if (invite_count < MAX_INVITES) {
-            strcpy(invites[invite_count].username, username);
-            invites[invite_count].group_id = state->user_group_id;
-            invite_count++;
-            save_invites();
+    if (store_find_invite(username, state->user_group_id) == -1) {
+        if (store_add_invite(username, state->user_group_id) != -1) {
+            journal_write("INV %s %d", username, state->user_group_id);
         } else {
             pthread_mutex_unlock(&invite_mutex);
-            tcp_send(state->sockfd, "504"); // Server full
-            write_log_detailed(state->client_addr, command, "-ERR Invite list full");
+            tcp_send(state->sockfd, "504"); // Out of memory
+            write_log_detailed(state->client_addr, command, "-ERR Out of memory");
             return;
         }
     }
@@ -371,14 +312,6 @@ void handle_invite(conn_state_t *state, char *command) {
 void handle_accept(conn_state_t *state, char *command) {
     char group_name[MAX_GROUPNAME];
 
-    /* Check access control */
-    char *access_error = role_based_access_control("ACCEPT", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     /* Parse command */
     if (sscanf(command, "ACCEPT %s", group_name) != 1) {
         tcp_send(state->sockfd, "300");
@@ -389,11 +322,9 @@ void handle_accept(conn_state_t *state, char *command) {
     // Retrieve group id
     int group_id = -1;
     pthread_mutex_lock(&group_mutex);
-    for (int i = 0; i < group_count; i++) {
-        if (strcmp(groups[i].group_name, group_name) == 0) {
-            group_id = groups[i].group_id;
-            break;
-        }
+    int group_index = store_find_group_by_name(group_name);
+    if (group_index != -1) {
+        group_id = GROUP(group_index).group_id;
     }
     pthread_mutex_unlock(&group_mutex);
 
@@ -404,14 +335,8 @@ void handle_accept(conn_state_t *state, char *command) {
         return;
     }
 
-    int invite_index = -1;
     pthread_mutex_lock(&invite_mutex);
-    for (int i = 0; i < invite_count; i++) {
-        if (strcmp(invites[i].username, state->logged_user) == 0 && invites[i].group_id == group_id) {
-            invite_index = i;
-            break;
-        }
-    }
+    int invite_index = store_find_invite(state->logged_user, group_id);
 
     // Invite not exist
     if (invite_index == -1) {
@@ -422,23 +347,18 @@ void handle_accept(conn_state_t *state, char *command) {
     }
 
     // Remove invite
-    for (int i = invite_index; i < invite_count - 1; i++) {
-        invites[i] = invites[i+1];
-    }
-    invite_count--;
-    save_invites();
+    store_remove_invite(invite_index);
+    journal_write("UNINV %s %d", state->logged_user, group_id);
     pthread_mutex_unlock(&invite_mutex);
 
     // Update user group
     pthread_mutex_lock(&account_mutex);
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, state->logged_user) == 0) {
-            accounts[i].group_id = group_id;
-            state->user_group_id = group_id;
-            break;
-        }
+    int idx = store_find_account(state->logged_user);
+    if (idx != -1) {
+        store_set_account_group(idx, group_id);
+        state->user_group_id = group_id;
+        journal_write("MEM %s %d", state->logged_user, group_id);
     }
-    save_accounts();
     pthread_mutex_unlock(&account_mutex);
 
     tcp_send(state->sockfd, "190");
@@ -456,20 +376,15 @@ void handle_accept(conn_state_t *state, char *command) {
  *   300: Syntax error
  **/
 void handle_leave(conn_state_t *state, char *command) {
-    /* Role-based access control */
-    char *rbac_result = role_based_access_control("LEAVE", state);
-    if (rbac_result != NULL) {
-        tcp_send(state->sockfd, rbac_result);
-        return;
-    }
-    
     /* Check if user is the group leader */
     pthread_mutex_lock(&group_mutex);
     int is_leader = is_group_leader(state->logged_user, state->user_group_id);
     
     /* If leader, check if there are other members */
     if (is_leader) {
+        pthread_mutex_lock(&account_mutex);
         int member_count = count_group_members(state->user_group_id);
+        pthread_mutex_unlock(&account_mutex);
         if (member_count > 1) {
             pthread_mutex_unlock(&group_mutex);
             tcp_send(state->sockfd, "408");
@@ -478,31 +393,25 @@ void handle_leave(conn_state_t *state, char *command) {
         }
         
         /* If leader is the only member, delete the group */
-        int group_index = -1;
-        char group_name[MAX_GROUPNAME];
-        for (int i = 0; i < group_count; i++) {
-            if (groups[i].group_id == state->user_group_id) {
-                group_index = i;
-                strcpy(group_name, groups[i].group_name);
-                break;
-            }
-        }
+        store_remove_group(state->user_group_id);
+        journal_write("DEL %d", state->user_group_id);
         
-        /* Remove group from list */
-        if (group_index != -1) {
-            for (int i = group_index; i < group_count - 1; i++) {
-                groups[i] = groups[i + 1];
-            }
-            group_count--;
-            save_groups();
+        pthread_mutex_unlock(&group_mutex);
+        
+        /* Drop requests and invites that point at the deleted group */
+        pthread_mutex_lock(&request_mutex);
+        if (store_purge_requests(state->user_group_id) > 0) {
+            journal_write("PREQ %d", state->user_group_id);
         }
+        pthread_mutex_unlock(&request_mutex);
         
-        pthread_mutex_unlock(&group_mutex);
+        pthread_mutex_lock(&invite_mutex);
+        if (store_purge_invites(state->user_group_id) > 0) {
+            journal_write("PINV %d", state->user_group_id);
+        }
+        pthread_mutex_unlock(&invite_mutex);
         
-        /* Delete group folder */
-        char folder_path[MAX_PATH];
-        snprintf(folder_path, sizeof(folder_path), "groups/%s", group_name);
-        /* Note: Not deleting folder to preserve files */
+        /* Note: Group folder is not deleted to preserve files */
     } else {
         pthread_mutex_unlock(&group_mutex);
     }
@@ -512,14 +421,12 @@ void handle_leave(conn_state_t *state, char *command) {
     
     pthread_mutex_lock(&account_mutex);
     
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, state->logged_user) == 0) {
-            accounts[i].group_id = -1;
-            state->user_group_id = -1;
-            break;
-        }
+    int idx = store_find_account(state->logged_user);
+    if (idx != -1) {
+        store_set_account_group(idx, -1);
+        state->user_group_id = -1;
+        journal_write("MEM %s -1", state->logged_user);
     }
-    save_accounts();
     
     pthread_mutex_unlock(&account_mutex);
     
@@ -527,7 +434,7 @@ void handle_leave(conn_state_t *state, char *command) {
     
     /* Log the leave action */
     write_log_detailed(state->client_addr, command, "+OK Left group successfully");
-    printf("User %s left group %d\n", state->logged_user, old_group_id);
+    TRACE(TRACE_INFO, "User %s left group %d\n", state->logged_user, old_group_id);
 }
 
 /**
@@ -544,14 +451,6 @@ void handle_leave(conn_state_t *state, char *command) {
 void handle_kick(conn_state_t *state, char *command) {
     char username[MAX_USERNAME];
 
-    /* Check access control */
-    char *access_error = role_based_access_control("KICK", state);
-    if (access_error != NULL) {
-        tcp_send(state->sockfd, access_error);
-        write_log_detailed(state->client_addr, command, "-ERR Access denied");
-        return;
-    }
-
     /* Parse command */
     if (sscanf(command, "KICK %s", username) != 1) {
         tcp_send(state->sockfd, "300");
@@ -561,15 +460,11 @@ void handle_kick(conn_state_t *state, char *command) {
 
     int user_found_in_group = 0;
     pthread_mutex_lock(&account_mutex);
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, username) == 0) {
-            if (accounts[i].group_id == state->user_group_id) {
-                accounts[i].group_id = -1; // Remove user from group
-                user_found_in_group = 1;
-                save_accounts();
-            }
-            break;
-        }
+    int idx = store_find_account(username);
+    if (idx != -1 && ACCOUNT(idx).group_id == state->user_group_id) {
+        store_set_account_group(idx, -1); // Remove user from group
+        user_found_in_group = 1;
+        journal_write("MEM %s -1", username);
     }
     pthread_mutex_unlock(&account_mutex);
 
@@ -596,38 +491,28 @@ void handle_list_groups(conn_state_t *state, char *command) {
     char response[BUFF_SIZE];
     char temp[256];
     
-    /* Role-based access control */
-    char *rbac_result = role_based_access_control("LIST_GROUPS", state);
-    if (rbac_result != NULL) {
-        tcp_send(state->sockfd, rbac_result);
-        return;
-    }
-    
     pthread_mutex_lock(&group_mutex);
     
     /* Build response with list of groups */
     if (group_count == 0) {
         snprintf(response, sizeof(response), "203 No groups available");
     } else {
-        snprintf(response, sizeof(response), "203 ");
-        for (int i = 0; i < group_count; i++) {
+        int len = snprintf(response, sizeof(response), "203 ");
+        for (int i = 0; i < group_count && len != -1; i++) {
             snprintf(temp, sizeof(temp), "[%d] %s (Leader: %s)", 
-                    groups[i].group_id, 
-                    groups[i].group_name, 
-                    groups[i].leader);
+                    GROUP(i).group_id, 
+                    GROUP(i).group_name, 
+                    GROUP(i).leader);
             
-            /* Add separator if not first item */
-            if (i > 0) {
-                strcat(response, " | ");
-            }
-            strcat(response, temp);
+            /* Add separator if not first item; stop once the reply is full */
+            len = list_append(response, len, i > 0 ? " | " : "", temp);
         }
     }
     
     pthread_mutex_unlock(&group_mutex);
     
     tcp_send(state->sockfd, response);
-    printf("User %s listed groups\n", state->logged_user);
+    TRACE(TRACE_DEBUG, "User %s listed groups\n", state->logged_user);
 }
 
 /**
@@ -643,34 +528,22 @@ void handle_list_groups(conn_state_t *state, char *command) {
 void handle_list_members(conn_state_t *state, char *command) {
     char response[BUFF_SIZE];
     
-    /* Role-based access control */
-    char *rbac_result = role_based_access_control("LIST_MEMBERS", state);
-    if (rbac_result != NULL) {
-        tcp_send(state->sockfd, rbac_result);
-        return;
-    }
-    
     pthread_mutex_lock(&account_mutex);
     
     /* Build list of members in user's group */
-    snprintf(response, sizeof(response), "204 ");
+    int len = snprintf(response, sizeof(response), "204 ");
     int member_count = 0;
     
-    for (int i = 0; i < account_count; i++) {
-        if (accounts[i].group_id == state->user_group_id) {
-            /* Add separator if not first member */
-            if (member_count > 0) {
-                strcat(response, ", ");
-            }
-            strcat(response, accounts[i].username);
-            member_count++;
-        }
+    for (int i = store_first_member(state->user_group_id); i != -1 && len != -1; i = store_next_member(i)) {
+        /* Add separator if not first member */
+        len = list_append(response, len, member_count > 0 ? ", " : "", ACCOUNT(i).username);
+        member_count++;
     }
     
     pthread_mutex_unlock(&account_mutex);
     
     tcp_send(state->sockfd, response);
-    printf("User %s listed members of group %d\n", state->logged_user, state->user_group_id);
+    TRACE(TRACE_DEBUG, "User %s listed members of group %d\n", state->logged_user, state->user_group_id);
 }
 
 /**
@@ -686,28 +559,16 @@ void handle_list_members(conn_state_t *state, char *command) {
 void handle_list_requests(conn_state_t *state, char *command) {
     char response[BUFF_SIZE];
     
-    /* Role-based access control */
-    char *rbac_result = role_based_access_control("LIST_REQUESTS", state);
-    if (rbac_result != NULL) {
-        tcp_send(state->sockfd, rbac_result);
-        return;
-    }
-    
     pthread_mutex_lock(&request_mutex);
     
     /* Build list of pending requests for this group */
-    snprintf(response, sizeof(response), "205 ");
+    int len = snprintf(response, sizeof(response), "205 ");
     int request_counter = 0;
     
-    for (int i = 0; i < request_count; i++) {
-        if (requests[i].group_id == state->user_group_id) {
-            /* Add separator if not first request */
-            if (request_counter > 0) {
-                strcat(response, ", ");
-            }
-            strcat(response, requests[i].username);
-            request_counter++;
-        }
+    for (int i = store_first_request(state->user_group_id); i != -1 && len != -1; i = store_next_request(i)) {
+        /* Add separator if not first request */
+        len = list_append(response, len, request_counter > 0 ? ", " : "", REQUEST(i).username);
+        request_counter++;
     }
     
     pthread_mutex_unlock(&request_mutex);
@@ -718,5 +579,5 @@ void handle_list_requests(conn_state_t *state, char *command) {
     }
     
     tcp_send(state->sockfd, response);
-    printf("User %s listed requests for group %d\n", state->logged_user, state->user_group_id);
+    TRACE(TRACE_DEBUG, "User %s listed requests for group %d\n", state->logged_user, state->user_group_id);
 }
@@ -0,0 +1,340 @@
+#include "common.h"
+#include <fcntl.h>
+#include <stdarg.h>
+
+/*
+ * Every mutation of the metadata tables appends one line to data/journal.log
+ * instead of rewriting the stored tables. At startup the journal is replayed
+ * on top of the snapshot (snapshot.c); a background thread folds it into a
+ * new snapshot once it grows past JOURNAL_COMPACT_BYTES.
+ *
+ * Records (all idempotent, so replaying one twice is harmless):
+ *   ACC <user> <password>      account registered
+ *   MEM <user> <group_id>      account moved to a group (-1: none)
+ *   GRP <group_id> <name> <leader>
+ *   DEL <group_id>             group deleted
+ *   REQ / UNREQ <user> <group_id>
+ *   PREQ <group_id>            all requests of a group dropped
+ *   INV / UNINV <user> <group_id>
+ *   PINV <group_id>            all invites of a group dropped
+ *
+ * journal_write is called with the mutex of the mutated table held, so the
+ * journal order matches the order the tables changed in.
+ */
+
+#define JOURNAL_PATH "data/journal.log"
+#define JOURNAL_OLD_PATH "data/journal.old"   /* Segment being compacted */
+
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_full = PTHREAD_COND_INITIALIZER;
+static int journal_fd = -1;
+static long long journal_bytes = 0;     /* Size of JOURNAL_PATH */
+
+/* Statistics, protected by journal_lock */
+static long long journal_records = 0;
+static long long journal_write_ns = 0;
+static int journal_compactions = 0;
+static long long journal_compact_ns_last = 0;
+
+/* ==================== REPLAY ==================== */
+
+/**
+ * @function journal_apply: Apply one journal record to the tables
+ * @param line: Record without the trailing newline
+ * @return: 0 if applied (or already applied), -1 if malformed
+ **/
+static int journal_apply(const char *line) {
+    char op[8];
+    char name[MAX_USERNAME];
+    char arg[MAX_PASSWORD];
+    int id;
+
+    if (sscanf(line, "%7s", op) != 1) {
+        return -1;
+    }
+
+    if (strcmp(op, "ACC") == 0 && sscanf(line, "ACC %49s %49s", name, arg) == 2) {
+        if (store_find_account(name) == -1) {
+            store_add_account(name, arg);
+        }
+    } else if (strcmp(op, "MEM") == 0 && sscanf(line, "MEM %49s %d", name, &id) == 2) {
+        int idx = store_find_account(name);
+        if (idx != -1) {
+            store_set_account_group(idx, id);
+        }
+    } else if (strcmp(op, "GRP") == 0 && sscanf(line, "GRP %d %49s %49s", &id, name, arg) == 3) {
+        if (store_find_group(id) == -1 && store_find_group_by_name(name) == -1) {
+            store_restore_group(id, name, arg);
+        }
+    } else if (strcmp(op, "DEL") == 0 && sscanf(line, "DEL %d", &id) == 1) {
+        store_remove_group(id);
+    } else if (strcmp(op, "REQ") == 0 && sscanf(line, "REQ %49s %d", name, &id) == 2) {
+        if (store_find_request(name, id) == -1) {
+            store_add_request(name, id);
+        }
+    } else if (strcmp(op, "UNREQ") == 0 && sscanf(line, "UNREQ %49s %d", name, &id) == 2) {
+        int idx = store_find_request(name, id);
+        if (idx != -1) {
+            store_remove_request(idx);
+        }
+    } else if (strcmp(op, "PREQ") == 0 && sscanf(line, "PREQ %d", &id) == 1) {
+        store_purge_requests(id);
+    } else if (strcmp(op, "INV") == 0 && sscanf(line, "INV %49s %d", name, &id) == 2) {
+        if (store_find_invite(name, id) == -1) {
+            store_add_invite(name, id);
+        }
+    } else if (strcmp(op, "UNINV") == 0 && sscanf(line, "UNINV %49s %d", name, &id) == 2) {
+        int idx = store_find_invite(name, id);
+        if (idx != -1) {
+            store_remove_invite(idx);
+        }
+    } else if (strcmp(op, "PINV") == 0 && sscanf(line, "PINV %d", &id) == 1) {
+        store_purge_invites(id);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @function journal_replay_file: Apply every record of one journal file
+ * @param path: Journal file
+ * @return: Number of records applied, -1 if the file does not exist
+ * @note: A torn last line (crash mid-append) is skipped
+ **/
+static int journal_replay_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char line[256];
+    int applied = 0;
+    int bad = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        size_t len = strlen(line);
+        if (len == 0 || line[len - 1] != '\n') {
+            bad++;
+            continue;
+        }
+        line[len - 1] = '\0';
+        if (journal_apply(line) == 0) {
+            applied++;
+        } else {
+            bad++;
+        }
+    }
+    fclose(f);
+
+    if (bad > 0) {
+        printf("Skipped %d bad records in %s\n", bad, path);
+    }
+    return applied;
+}
+
+/**
+ * @function journal_replay: Bring the loaded tables up to date from the journal
+ * @return: Number of records applied
+ * @note: Called after load_* and store_build_indexes, before any client is
+ *        accepted. A segment left by an interrupted compaction goes first.
+ **/
+int journal_replay() {
+    int applied = 0;
+    int n;
+
+    if ((n = journal_replay_file(JOURNAL_OLD_PATH)) > 0) {
+        applied += n;
+    }
+    if ((n = journal_replay_file(JOURNAL_PATH)) > 0) {
+        applied += n;
+    }
+    if (applied > 0) {
+        printf("Replayed %d journal records\n", applied);
+    }
+    return applied;
+}
+
+/* ==================== APPEND ==================== */
+
+/**
+ * @function journal_write: Append one record to the journal
+ * @param fmt: printf format of the record, without the newline
+ * @note: One write(2) per record on an O_APPEND descriptor; no fsync, like the
+ *        text files it replaces
+ **/
+void journal_write(const char *fmt, ...) {
+    char record[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int len = vsnprintf(record, sizeof(record) - 1, fmt, ap);
+    va_end(ap);
+    if (len < 0 || len >= (int)sizeof(record) - 1) {
+        fprintf(stderr, "Journal record too long, dropped\n");
+        return;
+    }
+    record[len++] = '\n';
+
+    long long start = now_ns();
+    pthread_mutex_lock(&journal_lock);
+    if (journal_fd == -1 || write(journal_fd, record, len) != len) {
+        perror("Cannot write to journal.log");
+    } else {
+        journal_bytes += len;
+        journal_records++;
+        if (journal_bytes >= JOURNAL_COMPACT_BYTES) {
+            pthread_cond_signal(&journal_full);
+        }
+    }
+    journal_write_ns += now_ns() - start;
+    pthread_mutex_unlock(&journal_lock);
+}
+
+/* ==================== COMPACTION ==================== */
+
+/**
+ * @function journal_compact: Fold the journal into a new snapshot
+ * @return: 0 on success, -1 on error (the journal is kept and retried later)
+ * @note: The tables are only copied under their mutexes; the files are
+ *        written after every lock is released
+ **/
+static int journal_compact() {
+    long long start = now_ns();
+
+    /* Same order as the handlers: group, account, request, invite */
+    pthread_mutex_lock(&group_mutex);
+    pthread_mutex_lock(&account_mutex);
+    pthread_mutex_lock(&request_mutex);
+    pthread_mutex_lock(&invite_mutex);
+
+    int n_accounts = account_count;
+    int n_groups = group_count;
+    int n_requests = request_count;
+    int n_invites = invite_count;
+    account_t *acc = malloc((n_accounts + 1) * sizeof(account_t));
+    group_t *grp = malloc((n_groups + 1) * sizeof(group_t));
+    request_t *req = malloc((n_requests + 1) * sizeof(request_t));
+    invite_t *inv = malloc((n_invites + 1) * sizeof(invite_t));
+    int ok = acc != NULL && grp != NULL && req != NULL && inv != NULL;
+
+    if (ok) {
+        table_copy_out(&accounts, sizeof(account_t), acc, n_accounts);
+        table_copy_out(&groups, sizeof(group_t), grp, n_groups);
+        table_copy_out(&requests, sizeof(request_t), req, n_requests);
+        table_copy_out(&invites, sizeof(invite_t), inv, n_invites);
+
+        /* Start a fresh journal; the old segment is dropped once the copy is
+         * on disk. If an earlier compaction failed, the old segment is still
+         * there: keep appending instead, replay is idempotent. */
+        pthread_mutex_lock(&journal_lock);
+        if (access(JOURNAL_OLD_PATH, F_OK) == -1) {
+            int fd = -1;
+            if (rename(JOURNAL_PATH, JOURNAL_OLD_PATH) == 0) {
+                fd = open(JOURNAL_PATH, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            }
+            if (fd != -1) {
+                close(journal_fd);
+                journal_fd = fd;
+                journal_bytes = 0;
+            } else {
+                perror("Cannot rotate journal.log");
+                rename(JOURNAL_OLD_PATH, JOURNAL_PATH);
+                ok = 0;
+            }
+        }
+        pthread_mutex_unlock(&journal_lock);
+    }
+
+    pthread_mutex_unlock(&invite_mutex);
+    pthread_mutex_unlock(&request_mutex);
+    pthread_mutex_unlock(&account_mutex);
+    pthread_mutex_unlock(&group_mutex);
+
+    if (ok) {
+        ok = snapshot_save(acc, n_accounts, grp, n_groups, req, n_requests, inv, n_invites) == 0;
+    }
+    if (ok) {
+        unlink(JOURNAL_OLD_PATH);
+    }
+
+    free(acc);
+    free(grp);
+    free(req);
+    free(inv);
+
+    pthread_mutex_lock(&journal_lock);
+    if (ok) {
+        journal_compactions++;
+    }
+    journal_compact_ns_last = now_ns() - start;
+    pthread_mutex_unlock(&journal_lock);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @function journal_compactor: Background thread that compacts a full journal
+ * @param arg: Unused
+ * @return: NULL
+ **/
+static void *journal_compactor(void *arg) {
+    (void)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&journal_lock);
+        while (journal_bytes < JOURNAL_COMPACT_BYTES) {
+            pthread_cond_wait(&journal_full, &journal_lock);
+        }
+        pthread_mutex_unlock(&journal_lock);
+
+        if (journal_compact() == -1) {
+            sleep(1);   /* Disk full or similar; don't spin */
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @function journal_start: Open the journal for appending and start compaction
+ * @param force_compact: Write a snapshot even if the journal is empty
+ *                       (after importing the legacy text files)
+ * @return: 0 on success, -1 on error
+ * @note: A journal left from the previous run is folded into a snapshot
+ *        first, so every run starts with an empty journal
+ **/
+int journal_start(int force_compact) {
+    journal_fd = open(JOURNAL_PATH, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journal_fd == -1) {
+        perror("Cannot open journal.log");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(journal_fd, &st) == 0) {
+        journal_bytes = st.st_size;
+    }
+    if ((force_compact || journal_bytes > 0 || access(JOURNAL_OLD_PATH, F_OK) == 0) &&
+        journal_compact() == -1) {
+        fprintf(stderr, "Cannot compact journal.log\n");
+        return -1;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, journal_compactor, NULL) != 0) {
+        perror("pthread_create() error");
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+/**
+ * @function journal_print_stats: Print journal size, write cost and compactions
+ **/
+void journal_print_stats() {
+    pthread_mutex_lock(&journal_lock);
+    printf("[journal] records=%lld bytes=%lld avg_write=%.1fus compactions=%d last_compaction=%.1fms\n",
+           journal_records, journal_bytes,
+           journal_records ? journal_write_ns / 1000.0 / journal_records : 0.0,
+           journal_compactions, journal_compact_ns_last / 1e6);
+    pthread_mutex_unlock(&journal_lock);
+}
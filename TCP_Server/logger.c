@@ -0,0 +1,289 @@
+#include "common.h"
+#include <fcntl.h>
+
+/*
+ * Activity log. Handler threads format nothing and touch no file: they copy
+ * the record into a lock-free multi-producer ring (bounded MPMC queue in the
+ * style of D. Vyukov, used here with one consumer) and return. One writer
+ * thread drains the ring, stamps the records with a timestamp it formats at
+ * most once per second, and appends them to the daily file in batches. The
+ * file stays open and is switched when a record of a new day arrives.
+ *
+ * A full ring drops the record rather than block the handler; drops are
+ * counted, reported in the log itself and in the SIGUSR1 statistics.
+ *
+ * Each slot carries a turn number instead of a sequence number, so the
+ * zero-initialised ring is ready before logger_start (lap 0, all free).
+ */
+
+#define LOG_RING_SIZE 8192      /* Records in flight, power of two */
+#define LOG_RECORD_SIZE 256     /* Longer records are truncated */
+#define LOG_BATCH_SIZE 65536    /* Bytes gathered before one write(2) */
+#define LOG_IDLE_WAIT_MS 1000   /* Longest sleep of an idle writer */
+
+typedef struct {
+    unsigned long turn;     /* 2*lap: free for that lap, 2*lap+1: filled */
+    time_t when;
+    int len;
+    char text[LOG_RECORD_SIZE];     /* "client$request\r\n$result" */
+} log_slot_t;
+
+static log_slot_t log_ring[LOG_RING_SIZE];
+static unsigned long log_tail = 0;      /* Next position to claim (producers) */
+static unsigned long log_head = 0;      /* Next position to drain (writer) */
+
+/* Wakeup of an idle writer; producers only lock when log_writer_idle is set */
+static int log_writer_idle = 0;
+static pthread_mutex_t log_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_wake = PTHREAD_COND_INITIALIZER;
+
+/* Statistics */
+static long long log_pushed = 0;
+static long long log_dropped = 0;
+static long long log_written = 0;       /* Writer thread only */
+static long long log_batches = 0;       /* Writer thread only */
+
+/**
+ * @function get_log_filename: Generate log filename for a date
+ * @param filename: Buffer to store the filename
+ * @param size: Size of the buffer
+ * @param t: Local date of the records
+ **/
+void get_log_filename(char *filename, size_t size, const struct tm *t) {
+    snprintf(filename, size, "logs/log_%04d%02d%02d.txt",
+             t->tm_year + 1900, t->tm_mon + 1, t->tm_mday);
+}
+
+/**
+ * @function log_append: Copy a string into a record, truncating at its end
+ * @param slot: Record
+ * @param s: String
+ **/
+static void log_append(log_slot_t *slot, const char *s) {
+    int n = strlen(s);
+    if (n > LOG_RECORD_SIZE - slot->len) {
+        n = LOG_RECORD_SIZE - slot->len;
+    }
+    memcpy(slot->text + slot->len, s, n);
+    slot->len += n;
+}
+
+/**
+ * @function write_log_detailed: Queue a detailed log entry for the daily log file
+ * @param client_addr: Client address in format IP:Port
+ * @param request: Request received from client
+ * @param result: Result/response sent to client
+ * @note: Never blocks; the entry is dropped (and counted) if the writer is
+ *        LOG_RING_SIZE entries behind
+ **/
+void write_log_detailed(const char *client_addr, const char *request, const char *result) {
+    unsigned long pos = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+    log_slot_t *slot;
+
+    /* Claim a slot */
+    for (;;) {
+        slot = &log_ring[pos & (LOG_RING_SIZE - 1)];
+        unsigned long turn = __atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE);
+        long diff = (long)(turn - pos / LOG_RING_SIZE * 2);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&log_tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    /* Fill it and hand it to the writer */
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    slot->when = ts.tv_sec;
+    slot->len = 0;
+    log_append(slot, client_addr);
+    log_append(slot, "$");
+    if (request != NULL && request[0] != '\0') {
+        log_append(slot, request);
+        log_append(slot, "\\r\\n$");
+    }
+    log_append(slot, result);
+    __atomic_store_n(&slot->turn, pos / LOG_RING_SIZE * 2 + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&log_pushed, 1, __ATOMIC_RELAXED);
+
+    /* Writer asleep on an empty ring: wake it (rare under load) */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&log_writer_idle, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&log_wake_lock);
+        pthread_cond_signal(&log_wake);
+        pthread_mutex_unlock(&log_wake_lock);
+    }
+}
+
+/* ==================== WRITER THREAD ==================== */
+
+typedef struct {
+    int fd;                 /* Daily file, -1 if not open */
+    int day;                /* yyyymmdd of the open file */
+    time_t stamp_sec;       /* Second the cached stamp is for */
+    char stamp[32];         /* "[dd/mm/yyyy hh:mm:ss]" */
+    int stamp_len;
+    char batch[LOG_BATCH_SIZE];
+    int batch_len;
+} log_writer_t;
+
+/**
+ * @function log_flush: Write out the gathered batch
+ * @param w: Writer state
+ **/
+static void log_flush(log_writer_t *w) {
+    if (w->batch_len > 0 && w->fd != -1) {
+        int off = 0;
+        while (off < w->batch_len) {
+            ssize_t n = write(w->fd, w->batch + off, w->batch_len - off);
+            if (n <= 0) {
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+                perror("Cannot write log file");
+                break;
+            }
+            off += n;
+        }
+        log_batches++;
+    }
+    w->batch_len = 0;
+}
+
+/**
+ * @function log_set_time: Refresh the cached timestamp, switching files at a new day
+ * @param w: Writer state
+ * @param when: Time of the next record
+ **/
+static void log_set_time(log_writer_t *w, time_t when) {
+    if (when == w->stamp_sec) {
+        return;
+    }
+
+    struct tm t;
+    localtime_r(&when, &t);
+    w->stamp_sec = when;
+    w->stamp_len = snprintf(w->stamp, sizeof(w->stamp), "[%02d/%02d/%04d %02d:%02d:%02d]",
+                            t.tm_mday, t.tm_mon + 1, t.tm_year + 1900,
+                            t.tm_hour, t.tm_min, t.tm_sec);
+
+    int day = (t.tm_year + 1900) * 10000 + (t.tm_mon + 1) * 100 + t.tm_mday;
+    if (day == w->day && w->fd != -1) {
+        return;
+    }
+
+    /* Midnight (or first record): finish the old file, open today's */
+    log_flush(w);
+    if (w->fd != -1) {
+        close(w->fd);
+    }
+    char log_filename[256];
+    get_log_filename(log_filename, sizeof(log_filename), &t);
+    mkdir("logs", 0755);
+    w->fd = open(log_filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (w->fd == -1) {
+        perror(log_filename);
+    }
+    w->day = day;
+}
+
+/**
+ * @function log_emit: Add one line to the batch
+ * @param w: Writer state
+ * @param when: Time of the record
+ * @param text: Record text (no newline)
+ * @param len: Length of text
+ **/
+static void log_emit(log_writer_t *w, time_t when, const char *text, int len) {
+    log_set_time(w, when);
+    if (w->batch_len + w->stamp_len + 1 + len + 1 > LOG_BATCH_SIZE) {
+        log_flush(w);
+    }
+    memcpy(w->batch + w->batch_len, w->stamp, w->stamp_len);
+    w->batch_len += w->stamp_len;
+    w->batch[w->batch_len++] = '$';
+    memcpy(w->batch + w->batch_len, text, len);
+    w->batch_len += len;
+    w->batch[w->batch_len++] = '\n';
+    log_written++;
+}
+
+/**
+ * @function log_writer: Writer thread draining the ring into the daily file
+ * @param arg: Unused
+ * @return: NULL
+ **/
+static void *log_writer(void *arg) {
+    (void)arg;
+    static log_writer_t w = { .fd = -1 };
+    long long dropped_reported = 0;
+
+    for (;;) {
+        log_slot_t *slot = &log_ring[log_head & (LOG_RING_SIZE - 1)];
+        unsigned long filled = log_head / LOG_RING_SIZE * 2 + 1;
+        if (__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) == filled) {
+            log_emit(&w, slot->when, slot->text, slot->len);
+            __atomic_store_n(&slot->turn, filled + 1, __ATOMIC_RELEASE);
+            log_head++;
+            continue;
+        }
+
+        /* Ring drained: note any drops, write the batch, then sleep */
+        long long dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+        if (dropped != dropped_reported) {
+            char note[96];
+            int len = snprintf(note, sizeof(note), "logger$-WARN %lld records dropped (queue full)",
+                               dropped - dropped_reported);
+            log_emit(&w, time(NULL), note, len);
+            dropped_reported = dropped;
+        }
+        log_flush(&w);
+
+        __atomic_store_n(&log_writer_idle, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&slot->turn, __ATOMIC_SEQ_CST) != filled) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += LOG_IDLE_WAIT_MS / 1000;
+            pthread_mutex_lock(&log_wake_lock);
+            pthread_cond_timedwait(&log_wake, &log_wake_lock, &deadline);
+            pthread_mutex_unlock(&log_wake_lock);
+        }
+        __atomic_store_n(&log_writer_idle, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/**
+ * @function logger_start: Start the log writer thread
+ * @return: 0 on success, -1 on error
+ * @note: Entries queued before the start are kept and written once it runs
+ **/
+int logger_start() {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, log_writer, NULL) != 0) {
+        perror("pthread_create() error");
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+/**
+ * @function logger_print_stats: Print queued, written and dropped log entries
+ **/
+void logger_print_stats() {
+    long long pushed = __atomic_load_n(&log_pushed, __ATOMIC_RELAXED);
+    long long tail = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+    printf("[logger] queued=%lld written=%lld batches=%lld backlog=%lld dropped=%lld\n",
+           pushed, __atomic_load_n(&log_written, __ATOMIC_RELAXED),
+           __atomic_load_n(&log_batches, __ATOMIC_RELAXED),
+           tail - (long long)__atomic_load_n(&log_head, __ATOMIC_RELAXED),
+           __atomic_load_n(&log_dropped, __ATOMIC_RELAXED));
+}
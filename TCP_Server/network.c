@@ -1,5 +1,10 @@
 #include "common.h"
 #include <sys/file.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <sys/xattr.h>
 
 /**
  * @function file_lock: Lock a file for reading or writing using flock
@@ -17,6 +22,33 @@ int file_lock(int fd, int operation) {
 
 /* ==================== NETWORK I/O FUNCTIONS ==================== */
 
+/**
+ * @function wait_socket: Wait until a non-blocking socket is ready for I/O
+ * @param sockfd: Socket file descriptor
+ * @param events: POLLIN to wait for data, POLLOUT to wait for send space
+ * @return: 0 when ready, -1 on error or after IO_TIMEOUT_MS without progress
+ **/
+int wait_socket(int sockfd, short events) {
+    struct pollfd pfd;
+    int ret;
+
+    pfd.fd = sockfd;
+    pfd.events = events;
+    pfd.revents = 0;
+
+    do {
+        ret = poll(&pfd, 1, IO_TIMEOUT_MS);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret <= 0) {
+        return -1;
+    }
+    if (pfd.revents & (POLLERR | POLLNVAL)) {
+        return -1;
+    }
+    return 0;
+}
+
 /**
  * @function tcp_send: Send message to client with \r\n delimiter
  * @param sockfd: Socket file descriptor of the client
@@ -24,72 +56,144 @@ int file_lock(int fd, int operation) {
  * @return: Number of bytes sent on success, -1 on error
  **/
 int tcp_send(int sockfd, char *msg) {
-    char buffer[BUFF_SIZE + 2];
-    int len, total = 0, bytes_sent;
-    
+    struct iovec iov[2];
+    struct iovec *v = iov;
+    int iovcnt = 2;
+    int len, total = 0;
+    ssize_t bytes_sent;
 
-    snprintf(buffer, sizeof(buffer), "%s\r\n", msg);
-    len = strlen(buffer);
-    
+    /* Message and delimiter go out together without being copied */
+    len = strlen(msg) + 2;
+    iov[0].iov_base = msg;
+    iov[0].iov_len = len - 2;
+    iov[1].iov_base = "\r\n";
+    iov[1].iov_len = 2;
 
     while (total < len) {
-        bytes_sent = send(sockfd, buffer + total, len - total, 0);
+        bytes_sent = writev(sockfd, v, iovcnt);
+        if (bytes_sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            /* Socket send buffer full: wait instead of dropping the reply */
+            if (wait_socket(sockfd, POLLOUT) == -1) {
+                return -1;
+            }
+            continue;
+        }
         if (bytes_sent <= 0) {
             return -1;
         }
         total += bytes_sent;
+
+        /* Skip what was sent for a partial write */
+        while (bytes_sent > 0) {
+            if ((size_t)bytes_sent >= v->iov_len) {
+                bytes_sent -= v->iov_len;
+                v++;
+                iovcnt--;
+            } else {
+                v->iov_base = (char *)v->iov_base + bytes_sent;
+                v->iov_len -= bytes_sent;
+                bytes_sent = 0;
+            }
+        }
     }
     
     return total;
 }
 
+/**
+ * @function tcp_grow_buffer: Give a connection a (bigger) receive buffer from the pool
+ * @param state: Connection state
+ * @return: 0 on success, -1 if already at BUFF_SIZE or out of memory
+ **/
+static int tcp_grow_buffer(conn_state_t *state) {
+    int old_cap = state->framer.capacity;
+    int new_cap = old_cap == 0 ? RECV_BUF_MIN : old_cap * 4;
+    if (new_cap > BUFF_SIZE) {
+        return -1;
+    }
+
+    char *buf = buffer_get(new_cap);
+    if (buf == NULL) {
+        return -1;
+    }
+    char *old_buf = state->framer.buf;
+    framer_relocate(&state->framer, buf, new_cap);
+    buffer_put(old_buf, old_cap);
+    return 0;
+}
+
+/**
+ * @function tcp_release_buffer: Return a connection's receive buffer to the pool
+ * @param state: Connection state
+ * @param force: Non-zero to release even with bytes pending (connection closing)
+ * @note: Without force the buffer is kept while a partial command is buffered
+ **/
+void tcp_release_buffer(conn_state_t *state, int force) {
+    if (state->framer.buf == NULL) {
+        return;
+    }
+    if (!force && framer_pending(&state->framer) > 0) {
+        return;
+    }
+
+    buffer_put(state->framer.buf, state->framer.capacity);
+    framer_init(&state->framer, NULL, 0);
+}
+
 /**
  * @function tcp_receive: Receive complete message from client (delimited by \r\n)
  * @param sockfd: Socket file descriptor of the client
  * @param state: Connection state containing receive buffer
- * @param buffer: Buffer to store the received message
- * @param max_len: Maximum length of the buffer
- * @return: Length of received message on success, -1 on error
+ * @param msg: Receives the message, NUL-terminated inside the connection's receive buffer;
+ *             valid until the next tcp_receive on this connection
+ * @return: Length of received message on success, TCP_WOULD_BLOCK when the
+ *          non-blocking socket has no complete message yet, -1 on error
  **/
-int tcp_receive(int sockfd, conn_state_t *state, char *buffer, int max_len) {
-    int bytes_received, i;
+int tcp_receive(int sockfd, conn_state_t *state, char **msg) {
+    int bytes_received, msg_len, avail;
     
     while (1) {
+        msg_len = framer_next(&state->framer, msg);
+        if (msg_len >= 0) {
+            return msg_len;
+        }
 
-        for (i = 0; i < state->buffer_pos - 1; i++) {
-            if (state->recv_buffer[i] == '\r' && state->recv_buffer[i + 1] == '\n') {
-
-                int msg_len = i;
-                if (msg_len >= max_len) {
-                    msg_len = max_len - 1;
-                }
-                
-                memcpy(buffer, state->recv_buffer, msg_len);
-                buffer[msg_len] = '\0';
-                
-
-                state->buffer_pos -= (i + 2);
-                memmove(state->recv_buffer, state->recv_buffer + i + 2, state->buffer_pos);
-                
-                return msg_len;
+        char *space = framer_space(&state->framer, &avail);
+        if (avail == 0) {
+            /* No buffer yet, or a partial line fills it */
+            if (tcp_grow_buffer(state) == -1) {
+                return -1;  /* Line longer than BUFF_SIZE */
             }
+            continue;
         }
         
-
-        if (state->buffer_pos >= BUFF_SIZE - 1) {
-            return -1;
+        bytes_received = recv(sockfd, space, avail, 0);
+        if (bytes_received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return TCP_WOULD_BLOCK;
+        }
+        if (bytes_received == -1 && errno == EINTR) {
+            continue;
         }
-        
-        bytes_received = recv(sockfd, state->recv_buffer + state->buffer_pos, 
-                            BUFF_SIZE - state->buffer_pos - 1, 0);
         if (bytes_received <= 0) {
             return -1;
         }
         
-        state->buffer_pos += bytes_received;
+        framer_commit(&state->framer, bytes_received);
     }
 }
 
+/**
+ * @function tcp_receive_buffered: Take a pipelined message already in the receive buffer
+ * @param state: Connection state containing receive buffer
+ * @param msg: Receives the message, as for tcp_receive
+ * @return: Length of the message, TCP_WOULD_BLOCK if none is buffered
+ * @note: Never touches the socket, so it is safe to call from a worker
+ **/
+int tcp_receive_buffered(conn_state_t *state, char **msg) {
+    int msg_len = framer_next(&state->framer, msg);
+    return msg_len >= 0 ? msg_len : TCP_WOULD_BLOCK;
+}
+
 /**
  * @function send_all: Ensure all data in buffer is sent through socket
  * @param sockfd: Socket file descriptor
@@ -106,6 +210,12 @@ int send_all(int sockfd, const void *buffer, int length) {
     while (total_sent < length) {
         n = send(sockfd, ptr + total_sent, bytes_left, 0);
         
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (wait_socket(sockfd, POLLOUT) == -1) {
+                return -1;
+            }
+            continue;
+        }
         if (n == -1) {
             perror("send() error");
             return -1;
@@ -119,132 +229,588 @@ int send_all(int sockfd, const void *buffer, int length) {
 }
 
 /**
- * @function get_file_size: Get size of a file
- * @param filename: Path to file
- * @return: File size in bytes, -1 if not exist, -2 if directory
+ * @function recv_all: Receive exactly length bytes from a socket
+ * @param sockfd: Socket file descriptor
+ * @param buffer: Destination buffer
+ * @param length: Total bytes to receive
+ * @return: 0 on success, -1 on network error or if the peer closed early
  **/
-long long get_file_size(const char *filename) {
-    struct stat st;
-    if (stat(filename, &st) == 0) {
-        /* Check if it's a regular file */
-        if (S_ISREG(st.st_mode)) {
-            return st.st_size;
+int recv_all(int sockfd, void *buffer, int length) {
+    char *ptr = (char *)buffer;
+    int total_received = 0;
+    int n;
+
+    while (total_received < length) {
+        n = recv(sockfd, ptr + total_received, length - total_received, 0);
+
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (wait_socket(sockfd, POLLIN) == -1) {
+                return -1;
+            }
+            continue;
         }
-        /* If it's a directory */
-        if (S_ISDIR(st.st_mode)) {
-            return -2;
+        if (n <= 0) {
+            return -1;
         }
 
+        total_received += n;
     }
-    return -1; /* File does not exist or cannot access */
+
+    return 0;
 }
 
+/* ==================== CONTENT DIGESTS ==================== */
+
+/*
+ * A digest is computed once, while an upload comes in: the copy and io_uring
+ * engines hash each buffer as it passes through. splice never brings the
+ * bytes to user space, so an upload that wants a digest is received by one
+ * of those two instead (splice is kept for -H none). The digest of a finished
+ * upload is kept in the DIGEST_XATTR extended attribute of the file, so it
+ * follows the file through RENAME/MOVE and disappears with it; DOWNLOAD sends
+ * that stored digest and leaves sendfile to move the bytes untouched.
+ */
+
+/* Digest computed over uploads and downloads, chosen with -H */
+int digest_algo = DIGEST_CRC32C;
+
 /**
- * @function send_file_content: Read file from disk and send raw bytes to client
- * @param sockfd: Socket descriptor
- * @param filepath: Full path to file
- * @return: 0 on success, -1 on error
+ * @function digest_file: Hash a byte range of a file already on disk
+ * @param fd: File descriptor (readable)
+ * @param offset: First byte
+ * @param length: Number of bytes
+ * @param digest: Digest to update
+ * @return: 0 on success, -1 on read error or short file
+ * @note: For bytes that did not come through a transfer engine: the part
+ *        an UPLOAD_RESUME already held, or an upload sent in chunks
  **/
-int send_file_content(int sockfd, const char *filepath) {
-    FILE *fp = fopen(filepath, "rb");
-    if (fp == NULL) {
+int digest_file(int fd, long long offset, long long length, digest_t *digest) {
+    if (digest == NULL || digest->algo == DIGEST_NONE || length == 0) {
+        return 0;
+    }
+
+    char *file_buf = buffer_get(BUFF_SIZE);
+    int ret = 0;
+    if (file_buf == NULL) {
         return -1;
     }
+    while (length > 0) {
+        ssize_t n = pread(fd, file_buf, length < BUFF_SIZE ? length : BUFF_SIZE, offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ret = -1;
+            break;
+        }
+        digest_update(digest, file_buf, n);
+        offset += n;
+        length -= n;
+    }
+    buffer_put(file_buf, BUFF_SIZE);
+    return ret;
+}
 
-    int fd = fileno(fp);
-    
-    /* Lock file for reading */
-    if (file_lock(fd, LOCK_SH) == -1) {
-        fclose(fp);
+/**
+ * @function digest_store: Keep a file's digest in its extended attribute
+ * @param fd: File descriptor
+ * @param text: Digest as "<algo>:<hex>" ("" stores nothing)
+ * @note: Filesystems without user xattrs just do not keep it
+ **/
+void digest_store(int fd, const char *text) {
+    if (text[0] != '\0') {
+        fsetxattr(fd, DIGEST_XATTR, text, strlen(text), 0);
+    }
+}
+
+/**
+ * @function digest_stored: Read the digest kept with a file
+ * @param fd: File descriptor
+ * @param text: Buffer for "<algo>:<hex>"
+ * @param size: Size of text
+ * @return: 0 if a digest is stored, -1 if not
+ **/
+int digest_stored(int fd, char *text, size_t size) {
+    ssize_t n = fgetxattr(fd, DIGEST_XATTR, text, size - 1);
+    if (n <= 0) {
         return -1;
     }
+    text[n] = '\0';
+    return 0;
+}
 
-    char file_buf[BUFF_SIZE];
-    size_t n_read;
-    
-    while ((n_read = fread(file_buf, 1, sizeof(file_buf), fp)) > 0) {
-        int n_sent = send_all(sockfd, file_buf, n_read);
-        if (n_sent < 0) {
-            file_lock(fd, LOCK_UN);
-            fclose(fp);
+/**
+ * @function tcp_send_digest: Send a completion code followed by a digest
+ * @param sockfd: Socket descriptor
+ * @param code: Response code
+ * @param text: Digest as "<algo>:<hex>", "" to send the code alone
+ * @return: Result of tcp_send
+ **/
+int tcp_send_digest(int sockfd, const char *code, const char *text) {
+    char msg[DIGEST_TEXT_SIZE + 16];
+    snprintf(msg, sizeof(msg), text[0] != '\0' ? "%s %s" : "%s", code, text);
+    return tcp_send(sockfd, msg);
+}
+
+/* ==================== FILE TRANSFER ENGINES ==================== */
+
+/* Engine used for file bodies, chosen with -b */
+int io_backend = IO_BACKEND_COPY;
+
+/* Per-engine counters, updated atomically by the workers */
+typedef struct {
+    const char *name;
+    long long transfers;
+    long long bytes;
+    long long ns;           /* Wall time spent inside the engine */
+    long long syscalls;
+} transfer_stat_t;
+
+static transfer_stat_t transfer_stats[ENGINE_COUNT] = {
+    [ENGINE_COPY] = { "copy" },
+    [ENGINE_URING] = { "io_uring" },
+    [ENGINE_SENDFILE] = { "sendfile" },
+    [ENGINE_SPLICE] = { "splice" },
+};
+
+/**
+ * @function transfer_record: Account one finished file transfer
+ * @param engine: ENGINE_* that moved the bytes
+ * @param bytes: Bytes transferred
+ * @param ns: Time taken in nanoseconds
+ * @param syscalls: Syscalls issued
+ **/
+static void transfer_record(int engine, long long bytes, long long ns, long long syscalls) {
+    transfer_stat_t *st = &transfer_stats[engine];
+    __atomic_add_fetch(&st->transfers, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&st->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&st->ns, ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&st->syscalls, syscalls, __ATOMIC_RELAXED);
+}
+
+/**
+ * @function transfer_print_stats: Print throughput and syscalls per MB of each engine
+ **/
+void transfer_print_stats() {
+    for (int i = 0; i < ENGINE_COUNT; i++) {
+        transfer_stat_t *st = &transfer_stats[i];
+        long long transfers = __atomic_load_n(&st->transfers, __ATOMIC_RELAXED);
+        long long bytes = __atomic_load_n(&st->bytes, __ATOMIC_RELAXED);
+        long long ns = __atomic_load_n(&st->ns, __ATOMIC_RELAXED);
+        long long syscalls = __atomic_load_n(&st->syscalls, __ATOMIC_RELAXED);
+        double mb = bytes / (1024.0 * 1024.0);
+
+        printf("[transfer %s] files=%lld bytes=%lld rate=%.1fMB/s syscalls=%lld (%.1f per MB)\n",
+               st->name, transfers, bytes, ns ? mb * 1e9 / ns : 0.0,
+               syscalls, mb > 0 ? syscalls / mb : 0.0);
+    }
+}
+
+/**
+ * @function pwrite_all: Write a whole buffer at a file offset
+ * @param fd: File descriptor
+ * @param buffer: Data to write
+ * @param length: Number of bytes
+ * @param offset: File offset of the first byte
+ * @param syscalls: Incremented for every write issued
+ * @return: 0 on success, -1 on error
+ **/
+static int pwrite_all(int fd, const char *buffer, long long length, long long offset,
+                      long long *syscalls) {
+    while (length > 0) {
+        ssize_t n = pwrite(fd, buffer, length, offset);
+        (*syscalls)++;
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
             return -1;
         }
+        buffer += n;
+        offset += n;
+        length -= n;
     }
-    
-
-    file_lock(fd, LOCK_UN);
-    fclose(fp);
     return 0;
 }
 
 /**
- * @function receive_file_content: Receive raw binary data from client
+ * @function copy_send_file: Blocking engine, pread() into a buffer then send_all()
  * @param sockfd: Socket descriptor
- * @param state: Connection state
- * @param filepath: Full path to save the received file
- * @param filesize: Total size of the file to receive
- * @return: 0 on success, -1 on file error, -2 on connection error
+ * @param fd: File descriptor
+ * @param offset: First byte to send
+ * @param length: Number of bytes to send
+ * @param digest: Updated with every byte sent (NULL: no hashing)
+ * @param syscalls: Incremented for every syscall issued
+ * @return: 0 on success, -1 on error
  **/
-int receive_file_content(int sockfd, conn_state_t *state, const char *filepath, long long filesize) {
-    FILE *fp = fopen(filepath, "wb");
-    if (fp == NULL) {
-        perror("File open failed");
+static int copy_send_file(int sockfd, int fd, long long offset, long long length, digest_t *digest,
+                          long long *syscalls) {
+    char *file_buf = buffer_get(BUFF_SIZE);
+    int ret = 0;
+
+    if (file_buf == NULL) {
         return -1;
     }
 
-    int fd = fileno(fp);
-    
-    
-    if (file_lock(fd, LOCK_EX) == -1) {
-        fclose(fp);
+    while (length > 0) {
+        ssize_t n_read = pread(fd, file_buf, length < BUFF_SIZE ? length : BUFF_SIZE, offset);
+        (*syscalls)++;
+        if (n_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n_read <= 0) {
+            ret = -1;
+            break;
+        }
+        digest_update(digest, file_buf, n_read);
+
+        (*syscalls)++;
+        if (send_all(sockfd, file_buf, (int)n_read) < 0) {
+            ret = -1;
+            break;
+        }
+        offset += n_read;
+        length -= n_read;
+    }
+
+    buffer_put(file_buf, BUFF_SIZE);
+    return ret;
+}
+
+/**
+ * @function sendfile_send_file: Zero-copy engine, page cache straight to the socket
+ * @param sockfd: Socket descriptor
+ * @param fd: File descriptor
+ * @param offset: First byte to send; advanced past every byte sent
+ * @param length: Number of bytes to send
+ * @param syscalls: Incremented for every syscall issued
+ * @return: 0 on success, -1 on error, TRANSFER_UNSUPPORTED if the kernel or
+ *          filesystem cannot sendfile (*offset tells where the copy engine resumes)
+ * @note: One sendfile call moves at most ~2 GB, so large files take several
+ **/
+static int sendfile_send_file(int sockfd, int fd, long long *offset, long long length,
+                              long long *syscalls) {
+    off_t pos = *offset;
+    long long end = *offset + length;
+    int ret = 0;
+
+    while (pos < end) {
+        long long chunk = end - pos;
+        if (chunk > 0x7ffff000LL) {
+            chunk = 0x7ffff000LL;
+        }
+
+        ssize_t n = sendfile(sockfd, fd, &pos, chunk);
+        (*syscalls)++;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (wait_socket(sockfd, POLLOUT) == -1) {
+                ret = -1;
+                break;
+            }
+            continue;
+        }
+        if (n == -1 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+            ret = TRANSFER_UNSUPPORTED;
+            break;
+        }
+        if (n <= 0) {
+            ret = -1;   /* Socket error, or the file shrank under us */
+            break;
+        }
+    }
+
+    *offset = pos;
+    return ret;
+}
+
+/**
+ * @function copy_receive_file: Blocking engine, recv() into a buffer then pwrite()
+ * @param sockfd: Socket descriptor
+ * @param fd: File descriptor
+ * @param offset: File offset of the first received byte
+ * @param length: Number of bytes to receive
+ * @param digest: Updated with every byte received (NULL: no hashing)
+ * @param syscalls: Incremented for every syscall issued
+ * @return: 0 on success, -1 on file error, -2 on connection error
+ **/
+static int copy_receive_file(int sockfd, int fd, long long offset, long long length,
+                             digest_t *digest, long long *syscalls) {
+    char *file_buf = buffer_get(BUFF_SIZE);
+    int ret = 0;
+    int n;
+
+    if (file_buf == NULL) {
         return -1;
     }
 
-    long long total_received = 0;
-    
-    
-    if (state->buffer_pos > 0) {
-        long long to_write = state->buffer_pos;
-        
-        if (to_write > filesize) {
-            to_write = filesize;
+    while (length > 0) {
+        n = recv(sockfd, file_buf, length < BUFF_SIZE ? length : BUFF_SIZE, 0);
+        (*syscalls)++;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (wait_socket(sockfd, POLLIN) == -1) {
+                ret = -2;
+                break;
+            }
+            continue;
+        }
+        if (n <= 0) {
+            ret = -2;
+            break;
         }
 
-        fwrite(state->recv_buffer, 1, to_write, fp);
-        total_received += to_write;
+        if (pwrite_all(fd, file_buf, n, offset, syscalls) == -1) {
+            ret = -1;
+            break;
+        }
+        digest_update(digest, file_buf, n);
+        offset += n;
+        length -= n;
+    }
+
+    buffer_put(file_buf, BUFF_SIZE);
+    return ret;
+}
+
+/* Per-worker pipe used by the splice engine, created on first upload */
+static __thread int splice_pipe[2] = { -1, -1 };
+static __thread int splice_pipe_size = 0;
+
+/**
+ * @function splice_pipe_open: Get the calling worker's pipe
+ * @return: 0 on success, -1 if no pipe could be created
+ **/
+static int splice_pipe_open() {
+    if (splice_pipe[0] != -1) {
+        return 0;
+    }
+    if (pipe2(splice_pipe, O_CLOEXEC) == -1) {
+        splice_pipe[0] = splice_pipe[1] = -1;
+        return -1;
+    }
+
+    /* A bigger pipe means fewer splice calls; keep the default if refused */
+    fcntl(splice_pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    splice_pipe_size = fcntl(splice_pipe[1], F_GETPIPE_SZ);
+    if (splice_pipe_size <= 0) {
+        splice_pipe_size = 65536;
+    }
+    return 0;
+}
+
+/**
+ * @function splice_pipe_reset: Drop the worker's pipe after a failure
+ * @note: The pipe may still hold bytes of the failed upload, so it is
+ *        never reused; the next upload creates a fresh one
+ **/
+static void splice_pipe_reset() {
+    close(splice_pipe[0]);
+    close(splice_pipe[1]);
+    splice_pipe[0] = splice_pipe[1] = -1;
+}
+
+/**
+ * @function splice_pipe_to_file: Move everything sitting in the pipe into the file
+ * @param fd: File descriptor
+ * @param offset: File offset of the first byte; advanced past every byte written
+ * @param pending: Bytes in the pipe
+ * @param syscalls: Incremented for every syscall issued
+ * @return: 0 on success, -1 on file error, TRANSFER_UNSUPPORTED if the
+ *          filesystem cannot splice (the pipe is then drained with read/pwrite)
+ **/
+static int splice_pipe_to_file(int fd, long long *offset, long long pending, long long *syscalls) {
+    while (pending > 0) {
+        loff_t off = *offset;
+        ssize_t n = splice(splice_pipe[0], NULL, fd, &off, pending, SPLICE_F_MOVE);
+        (*syscalls)++;
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && errno == EINVAL) {
+            break;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        *offset += n;
+        pending -= n;
+    }
+    if (pending == 0) {
+        return 0;
+    }
 
-        int remaining = state->buffer_pos - to_write;
-        if (remaining > 0) {
-            memmove(state->recv_buffer, state->recv_buffer + to_write, remaining);
+    /* Filesystem without splice_write: still land the bytes already taken off the socket */
+    char *file_buf = buffer_get(BUFF_SIZE);
+    int ret = TRANSFER_UNSUPPORTED;
+    if (file_buf == NULL) {
+        return -1;
+    }
+    while (pending > 0) {
+        ssize_t n = read(splice_pipe[0], file_buf, pending < BUFF_SIZE ? pending : BUFF_SIZE);
+        (*syscalls)++;
+        if (n == -1 && errno == EINTR) {
+            continue;
         }
-        state->buffer_pos = remaining;
+        if (n <= 0 || pwrite_all(fd, file_buf, n, *offset, syscalls) == -1) {
+            ret = -1;
+            break;
+        }
+        *offset += n;
+        pending -= n;
     }
+    buffer_put(file_buf, BUFF_SIZE);
+    return ret;
+}
 
-    
-    char file_buf[BUFF_SIZE];
-    int n;
-    
-    while (total_received < filesize) {
-        long long bytes_to_recv = sizeof(file_buf);
-        if (filesize - total_received < bytes_to_recv) {
-            bytes_to_recv = filesize - total_received;
+/**
+ * @function splice_receive_file: Zero-copy engine, socket -> worker pipe -> file
+ * @param sockfd: Socket descriptor
+ * @param fd: File descriptor
+ * @param offset: File offset of the first received byte; advanced past every byte written
+ * @param length: Number of bytes to receive
+ * @param syscalls: Incremented for every syscall issued
+ * @return: 0 on success, -1 on file error, -2 on connection error,
+ *          TRANSFER_UNSUPPORTED if splice cannot be used (*offset tells where
+ *          the copy engine resumes)
+ **/
+static int splice_receive_file(int sockfd, int fd, long long *offset, long long length,
+                               long long *syscalls) {
+    long long end = *offset + length;
+    int ret = 0;
+
+    if (splice_pipe_open() == -1) {
+        return TRANSFER_UNSUPPORTED;
+    }
+
+    while (*offset < end) {
+        long long chunk = end - *offset;
+        if (chunk > splice_pipe_size) {
+            chunk = splice_pipe_size;
         }
 
-        n = recv(sockfd, file_buf, bytes_to_recv, 0);
+        ssize_t n = splice(sockfd, NULL, splice_pipe[1], NULL, chunk,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        (*syscalls)++;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            if (wait_socket(sockfd, POLLIN) == -1) {
+                ret = -2;
+                break;
+            }
+            continue;
+        }
+        if (n == -1 && errno == EINVAL) {
+            ret = TRANSFER_UNSUPPORTED;     /* Pipe is empty at this point */
+            break;
+        }
         if (n <= 0) {
-            file_lock(fd, LOCK_UN);
-            fclose(fp);
-            return -2;
+            ret = -2;
+            break;
         }
 
-        fwrite(file_buf, 1, n, fp);
-        total_received += n;
+        ret = splice_pipe_to_file(fd, offset, n, syscalls);
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    if (ret != 0 && ret != TRANSFER_UNSUPPORTED) {
+        splice_pipe_reset();
+    }
+    return ret;
+}
+
+/**
+ * @function send_file_content: Send a byte range of an open file to the client
+ * @param sockfd: Socket descriptor
+ * @param fd: File to send, opened and locked (LOCK_SH) by the caller
+ * @param offset: First byte to send
+ * @param length: Number of bytes to send (within the file)
+ * @param digest: Updated with every byte sent (NULL: no hashing)
+ * @return: 0 on success, -1 on error
+ * @note: Hashing needs the bytes in user space, so with a digest the copy
+ *        engine stands in for sendfile
+ **/
+int send_file_content(int sockfd, int fd, long long offset, long long length, digest_t *digest) {
+    long long start = now_ns();
+    long long syscalls = 0;
+    long long end = offset + length;
+    int engine;
+    int ret;
+
+    if (io_backend == IO_BACKEND_URING) {
+        engine = ENGINE_URING;
+        ret = uring_send_file(sockfd, fd, offset, length, digest, &syscalls);
+    } else if (digest == NULL || digest->algo == DIGEST_NONE) {
+        engine = ENGINE_SENDFILE;
+        ret = sendfile_send_file(sockfd, fd, &offset, length, &syscalls);
+    } else {
+        ret = TRANSFER_UNSUPPORTED;
+    }
+    /* Engine unusable here: finish from where it stopped with the copy loop */
+    if (ret == TRANSFER_UNSUPPORTED) {
+        engine = ENGINE_COPY;
+        ret = copy_send_file(sockfd, fd, offset, end - offset, digest, &syscalls);
     }
+    if (ret == 0) {
+        transfer_record(engine, length, now_ns() - start, syscalls);
+    }
+    return ret == 0 ? 0 : -1;
+}
 
+/**
+ * @function receive_file_content: Receive raw binary data from client
+ * @param sockfd: Socket descriptor
+ * @param state: Connection state
+ * @param fd: File to write, opened and locked (LOCK_EX) by the caller
+ * @param offset: Bytes of the file already held; receiving starts there
+ * @param filesize: Total size of the file (end of the chunk for UPLOAD_CHUNK)
+ * @param digest: Updated with every byte received (NULL: no hashing)
+ * @return: 0 on success, -1 on file error, -2 on connection error
+ * @note: Hashing needs the bytes in user space, so with a digest the copy
+ *        engine stands in for splice
+ **/
+int receive_file_content(int sockfd, conn_state_t *state, int fd, long long offset, long long filesize,
+                         digest_t *digest) {
+    long long start = now_ns();
+    long long syscalls = 0;
+    long long total_received = offset;
     
-    file_lock(fd, LOCK_UN);
-    fclose(fp);
-    printf("File saved: %s (%lld bytes)\n", filepath, total_received);
+    /* Bytes that arrived together with the UPLOAD line are already buffered */
+    if (framer_pending(&state->framer) > 0) {
+        long long to_write = framer_pending(&state->framer);
+        
+        if (to_write > filesize - total_received) {
+            to_write = filesize - total_received;
+        }
+
+        if (pwrite_all(fd, framer_data(&state->framer), to_write, total_received, &syscalls) == -1) {
+            return -1;
+        }
+        digest_update(digest, framer_data(&state->framer), to_write);
+        total_received += to_write;
+        framer_consume(&state->framer, to_write);
+    }
+
+    int engine;
+    int ret;
+
+    if (io_backend == IO_BACKEND_URING) {
+        engine = ENGINE_URING;
+        ret = uring_receive_file(sockfd, fd, total_received, filesize - total_received, digest, &syscalls);
+    } else if (digest == NULL || digest->algo == DIGEST_NONE) {
+        engine = ENGINE_SPLICE;
+        ret = splice_receive_file(sockfd, fd, &total_received, filesize - total_received, &syscalls);
+    } else {
+        ret = TRANSFER_UNSUPPORTED;
+    }
+    /* Engine unusable here: finish from where it stopped with the copy loop */
+    if (ret == TRANSFER_UNSUPPORTED) {
+        engine = ENGINE_COPY;
+        ret = copy_receive_file(sockfd, fd, total_received, filesize - total_received, digest, &syscalls);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    transfer_record(engine, filesize - offset, now_ns() - start, syscalls);
     return 0;
 }
-
@@ -0,0 +1,185 @@
+#include "common.h"
+
+/* ==================== BUFFER POOL ==================== */
+
+/* Size classes; a buffer is always returned to the class it came from */
+static const int buffer_class_size[BUFFER_CLASSES] = { 4096, 16384, 65536 };
+
+/* Free buffers kept per class; anything beyond goes back to malloc */
+static const int buffer_class_keep[BUFFER_CLASSES] = { 1024, 256, 64 };
+
+/* A cached free buffer stores the next pointer in its first bytes */
+typedef struct free_buf {
+    struct free_buf *next;
+} free_buf_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    free_buf_t *free_list;
+    int cached;             /* Buffers in free_list */
+    int in_use;             /* Buffers handed out */
+    int in_use_max;
+    long long mallocs;      /* Gets that missed the cache */
+} buffer_class_t;
+
+static buffer_class_t buffer_classes[BUFFER_CLASSES] = {
+    { PTHREAD_MUTEX_INITIALIZER }, { PTHREAD_MUTEX_INITIALIZER }, { PTHREAD_MUTEX_INITIALIZER }
+};
+
+/**
+ * @function buffer_class: Find the size class of a buffer size
+ * @param size: One of the class sizes
+ * @return: Class index, -1 if size is not a class size
+ **/
+static int buffer_class(int size) {
+    for (int i = 0; i < BUFFER_CLASSES; i++) {
+        if (buffer_class_size[i] == size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @function buffer_get: Borrow a buffer from the pool
+ * @param size: Buffer size, one of 4096, 16384 or BUFF_SIZE
+ * @return: Buffer of size bytes, NULL if out of memory
+ **/
+void *buffer_get(int size) {
+    int c = buffer_class(size);
+    if (c == -1) {
+        return malloc(size);
+    }
+
+    buffer_class_t *bc = &buffer_classes[c];
+    pthread_mutex_lock(&bc->lock);
+    free_buf_t *buf = bc->free_list;
+    if (buf != NULL) {
+        bc->free_list = buf->next;
+        bc->cached--;
+    } else {
+        bc->mallocs++;
+    }
+    bc->in_use++;
+    if (bc->in_use > bc->in_use_max) {
+        bc->in_use_max = bc->in_use;
+    }
+    pthread_mutex_unlock(&bc->lock);
+
+    if (buf == NULL) {
+        buf = malloc(size);
+        if (buf == NULL) {
+            pthread_mutex_lock(&bc->lock);
+            bc->in_use--;
+            pthread_mutex_unlock(&bc->lock);
+        }
+    }
+    return buf;
+}
+
+/**
+ * @function buffer_put: Return a buffer obtained from buffer_get
+ * @param buf: Buffer (NULL is ignored)
+ * @param size: Size passed to buffer_get
+ **/
+void buffer_put(void *buf, int size) {
+    if (buf == NULL) {
+        return;
+    }
+
+    int c = buffer_class(size);
+    if (c == -1) {
+        free(buf);
+        return;
+    }
+
+    buffer_class_t *bc = &buffer_classes[c];
+    pthread_mutex_lock(&bc->lock);
+    bc->in_use--;
+    if (bc->cached < buffer_class_keep[c]) {
+        free_buf_t *fb = (free_buf_t *)buf;
+        fb->next = bc->free_list;
+        bc->free_list = fb;
+        bc->cached++;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&bc->lock);
+
+    free(buf);  /* Cache full */
+}
+
+/* ==================== CONNECTION SLAB ==================== */
+
+#define CONN_SLAB_SIZE 64   /* conn_state_t allocated together */
+
+/* Free connection states are chained through this overlay */
+typedef union conn_slot {
+    union conn_slot *next;
+    conn_state_t state;
+} conn_slot_t;
+
+static pthread_mutex_t conn_slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static conn_slot_t *conn_free_list = NULL;
+static int conn_slabs = 0;
+static int conn_in_use = 0;
+
+/**
+ * @function conn_alloc: Take a zeroed connection state from the slab
+ * @return: Connection state, NULL if out of memory
+ * @note: Slabs are never given back; the free list keeps the high-water mark
+ **/
+conn_state_t *conn_alloc() {
+    pthread_mutex_lock(&conn_slab_lock);
+    if (conn_free_list == NULL) {
+        conn_slot_t *slab = malloc(CONN_SLAB_SIZE * sizeof(conn_slot_t));
+        if (slab == NULL) {
+            pthread_mutex_unlock(&conn_slab_lock);
+            return NULL;
+        }
+        for (int i = 0; i < CONN_SLAB_SIZE; i++) {
+            slab[i].next = conn_free_list;
+            conn_free_list = &slab[i];
+        }
+        conn_slabs++;
+    }
+
+    conn_slot_t *slot = conn_free_list;
+    conn_free_list = slot->next;
+    conn_in_use++;
+    pthread_mutex_unlock(&conn_slab_lock);
+
+    memset(&slot->state, 0, sizeof(conn_state_t));
+    return &slot->state;
+}
+
+/**
+ * @function conn_free: Give a connection state back to the slab
+ * @param state: State from conn_alloc (its receive buffer must be released)
+ **/
+void conn_free(conn_state_t *state) {
+    conn_slot_t *slot = (conn_slot_t *)state;
+
+    pthread_mutex_lock(&conn_slab_lock);
+    slot->next = conn_free_list;
+    conn_free_list = slot;
+    conn_in_use--;
+    pthread_mutex_unlock(&conn_slab_lock);
+}
+
+/**
+ * @function pool_print_stats: Print connection slab and buffer pool usage
+ **/
+void pool_print_stats() {
+    pthread_mutex_lock(&conn_slab_lock);
+    printf("[conn slab] in_use=%d capacity=%d state_size=%zu bytes\n",
+           conn_in_use, conn_slabs * CONN_SLAB_SIZE, sizeof(conn_slot_t));
+    pthread_mutex_unlock(&conn_slab_lock);
+
+    for (int i = 0; i < BUFFER_CLASSES; i++) {
+        buffer_class_t *bc = &buffer_classes[i];
+        pthread_mutex_lock(&bc->lock);
+        printf("[buffers %dK] in_use=%d max_in_use=%d cached=%d mallocs=%lld\n",
+               buffer_class_size[i] / 1024, bc->in_use, bc->in_use_max, bc->cached, bc->mallocs);
+        pthread_mutex_unlock(&bc->lock);
+    }
+}
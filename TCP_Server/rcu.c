@@ -0,0 +1,137 @@
+#include "common.h"
+
+/*
+ * Epoch-based reclamation for data read without locks. A reader brackets its
+ * accesses with rcu_read_lock/rcu_read_unlock, which only publish the global
+ * epoch in the thread's own slot. A writer unpublishes an object (atomic
+ * pointer store) and hands it to rcu_retire, which bumps the epoch and frees
+ * the object once no reader is still inside an older epoch.
+ *
+ * All epoch and slot accesses are sequentially consistent: a reader that
+ * publishes an epoch at or after a retirement is guaranteed to load the new
+ * pointer, and a reader that published an older one holds back the free.
+ */
+
+/* One slot per thread that has ever read; threads here live for the whole run */
+typedef struct rcu_reader {
+    long long epoch;            /* Epoch entered, 0 outside a read section */
+    struct rcu_reader *next;
+} __attribute__((aligned(64))) rcu_reader_t;
+
+typedef struct rcu_retired {
+    void *ptr;
+    void (*free_fn)(void *ptr);
+    long long epoch;            /* Readers at this epoch or later cannot see ptr */
+    struct rcu_retired *next;
+} rcu_retired_t;
+
+static long long rcu_epoch = 1;
+static rcu_reader_t *rcu_readers = NULL;    /* Push-only list */
+static __thread rcu_reader_t *rcu_self = NULL;
+
+static pthread_mutex_t rcu_lock = PTHREAD_MUTEX_INITIALIZER;
+static rcu_retired_t *rcu_retired_list = NULL;  /* Protected by rcu_lock */
+static int rcu_reader_count = 0;
+static long long rcu_retired_total = 0;
+static long long rcu_freed_total = 0;
+
+/**
+ * @function rcu_register: Give the calling thread its reader slot
+ * @note: The slot is never freed; if allocation fails the thread spins here,
+ *        since a reader without a slot could not be waited for
+ **/
+static void rcu_register() {
+    rcu_reader_t *r;
+    while ((r = aligned_alloc(64, sizeof(rcu_reader_t))) == NULL) {
+        sleep(1);
+    }
+    r->epoch = 0;
+
+    pthread_mutex_lock(&rcu_lock);
+    r->next = rcu_readers;
+    __atomic_store_n(&rcu_readers, r, __ATOMIC_SEQ_CST);
+    rcu_reader_count++;
+    pthread_mutex_unlock(&rcu_lock);
+
+    rcu_self = r;
+}
+
+/**
+ * @function rcu_read_lock: Enter a read section
+ * @note: Sections do not nest and must not block
+ **/
+void rcu_read_lock() {
+    if (rcu_self == NULL) {
+        rcu_register();
+    }
+    __atomic_store_n(&rcu_self->epoch, __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @function rcu_read_unlock: Leave a read section
+ **/
+void rcu_read_unlock() {
+    __atomic_store_n(&rcu_self->epoch, 0, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @function rcu_reclaim: Free every retired object no reader can still see
+ * @note: Caller holds rcu_lock
+ **/
+static void rcu_reclaim() {
+    long long oldest = 0;   /* Oldest epoch a reader is in, 0 if none */
+    for (rcu_reader_t *r = __atomic_load_n(&rcu_readers, __ATOMIC_SEQ_CST); r != NULL; r = r->next) {
+        long long e = __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST);
+        if (e != 0 && (oldest == 0 || e < oldest)) {
+            oldest = e;
+        }
+    }
+
+    rcu_retired_t **link = &rcu_retired_list;
+    while (*link != NULL) {
+        rcu_retired_t *item = *link;
+        if (oldest == 0 || item->epoch <= oldest) {
+            *link = item->next;
+            item->free_fn(item->ptr);
+            free(item);
+            rcu_freed_total++;
+        } else {
+            link = &item->next;
+        }
+    }
+}
+
+/**
+ * @function rcu_retire: Free an object once current readers are done with it
+ * @param ptr: Object, already unreachable for new readers
+ * @param free_fn: Destructor
+ * @note: Called by writers (rare); objects wait at most until the next call
+ **/
+void rcu_retire(void *ptr, void (*free_fn)(void *ptr)) {
+    rcu_retired_t *item = malloc(sizeof(rcu_retired_t));
+
+    pthread_mutex_lock(&rcu_lock);
+    long long epoch = __atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+    if (item != NULL) {
+        item->ptr = ptr;
+        item->free_fn = free_fn;
+        item->epoch = epoch;
+        item->next = rcu_retired_list;
+        rcu_retired_list = item;
+        rcu_retired_total++;
+    }
+    /* Out of memory: leak ptr rather than free it under a reader */
+    rcu_reclaim();
+    pthread_mutex_unlock(&rcu_lock);
+}
+
+/**
+ * @function rcu_print_stats: Print reader slots and reclamation counters
+ **/
+void rcu_print_stats() {
+    pthread_mutex_lock(&rcu_lock);
+    printf("[rcu] epoch=%lld readers=%d retired=%lld freed=%lld pending=%lld\n",
+           __atomic_load_n(&rcu_epoch, __ATOMIC_SEQ_CST), rcu_reader_count,
+           rcu_retired_total, rcu_freed_total, rcu_retired_total - rcu_freed_total);
+    pthread_mutex_unlock(&rcu_lock);
+}
@@ -0,0 +1,349 @@
+#include "common.h"
+#include <sys/epoll.h>
+#include <fcntl.h>
+
+/* ==================== REACTOR STATE ==================== */
+
+/* One epoll instance owning a listening socket and the clients it accepted */
+typedef struct {
+    int id;
+    int epfd;
+    int listenfd;
+    int cpu;                /* Core the reactor thread is pinned to, -1 if none */
+    conn_state_t **conns;   /* Connection table indexed by socket fd */
+    int conn_cap;
+    int conn_count;         /* Live connections (read via __atomic for stats) */
+    long long accepted;     /* Connections accepted since start */
+} reactor_t;
+
+/* Registry used only to print per-reactor statistics */
+static reactor_t *reactors[MAX_REACTORS];
+static int reactor_count = 0;
+static pthread_mutex_t reactor_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* A framed command handed from the reactor to a worker; command points
+ * into the connection's receive buffer, which only the owning thread touches */
+typedef struct {
+    conn_state_t *state;
+    char *command;
+} command_task_t;
+
+/* ==================== CONNECTION OWNERSHIP ==================== */
+
+/**
+ * @function reactor_rearm: Give a connection back to its reactor
+ * @param state: Connection state
+ * @note: Sockets are registered EPOLLONESHOT, so exactly one thread (the
+ *        reactor or the worker running its command) owns a connection at a
+ *        time. Re-arming hands ownership back; state must not be touched
+ *        afterwards. Data that arrived meanwhile is reported immediately.
+ **/
+static void reactor_rearm(conn_state_t *state) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+    ev.data.ptr = state;
+    epoll_ctl(state->epfd, EPOLL_CTL_MOD, state->sockfd, &ev);
+}
+
+/**
+ * @function run_command_task: Worker body, runs one command and any pipelined ones
+ * @param arg: Pointer to a command_task_t (freed here)
+ **/
+static void run_command_task(void *arg) {
+    command_task_t *task = (command_task_t *)arg;
+    conn_state_t *state = task->state;
+    char *command = task->command;
+
+    free(task);
+
+    /* Commands the client pipelined behind the first are already buffered */
+    do {
+        TRACE(TRACE_DEBUG, "Received from %s: %s\n",
+              state->is_logged_in ? state->logged_user : "anonymous", command);
+        process_command(state, command);
+    } while (tcp_receive_buffered(state, &command) >= 0);
+
+    /* Idle connections hold no receive buffer */
+    tcp_release_buffer(state, 0);
+    reactor_rearm(state);
+}
+
+/**
+ * @function reactor_track: Register a connection in the reactor's table
+ * @param r: Reactor
+ * @param state: Connection state (state->sockfd is the table index)
+ * @return: 0 on success, -1 if the table cannot grow
+ **/
+static int reactor_track(reactor_t *r, conn_state_t *state) {
+    if (state->sockfd >= r->conn_cap) {
+        int new_cap = r->conn_cap ? r->conn_cap : 1024;
+        while (new_cap <= state->sockfd) {
+            new_cap *= 2;
+        }
+
+        conn_state_t **grown = realloc(r->conns, new_cap * sizeof(conn_state_t *));
+        if (grown == NULL) {
+            return -1;
+        }
+        memset(grown + r->conn_cap, 0, (new_cap - r->conn_cap) * sizeof(conn_state_t *));
+        r->conns = grown;
+        r->conn_cap = new_cap;
+    }
+
+    r->conns[state->sockfd] = state;
+    __atomic_add_fetch(&r->conn_count, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/**
+ * @function reactor_close: Tear down a connection owned by the reactor
+ * @param r: Reactor
+ * @param state: Connection state to release
+ **/
+static void reactor_close(reactor_t *r, conn_state_t *state) {
+    epoll_ctl(r->epfd, EPOLL_CTL_DEL, state->sockfd, NULL);
+    r->conns[state->sockfd] = NULL;
+    __atomic_sub_fetch(&r->conn_count, 1, __ATOMIC_RELAXED);
+    client_disconnected(state);
+}
+
+/* ==================== EVENT HANDLERS ==================== */
+
+/**
+ * @function reactor_accept: Accept every pending connection on the listening socket
+ * @param r: Reactor
+ **/
+static void reactor_accept(reactor_t *r) {
+    struct sockaddr_in client_addr;
+    socklen_t sin_size;
+    int connfd;
+
+    while (1) {
+        sin_size = sizeof(client_addr);
+        connfd = accept4(r->listenfd, (struct sockaddr *)&client_addr, &sin_size,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connfd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept() error");
+            }
+            return;
+        }
+
+        __atomic_add_fetch(&r->accepted, 1, __ATOMIC_RELAXED);
+        TRACE(TRACE_INFO, "\n[NEW CONNECTION] %s:%d\n",
+              inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+
+        /* Create state for this connection */
+        conn_state_t *state = conn_alloc();
+        if (state == NULL) {
+            close(connfd);
+            continue;
+        }
+        state->sockfd = connfd;
+        state->user_group_id = -1;
+
+        /* Store client address for logging */
+        snprintf(state->client_addr, sizeof(state->client_addr), "%s:%d",
+                 inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+
+        if (reactor_track(r, state) == -1) {
+            close(connfd);
+            conn_free(state);
+            continue;
+        }
+
+        state->epfd = r->epfd;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+        ev.data.ptr = state;
+        if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, connfd, &ev) == -1) {
+            perror("epoll_ctl() error");
+            r->conns[connfd] = NULL;
+            __atomic_sub_fetch(&r->conn_count, 1, __ATOMIC_RELAXED);
+            close(connfd);
+            conn_free(state);
+            continue;
+        }
+
+        client_connected(state);
+    }
+}
+
+/**
+ * @function reactor_readable: Frame the next command of a readable client and queue it
+ * @param r: Reactor
+ * @param state: Connection state of the client
+ * @note: Edge-triggered, so the socket is read until a full command or EAGAIN.
+ *        Once a command is queued the worker owns the connection until it re-arms.
+ *        If the command queue is full the client gets 508 and is disconnected.
+ **/
+static void reactor_readable(reactor_t *r, conn_state_t *state) {
+    char *command;
+    int ret = tcp_receive(state->sockfd, state, &command);
+    if (ret == TCP_WOULD_BLOCK) {
+        tcp_release_buffer(state, 0);
+        reactor_rearm(state);
+        return;
+    }
+    if (ret < 0) {
+        reactor_close(r, state); /* Connection closed or error */
+        return;
+    }
+
+    command_task_t *task = malloc(sizeof(command_task_t));
+    if (task == NULL) {
+        reactor_close(r, state);
+        return;
+    }
+    task->state = state;
+    task->command = command;
+
+    /* Never wait for a worker here: with the queue full, every connection of
+     * this reactor would stall. The client is told to come back later */
+    if (thread_pool_try_submit(&command_pool, run_command_task, task) == -1) {
+        free(task);
+        send(state->sockfd, "508\r\n", 5, MSG_DONTWAIT | MSG_NOSIGNAL);
+        TRACE(TRACE_WARN, "Command queue full, turned away %s\n", state->client_addr);
+        reactor_close(r, state);
+    }
+}
+
+/* ==================== EVENT LOOP ==================== */
+
+/**
+ * @function reactor_loop: Run one reactor until epoll fails
+ * @param r: Reactor with listenfd and cpu filled in
+ * @return: -1 (only returns on error)
+ **/
+static int reactor_loop(reactor_t *r) {
+    struct epoll_event events[MAX_EVENTS];
+
+    fcntl(r->listenfd, F_SETFL, fcntl(r->listenfd, F_GETFL, 0) | O_NONBLOCK);
+
+    if ((r->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1() error");
+        return -1;
+    }
+
+    /* Level-triggered so a full fd table (EMFILE) is retried on the next wakeup */
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->listenfd, &ev) == -1) {
+        perror("epoll_ctl() error");
+        close(r->epfd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&reactor_registry_mutex);
+    r->id = reactor_count;
+    if (reactor_count < MAX_REACTORS) {
+        reactors[reactor_count++] = r;
+    }
+    pthread_mutex_unlock(&reactor_registry_mutex);
+
+    while (1) {
+        /* Timeout so a SIGUSR1 delivered to another thread is still noticed */
+        int n = epoll_wait(r->epfd, events, MAX_EVENTS, 1000);
+        if (stats_requested && __atomic_exchange_n(&stats_requested, 0, __ATOMIC_RELAXED)) {
+            print_server_stats();
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait() error");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                reactor_accept(r);
+            } else {
+                /* EPOLLHUP/EPOLLERR surface as a failed read and close the connection */
+                reactor_readable(r, (conn_state_t *)events[i].data.ptr);
+            }
+        }
+    }
+
+    close(r->epfd);
+    free(r->conns);
+    return -1;
+}
+
+/**
+ * @function reactor_run: Run the epoll event loop for a listening socket on this thread
+ * @param listenfd: Listening socket (switched to non-blocking here)
+ * @return: Does not return on success, -1 if the loop cannot start
+ **/
+int reactor_run(int listenfd) {
+    reactor_t *r = calloc(1, sizeof(reactor_t));
+    if (r == NULL) {
+        return -1;
+    }
+    r->listenfd = listenfd;
+    r->cpu = -1;
+    return reactor_loop(r);
+}
+
+/**
+ * @function reactor_thread: Thread body of a pinned reactor
+ * @param arg: Pointer to its reactor_t
+ * @return: NULL if the loop stops
+ **/
+static void *reactor_thread(void *arg) {
+    reactor_t *r = (reactor_t *)arg;
+
+    if (r->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(r->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            TRACE(TRACE_WARN, "Reactor on cpu %d: cannot set affinity, running unpinned\n", r->cpu);
+        }
+    }
+
+    reactor_loop(r);
+    return NULL;
+}
+
+/**
+ * @function reactor_start: Start a reactor thread for its own SO_REUSEPORT listener
+ * @param listenfd: Listening socket owned by the new reactor
+ * @param cpu: Core to pin the thread to (-1 to leave it unpinned)
+ * @param tid: Receives the thread id
+ * @return: 0 on success, -1 on failure
+ **/
+int reactor_start(int listenfd, int cpu, pthread_t *tid) {
+    reactor_t *r = calloc(1, sizeof(reactor_t));
+    if (r == NULL) {
+        return -1;
+    }
+    r->listenfd = listenfd;
+    r->cpu = cpu;
+
+    if (pthread_create(tid, NULL, reactor_thread, r) != 0) {
+        perror("pthread_create() error");
+        free(r);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @function reactor_print_stats: Print accepted and live connections per reactor
+ **/
+void reactor_print_stats() {
+    pthread_mutex_lock(&reactor_registry_mutex);
+    for (int i = 0; i < reactor_count; i++) {
+        reactor_t *r = reactors[i];
+        printf("[reactor %d] cpu=%d connections=%d accepted=%lld\n", r->id, r->cpu,
+               __atomic_load_n(&r->conn_count, __ATOMIC_RELAXED),
+               __atomic_load_n(&r->accepted, __ATOMIC_RELAXED));
+    }
+    pthread_mutex_unlock(&reactor_registry_mutex);
+}
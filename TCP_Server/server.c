@@ -1,221 +1,558 @@
 #include "common.h"
+#include <sys/resource.h>
+
+/* Worker pool running every command handler */
+thread_pool_t command_pool;
+
+/* Set by SIGUSR1, the reactor prints statistics on its next wakeup */
+volatile sig_atomic_t stats_requested = 0;
+
+/* ==================== COMMAND TABLE ==================== */
+
+/* One protocol verb: its handler, the role it requires and its argument count */
+typedef struct {
+    const char *name;
+    void (*handler)(conn_state_t *state, char *command);
+    int role;
+    int min_args;
+    int max_args;
+} command_def_t;
+
+/* Indexes into command_table, used by find_command */
+enum {
+    CMD_REGISTER, CMD_LOGIN, CMD_LOGOUT,
+    CMD_UPLOAD, CMD_UPLOAD_RESUME, CMD_UPLOAD_BEGIN, CMD_UPLOAD_CHUNK, CMD_UPLOAD_COMMIT,
+    CMD_UPLOAD_HASH,
+    CMD_DOWNLOAD,
+    CMD_CREATE, CMD_JOIN, CMD_APPROVE, CMD_INVITE, CMD_ACCEPT, CMD_LEAVE, CMD_KICK,
+    CMD_LIST_GROUPS, CMD_LIST_MEMBERS, CMD_LIST_REQUESTS,
+    CMD_RENAME_FILE, CMD_DELETE_FILE, CMD_COPY_FILE, CMD_MOVE_FILE,
+    CMD_MKDIR, CMD_RENAME_FOLDER, CMD_RMDIR, CMD_COPY_FOLDER, CMD_MOVE_FOLDER,
+    CMD_LIST_CONTENT,
+    CMD_COUNT
+};
+
+static const command_def_t command_table[CMD_COUNT] = {
+    [CMD_REGISTER]      = { "REGISTER",      handle_register,      ROLE_ANONYMOUS, 2, 2 },
+    [CMD_LOGIN]         = { "LOGIN",         handle_login,         ROLE_ANONYMOUS, 2, 2 },
+    [CMD_LOGOUT]        = { "LOGOUT",        handle_logout,        ROLE_LOGGED_IN, 0, 0 },
+    [CMD_UPLOAD]        = { "UPLOAD",        handle_upload,        ROLE_MEMBER,    2, 2 },
+    [CMD_UPLOAD_RESUME] = { "UPLOAD_RESUME", handle_upload_resume, ROLE_MEMBER,    2, 3 },
+    [CMD_UPLOAD_BEGIN]  = { "UPLOAD_BEGIN",  handle_upload_begin,  ROLE_MEMBER,    2, 2 },
+    [CMD_UPLOAD_CHUNK]  = { "UPLOAD_CHUNK",  handle_upload_chunk,  ROLE_ANONYMOUS, 3, 3 },
+    [CMD_UPLOAD_COMMIT] = { "UPLOAD_COMMIT", handle_upload_commit, ROLE_MEMBER,    1, 1 },
+    [CMD_UPLOAD_HASH]   = { "UPLOAD_HASH",   handle_upload_hash,   ROLE_MEMBER,    3, 3 },
+    [CMD_DOWNLOAD]      = { "DOWNLOAD",      handle_download,      ROLE_MEMBER,    1, 4 },
+    [CMD_CREATE]        = { "CREATE",        handle_create_group,  ROLE_LOGGED_IN, 1, 1 },
+    [CMD_JOIN]          = { "JOIN",          handle_join_group,    ROLE_LOGGED_IN, 1, 1 },
+    [CMD_APPROVE]       = { "APPROVE",       handle_approve,       ROLE_LEADER,    1, 1 },
+    [CMD_INVITE]        = { "INVITE",        handle_invite,        ROLE_LEADER,    1, 1 },
+    [CMD_ACCEPT]        = { "ACCEPT",        handle_accept,        ROLE_LOGGED_IN, 1, 1 },
+    [CMD_LEAVE]         = { "LEAVE",         handle_leave,         ROLE_MEMBER,    0, 0 },
+    [CMD_KICK]          = { "KICK",          handle_kick,          ROLE_LEADER,    1, 1 },
+    [CMD_LIST_GROUPS]   = { "LIST_GROUPS",   handle_list_groups,   ROLE_LOGGED_IN, 0, 0 },
+    [CMD_LIST_MEMBERS]  = { "LIST_MEMBERS",  handle_list_members,  ROLE_MEMBER,    0, 0 },
+    [CMD_LIST_REQUESTS] = { "LIST_REQUESTS", handle_list_requests, ROLE_LEADER,    0, 0 },
+    [CMD_RENAME_FILE]   = { "RENAME_FILE",   handle_rename_file,   ROLE_LEADER,    2, 2 },
+    [CMD_DELETE_FILE]   = { "DELETE_FILE",   handle_delete_file,   ROLE_LEADER,    1, 1 },
+    [CMD_COPY_FILE]     = { "COPY_FILE",     handle_copy_file,     ROLE_MEMBER,    2, 2 },
+    [CMD_MOVE_FILE]     = { "MOVE_FILE",     handle_move_file,     ROLE_MEMBER,    2, 2 },
+    [CMD_MKDIR]         = { "MKDIR",         handle_mkdir,         ROLE_MEMBER,    1, 1 },
+    [CMD_RENAME_FOLDER] = { "RENAME_FOLDER", handle_rename_folder, ROLE_LEADER,    2, 2 },
+    [CMD_RMDIR]         = { "RMDIR",         handle_rmdir,         ROLE_LEADER,    1, 1 },
+    [CMD_COPY_FOLDER]   = { "COPY_FOLDER",   handle_copy_folder,   ROLE_MEMBER,    2, 2 },
+    [CMD_MOVE_FOLDER]   = { "MOVE_FOLDER",   handle_move_folder,   ROLE_MEMBER,    2, 2 },
+    [CMD_LIST_CONTENT]  = { "LIST_CONTENT",  handle_list_content,  ROLE_MEMBER,    0, 1 },
+};
+
+/**
+ * @function find_command: Look a verb up in the command table
+ * @param verb: Start of the verb (not NUL-terminated)
+ * @param len: Length of the verb
+ * @return: Table entry, NULL for an unknown verb
+ * @note: Length plus one or two characters pick the only candidate, which
+ *        is then confirmed with a single memcmp
+ **/
+static const command_def_t *find_command(const char *verb, int len) {
+    int id = -1;
+
+    switch (len) {
+        case 4:
+            id = verb[0] == 'J' ? CMD_JOIN : verb[0] == 'K' ? CMD_KICK : -1;
+            break;
+        case 5:
+            switch (verb[0]) {
+                case 'L': id = verb[1] == 'O' ? CMD_LOGIN : CMD_LEAVE; break;
+                case 'M': id = CMD_MKDIR; break;
+                case 'R': id = CMD_RMDIR; break;
+            }
+            break;
+        case 6:
+            switch (verb[0]) {
+                case 'U': id = CMD_UPLOAD; break;
+                case 'L': id = CMD_LOGOUT; break;
+                case 'C': id = CMD_CREATE; break;
+                case 'I': id = CMD_INVITE; break;
+                case 'A': id = CMD_ACCEPT; break;
+            }
+            break;
+        case 7:
+            id = CMD_APPROVE;
+            break;
+        case 8:
+            id = verb[0] == 'R' ? CMD_REGISTER : verb[0] == 'D' ? CMD_DOWNLOAD : -1;
+            break;
+        case 9:
+            id = verb[0] == 'C' ? CMD_COPY_FILE : verb[0] == 'M' ? CMD_MOVE_FILE : -1;
+            break;
+        case 11:
+            switch (verb[0]) {
+                case 'R': id = CMD_RENAME_FILE; break;
+                case 'D': id = CMD_DELETE_FILE; break;
+                case 'L': id = CMD_LIST_GROUPS; break;
+                case 'C': id = CMD_COPY_FOLDER; break;
+                case 'M': id = CMD_MOVE_FOLDER; break;
+                case 'U': id = CMD_UPLOAD_HASH; break;
+            }
+            break;
+        case 12:
+            if (verb[0] == 'L') {
+                id = verb[5] == 'M' ? CMD_LIST_MEMBERS : CMD_LIST_CONTENT;
+            } else {
+                id = verb[7] == 'B' ? CMD_UPLOAD_BEGIN : CMD_UPLOAD_CHUNK;
+            }
+            break;
+        case 13:
+            switch (verb[0]) {
+                case 'L': id = CMD_LIST_REQUESTS; break;
+                case 'R': id = CMD_RENAME_FOLDER; break;
+                case 'U': id = verb[7] == 'R' ? CMD_UPLOAD_RESUME : CMD_UPLOAD_COMMIT; break;
+            }
+            break;
+    }
+
+    if (id == -1 || memcmp(command_table[id].name, verb, len) != 0) {
+        return NULL;
+    }
+    return &command_table[id];
+}
+
+/**
+ * @function count_args: Count the whitespace separated words after the verb
+ * @param args: Text following the verb
+ * @return: Number of arguments
+ **/
+static int count_args(const char *args) {
+    int count = 0;
+    while (*args) {
+        args += strspn(args, " \t");
+        if (*args == '\0') {
+            break;
+        }
+        count++;
+        args += strcspn(args, " \t");
+    }
+    return count;
+}
 
 /* ==================== MAIN COMMAND PROCESSOR ==================== */
 
 /**
- * @function process_command: Process and route client commands
+ * @function process_command: Authorize a client command and route it to its handler
  * @param state: Connection state of the client
  * @param command: Command string received from client
  * @return: None
  **/
 void process_command(conn_state_t *state, char *command) {
-    char cmd[20];
-    
     /* Parse command */
-    if (sscanf(command, "%s", cmd) != 1) {
+    char *verb = command + strspn(command, " \t");
+    int verb_len = strcspn(verb, " \t");
+    const command_def_t *def = find_command(verb, verb_len);
+    if (def == NULL) {
         tcp_send(state->sockfd, "300");
         return;
     }
     
-    /* Route to appropriate handler */
-    if (strcmp(cmd, "REGISTER") == 0) {
-        handle_register(state, command);
-    } else if (strcmp(cmd, "LOGIN") == 0) {
-        handle_login(state, command);
-    } else if (strcmp(cmd, "LOGOUT") == 0) {
-        handle_logout(state, command);
-    } else if (strcmp(cmd, "UPLOAD") == 0) {
-        handle_upload(state, command);
-    } else if (strcmp(cmd, "DOWNLOAD") == 0) {
-        handle_download(state, command);
-    } else if (strcmp(cmd, "CREATE") == 0) {
-        handle_create_group(state, command);
-    } else if (strcmp(cmd, "JOIN") == 0) {
-        handle_join_group(state, command);
-    } else if (strcmp(cmd, "APPROVE") == 0) {
-        handle_approve(state, command);
-    } else if (strcmp(cmd, "INVITE") == 0) {
-        handle_invite(state, command);
-    } else if (strcmp(cmd, "ACCEPT") == 0) {
-        handle_accept(state, command);
-    } else if (strcmp(cmd, "LEAVE") == 0) {
-        handle_leave(state, command);
-    } else if (strcmp(cmd, "KICK") == 0) {
-        handle_kick(state, command);
-    } else if (strcmp(cmd, "LIST_GROUPS") == 0) {
-        handle_list_groups(state, command);
-    } else if (strcmp(cmd, "LIST_MEMBERS") == 0) {
-        handle_list_members(state, command);
-    } else if (strcmp(cmd, "LIST_REQUESTS") == 0) {
-        handle_list_requests(state, command);
-    } else if (strcmp(cmd, "RENAME_FILE") == 0) {
-        handle_rename_file(state, command);
-    } else if (strcmp(cmd, "DELETE_FILE") == 0) {
-        handle_delete_file(state, command);
-    } else if (strcmp(cmd, "COPY_FILE") == 0) {
-        handle_copy_file(state, command);
-    } else if (strcmp(cmd, "MOVE_FILE") == 0) {
-        handle_move_file(state, command);
-    } else if (strcmp(cmd, "MKDIR") == 0) {
-        handle_mkdir(state, command);
-    } else if (strcmp(cmd, "RENAME_FOLDER") == 0) {
-        handle_rename_folder(state, command);
-    } else if (strcmp(cmd, "RMDIR") == 0) {
-        handle_rmdir(state, command);
-    } else if (strcmp(cmd, "COPY_FOLDER") == 0) {
-        handle_copy_folder(state, command);
-    } else if (strcmp(cmd, "MOVE_FOLDER") == 0) {
-        handle_move_folder(state, command);
-    } else if (strcmp(cmd, "LIST_CONTENT") == 0) {
-        handle_list_content(state, command);
-    } else {
+    /* Role check replaces the per-handler access control */
+    char *access_error = role_based_access_control(def->role, state);
+    if (access_error != NULL) {
+        tcp_send(state->sockfd, access_error);
+        write_log_detailed(state->client_addr, command, "-ERR Access denied");
+        return;
+    }
+    
+    int args = count_args(verb + verb_len);
+    if (args < def->min_args || args > def->max_args) {
         tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Syntax error");
+        return;
     }
+    
+    def->handler(state, verb);
 }
 
-/* ==================== THREAD FUNCTION ==================== */
+/* ==================== CONNECTION LIFECYCLE ==================== */
 
 /**
- * @function handle_client: Thread function to handle a client connection
- * @param arg: Pointer to conn_state_t structure for this client
- * @return: NULL after client disconnects
+ * @function client_connected: Greet a newly accepted client
+ * @param state: Connection state of the client
+ * @return: None
  **/
-void *handle_client(void *arg) {
-    conn_state_t *state = (conn_state_t *)arg;
-    char buffer[BUFF_SIZE];
-    
-    /* Send welcome message */
-    tcp_send(state->sockfd, "100");
-    
-    /* Process commands */
-    while (1) {
-        int ret = tcp_receive(state->sockfd, state, buffer, BUFF_SIZE);
-        if (ret <= 0) {
-            break; /* Connection closed or error */
-        }
-        
-        printf("Received from %s: %s\n", 
-               state->is_logged_in ? state->logged_user : "anonymous", buffer);
-        process_command(state, buffer);
-    }
-    
+void client_connected(conn_state_t *state) {
+    /* Send welcome message, listing optional features the client may use */
+    tcp_send(state->sockfd, dedup_enabled ? "100 dedup" : "100");
+}
+
+/**
+ * @function client_disconnected: Release a client after its socket closed
+ * @param state: Connection state of the client (returned to the slab here)
+ * @return: None
+ **/
+void client_disconnected(conn_state_t *state) {
     /* Auto logout if logged in */
     if (state->is_logged_in) {
         pthread_mutex_lock(&account_mutex);
-        for (int i = 0; i < account_count; i++) {
-            if (strcmp(accounts[i].username, state->logged_user) == 0) {
-                accounts[i].is_logged_in = 0;
-                printf("User %s disconnected (auto logout)\n", state->logged_user);
-                write_log_detailed(state->client_addr, "", "+INFO User disconnected (auto logout)");
-                break;
-            }
-        }
+        ACCOUNT(state->account_idx).is_logged_in = 0;
         pthread_mutex_unlock(&account_mutex);
+        TRACE(TRACE_INFO, "User %s disconnected (auto logout)\n", state->logged_user);
+        write_log_detailed(state->client_addr, "", "+INFO User disconnected (auto logout)");
     }
     
     close(state->sockfd);
-    free(state);
-    pthread_detach(pthread_self());
-    return NULL;
+    tcp_release_buffer(state, 1);
+    conn_free(state);
+}
+
+/**
+ * @function raise_fd_limit: Raise the open file limit to its hard maximum
+ * @return: None
+ * @note: Every client holds one descriptor, so the default soft limit (1024)
+ *        would cap concurrent sessions well below what the event loop handles
+ **/
+static void raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+/* ==================== STATISTICS ==================== */
+
+/**
+ * @function on_stats_signal: SIGUSR1 handler, defers the report to the reactor
+ * @param sig: Signal number (unused)
+ **/
+static void on_stats_signal(int sig) {
+    (void)sig;
+    stats_requested = 1;
+}
+
+/**
+ * @function print_server_stats: Print runtime statistics (triggered by SIGUSR1)
+ * @return: None
+ **/
+void print_server_stats() {
+    printf("========== SERVER STATISTICS ==========\n");
+    reactor_print_stats();
+    thread_pool_print_stats(&command_pool, "command pool");
+    thread_pool_print_stats(&copy_pool, "copy pool");
+    pool_print_stats();
+    rcu_print_stats();
+    journal_print_stats();
+    logger_print_stats();
+    transfer_print_stats();
+    upload_print_stats();
+    dedup_print_stats();
+    copy_print_stats();
+    printf("=======================================\n");
+    fflush(stdout);
 }
 
 /* ==================== MAIN FUNCTION ==================== */
 
+/**
+ * @function open_listener: Create, bind and listen on a TCP socket
+ * @param port: Port number
+ * @param reuse_port: Non-zero to set SO_REUSEPORT so several sockets share the port
+ * @return: Listening socket, -1 on error
+ **/
+static int open_listener(int port, int reuse_port) {
+    int listenfd;
+    struct sockaddr_in server_addr;
+    
+    /* Create socket */
+    if ((listenfd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+        perror("socket() error");
+        return -1;
+    }
+    
+    /* The kernel then spreads incoming connections across the sockets */
+    if (reuse_port) {
+        int on = 1;
+        if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+            perror("setsockopt(SO_REUSEPORT) error");
+            close(listenfd);
+            return -1;
+        }
+    }
+        
+    /* Bind */
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    
+    if (bind(listenfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+        perror("bind() error");
+        close(listenfd);
+        return -1;
+    }
+    
+    /* Listen */
+    if (listen(listenfd, BACKLOG) == -1) {
+        perror("listen() error");
+        close(listenfd);
+        return -1;
+    }
+    
+    return listenfd;
+}
+
+/**
+ * @function print_usage: Print command line usage
+ * @param prog: Program name
+ **/
+static void print_usage(const char *prog) {
+    printf("Usage: %s [-w workers] [-c copy_workers] [-q queue_size] [-r reactors] [-b copy|uring] [-H crc32c|sha256|none] [-d] [-F none|file|full] Port_Number\n", prog);
+}
+
 /**
  * @function main: Main server function to initialize and accept connections
  * @param argc: Number of command line arguments
- * @param argv: Array of command line arguments (argv[1] is port number)
+ * @param argv: Array of command line arguments
+ *              [-w workers] [-c copy_workers] [-q queue_size] [-r reactors] [-b copy|uring] [-H crc32c|sha256|none] [-d] [-F none|file|full] Port_Number
  * @return: 0 on normal exit, 1 on error
  **/
 int main(int argc, char *argv[]) {
-    int listenfd, connfd;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t sin_size;
-    pthread_t tid;
+    int listenfd;
     int port;
+    int worker_count = 0;           /* 0: one worker per core */
+    int copy_workers = 0;           /* 0: one per core */
+    int queue_size = POOL_QUEUE_SIZE;
+    int reactor_total = 1;          /* >1: one SO_REUSEPORT listener per reactor */
+    int digest_set = 0;
+    int opt;
+    
+    while ((opt = getopt(argc, argv, "w:c:q:r:b:H:dF:")) != -1) {
+        switch (opt) {
+            case 'w':
+                worker_count = atoi(optarg);
+                break;
+            case 'c':
+                copy_workers = atoi(optarg);
+                break;
+            case 'q':
+                queue_size = atoi(optarg);
+                break;
+            case 'r':
+                reactor_total = atoi(optarg);
+                break;
+            case 'b':
+                if (strcmp(optarg, "uring") == 0) {
+                    io_backend = IO_BACKEND_URING;
+                } else if (strcmp(optarg, "copy") == 0) {
+                    io_backend = IO_BACKEND_COPY;
+                } else {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'H':
+                digest_algo = digest_parse_algo(optarg);
+                if (digest_algo == -1) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                digest_set = 1;
+                break;
+            case 'd':
+                dedup_enabled = 1;
+                break;
+            case 'F':
+                if (strcmp(optarg, "none") == 0) {
+                    sync_policy = SYNC_NONE;
+                } else if (strcmp(optarg, "file") == 0) {
+                    sync_policy = SYNC_FILE;
+                } else if (strcmp(optarg, "full") == 0) {
+                    sync_policy = SYNC_FULL;
+                } else {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
     
-    if (argc != 2) {
-        printf("Usage: %s Port_Number\n", argv[0]);
+    if (argc - optind != 1 || reactor_total < 1 || reactor_total > MAX_REACTORS) {
+        print_usage(argv[0]);
         return 1;
     }
     
-    port = atoi(argv[1]);
+    /* Blobs are named by their SHA-256 */
+    if (dedup_enabled) {
+        if (digest_set && digest_algo != DIGEST_SHA256) {
+            fprintf(stderr, "-d needs -H sha256\n");
+            return 1;
+        }
+        digest_algo = DIGEST_SHA256;
+    }
+    
+    port = atoi(argv[optind]);
+    trace_init(TRACE_INFO);
     
-    /* Load data from files */
+    /* A client vanishing mid-send must not kill the whole server */
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+    
+    /* SIGUSR1 prints statistics; no SA_RESTART so epoll_wait wakes up */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stats_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+    
+    /* Keep the blocking engine when the kernel or the build lacks io_uring */
+    if (io_backend == IO_BACKEND_URING && !uring_available()) {
+        printf("io_uring not available, using copy backend\n");
+        io_backend = IO_BACKEND_COPY;
+    }
+    
+    /* Load data: the snapshot if there is one, else the legacy text files */
     printf("Loading data...\n");
-    load_accounts();
-    load_groups();
-    load_requests();
-    load_invites();
+    int snapshot = snapshot_load();
+    if (snapshot == -2) {
+        fprintf(stderr, "Refusing to start with a damaged snapshot\n");
+        return 1;
+    }
+    if (snapshot == -1) {
+        load_accounts();
+        load_groups();
+        load_requests();
+        load_invites();
+    }
+    if (store_build_indexes() == -1) {
+        fprintf(stderr, "Out of memory indexing data\n");
+        return 1;
+    }
+    journal_replay();
     
     /* Create necessary directories if not exist */
     mkdir("data", 0755);
     mkdir("groups", 0755);
     mkdir("logs", 0755);
+    if (dedup_enabled && dedup_init() == -1) {
+        return 1;
+    }
     
-    /* Create socket */
-    if ((listenfd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
-        perror("socket() error");
+    /* Uploads abandoned long ago, or by an earlier run, give their space back */
+    if (upload_sweeper_start() == -1) {
         return 1;
     }
-        
-    /* Bind */
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    server_addr.sin_addr.s_addr = INADDR_ANY;
     
-    if (bind(listenfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
-        perror("bind() error");
+    /* Activity log entries are written by a background thread */
+    if (logger_start() == -1) {
+        return 1;
+    }
+    
+    /* Mutations from now on go to the journal */
+    if (journal_start(snapshot == -1) == -1) {
+        return 1;
+    }
+    
+    /* First listener; SO_REUSEPORT only when it will be shared */
+    if ((listenfd = open_listener(port, reactor_total > 1)) == -1) {
+        return 1;
+    }
+    
+    /* Start the workers that run command handlers */
+    if (thread_pool_init(&command_pool, worker_count, queue_size) == -1) {
+        printf("Cannot start worker pool\n");
         close(listenfd);
         return 1;
     }
     
-    /* Listen */
-    if (listen(listenfd, BACKLOG) == -1) {
-        perror("listen() error");
+    /* Separate workers for COPY_FOLDER batches, which command workers wait on,
+     * and for blob store sweeps */
+    if (thread_pool_init(&copy_pool, copy_workers, POOL_QUEUE_SIZE) == -1) {
+        printf("Cannot start copy pool\n");
         close(listenfd);
         return 1;
     }
     
+    /* Count the blob store and drop what an earlier run left unreferenced */
+    dedup_collect_later();
+    
     printf("===========================================\n");
     printf("  FILE SHARING SERVER STARTED\n");
     printf("  Port: %d\n", port);
+    printf("  Workers: %d (queue %d)\n", command_pool.thread_count, command_pool.capacity);
+    printf("  Copy workers: %d\n", copy_pool.thread_count);
+    printf("  Reactors: %d\n", reactor_total);
+    printf("  I/O backend: %s\n", io_backend == IO_BACKEND_URING ? "io_uring" : "copy");
+    printf("  Digest: %s\n", digest_algo_name(digest_algo));
+    printf("  Dedup: %s\n", dedup_enabled ? "on (blobs/)" : "off");
+    printf("  Upload sync: %s\n", sync_policy == SYNC_NONE ? "none" : sync_policy == SYNC_FILE ? "file" : "full");
     printf("  Waiting for connections...\n");
     printf("===========================================\n");
     
     write_log_detailed("SERVER", "", "+INFO Server started");
     
-    /* Accept connections */
-    while (1) {
-        sin_size = sizeof(client_addr);
-        connfd = accept(listenfd, (struct sockaddr *)&client_addr, &sin_size);
-        if (connfd == -1) {
-            perror("accept() error");
-            continue;
+    /* Single reactor: serve all connections from this thread */
+    if (reactor_total == 1) {
+        if (reactor_run(listenfd) == -1) {
+            close(listenfd);
+            return 1;
         }
-        
-        printf("\n[NEW CONNECTION] %s:%d\n", 
-               inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-        
-        /* Create state for this connection */
-        conn_state_t *state = malloc(sizeof(conn_state_t));
-        memset(state, 0, sizeof(conn_state_t));
-        state->sockfd = connfd;
-        state->user_group_id = -1;
-        
-        /* Store client address for logging */
-        snprintf(state->client_addr, sizeof(state->client_addr), "%s:%d",
-                 inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-        
-        /* Create thread to handle client */
-        if (pthread_create(&tid, NULL, handle_client, state) != 0) {
-            perror("pthread_create() error");
-            close(connfd);
-            free(state);
+        close(listenfd);
+        return 0;
+    }
+    
+    /* Multi-reactor: one listener, accept queue and connection table per core.
+     * Only the cores this process may run on count (taskset, cgroup cpusets):
+     * they need not be 0..n-1 */
+    int cpus[CPU_SETSIZE];
+    int cpu_count = 0;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus[cpu_count++] = cpu;
+            }
         }
     }
+    pthread_t tids[MAX_REACTORS];
+    int started = 0;
+    for (int i = 0; i < reactor_total; i++) {
+        int fd = (i == 0) ? listenfd : open_listener(port, 1);
+        if (fd == -1) {
+            break;
+        }
+        if (reactor_start(fd, cpu_count > 0 ? cpus[i % cpu_count] : -1, &tids[started]) == -1) {
+            close(fd);
+            break;
+        }
+        started++;
+    }
     
-    close(listenfd);
-    return 0;
+    if (started == 0) {
+        return 1;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    return 1;
 }
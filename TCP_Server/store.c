@@ -0,0 +1,947 @@
+#include "common.h"
+
+/*
+ * Indexes over the metadata tables in utils.c (growable tables, table.c). Every index is guarded by the
+ * mutex of the table it points into (account_mutex, group_mutex,
+ * request_mutex, invite_mutex), so all store_* calls expect the caller to
+ * hold that mutex. When two are needed, take group_mutex before account_mutex.
+ *
+ * The exceptions are the read paths every file command takes: the group view
+ * (store_group_name, store_group_leader_is) and an account's group_id are
+ * read without any lock, see the GROUP VIEW section.
+ */
+
+/* ==================== HASH INDEX ==================== */
+
+#define HASH_MIN_SLOTS 64       /* First table size, doubled at half load */
+
+typedef struct {
+    int ref;                /* Record index + 1, 0 = empty slot */
+    unsigned hash;          /* Full hash of the record's key */
+} hash_slot_t;
+
+/* Open-addressing table (linear probing) of record indexes */
+typedef struct {
+    hash_slot_t *slots;
+    int capacity;           /* Power of two, 0 until the first insert */
+    int count;
+    unsigned (*hash_of)(int idx);               /* Hash of record idx's key */
+    int (*match)(int idx, const void *key);     /* Does record idx hold key */
+} hash_index_t;
+
+/**
+ * @function hash_str: FNV-1a hash of a string key
+ * @param s: Key
+ * @return: Hash
+ **/
+static unsigned hash_str(const char *s) {
+    unsigned h = 2166136261u;
+    while (*s) {
+        h = (h ^ (unsigned char)*s++) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @function hash_int: Hash of an integer key (Fibonacci hashing)
+ * @param v: Key
+ * @return: Hash
+ **/
+static unsigned hash_int(int v) {
+    unsigned h = (unsigned)v * 2654435769u;
+    return h ^ (h >> 16);
+}
+
+/**
+ * @function hidx_find: Look up the record holding a key
+ * @param h: Index
+ * @param hash: Hash of key
+ * @param key: Key passed to h->match
+ * @return: Record index, -1 if absent
+ **/
+static int hidx_find(hash_index_t *h, unsigned hash, const void *key) {
+    if (h->capacity == 0) {
+        return -1;
+    }
+    unsigned mask = h->capacity - 1;
+    for (unsigned i = hash & mask; h->slots[i].ref != 0; i = (i + 1) & mask) {
+        if (h->slots[i].hash == hash && h->match(h->slots[i].ref - 1, key)) {
+            return h->slots[i].ref - 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @function hidx_slot_of: Find the slot that points at a record
+ * @param h: Index
+ * @param hash: Hash of the key the slot was inserted under
+ * @param idx: Record index
+ * @return: Slot number, -1 if the record is not indexed
+ **/
+static int hidx_slot_of(hash_index_t *h, unsigned hash, int idx) {
+    if (h->capacity == 0) {
+        return -1;
+    }
+    unsigned mask = h->capacity - 1;
+    for (unsigned i = hash & mask; h->slots[i].ref != 0; i = (i + 1) & mask) {
+        if (h->slots[i].ref == idx + 1) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @function hidx_grow: Double the table and re-place every slot
+ * @param h: Index
+ * @return: 0 on success, -1 if out of memory
+ **/
+static int hidx_grow(hash_index_t *h) {
+    int capacity = h->capacity ? h->capacity * 2 : HASH_MIN_SLOTS;
+    hash_slot_t *slots = calloc(capacity, sizeof(hash_slot_t));
+    if (slots == NULL) {
+        return -1;
+    }
+
+    unsigned mask = capacity - 1;
+    for (int i = 0; i < h->capacity; i++) {
+        if (h->slots[i].ref == 0) {
+            continue;
+        }
+        unsigned j = h->slots[i].hash & mask;
+        while (slots[j].ref != 0) {
+            j = (j + 1) & mask;
+        }
+        slots[j] = h->slots[i];
+    }
+
+    free(h->slots);
+    h->slots = slots;
+    h->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @function hidx_insert: Index a record under its current key
+ * @param h: Index
+ * @param idx: Record index (its key must not be indexed yet)
+ * @return: 0 on success, -1 if out of memory
+ **/
+static int hidx_insert(hash_index_t *h, int idx) {
+    if ((h->count + 1) * 2 > h->capacity && hidx_grow(h) == -1) {
+        return -1;
+    }
+
+    unsigned hash = h->hash_of(idx);
+    unsigned mask = h->capacity - 1;
+    unsigned i = hash & mask;
+    while (h->slots[i].ref != 0) {
+        i = (i + 1) & mask;
+    }
+    h->slots[i].ref = idx + 1;
+    h->slots[i].hash = hash;
+    h->count++;
+    return 0;
+}
+
+/**
+ * @function hidx_remove: Drop a record from the index
+ * @param h: Index
+ * @param idx: Record index, still holding the key it was inserted under
+ * @note: Backward-shift deletion, so lookups never wade through tombstones
+ **/
+static void hidx_remove(hash_index_t *h, int idx) {
+    int slot = hidx_slot_of(h, h->hash_of(idx), idx);
+    if (slot == -1) {
+        return;
+    }
+
+    unsigned mask = h->capacity - 1;
+    unsigned hole = slot;
+    unsigned j = hole;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (h->slots[j].ref == 0) {
+            break;
+        }
+        /* Slot j may fill the hole unless its home lies in (hole, j] */
+        unsigned home = h->slots[j].hash & mask;
+        int stays = hole <= j ? (home > hole && home <= j) : (home > hole || home <= j);
+        if (!stays) {
+            h->slots[hole] = h->slots[j];
+            hole = j;
+        }
+    }
+    h->slots[hole].ref = 0;
+    h->count--;
+}
+
+/**
+ * @function hidx_replace: Point the slot of one record at another with the same key
+ * @param h: Index
+ * @param old_idx: Record currently indexed
+ * @param new_idx: Record that now holds the same key
+ **/
+static void hidx_replace(hash_index_t *h, int old_idx, int new_idx) {
+    int slot = hidx_slot_of(h, h->hash_of(new_idx), old_idx);
+    if (slot != -1) {
+        h->slots[slot].ref = new_idx + 1;
+    }
+}
+
+/**
+ * @function hidx_clear: Empty an index, keeping its table
+ * @param h: Index
+ **/
+static void hidx_clear(hash_index_t *h) {
+    if (h->capacity > 0) {
+        memset(h->slots, 0, h->capacity * sizeof(hash_slot_t));
+    }
+    h->count = 0;
+}
+
+/* ==================== GROUP CHAINS ==================== */
+
+/*
+ * Records of one table that share a group_id form a doubly linked chain in
+ * insertion order. The head of each chain is found through a hash index on
+ * group_id; prev of the head points at the tail so appends are O(1).
+ */
+typedef struct {
+    table_t next;           /* ints parallel to the table, -1 ends the chain */
+    table_t prev;
+    int (*group_of)(int idx);
+    hash_index_t heads;
+} chain_index_t;
+
+#define NEXT(c, idx) TABLE_AT((c)->next, int, idx)
+#define PREV(c, idx) TABLE_AT((c)->prev, int, idx)
+
+/**
+ * @function chain_init: Set the key functions of a chain index
+ * @param c: Chain index, zero-initialised
+ * @param group_of: Group ID of a record
+ * @param hash_of: Hash of a record's group ID
+ * @param match: Does a record hold a group ID
+ * @note: The indexes embed table_t directories; left without initialisers
+ *        they stay in .bss instead of adding megabytes to .data
+ **/
+static void chain_init(chain_index_t *c, int (*group_of)(int idx), unsigned (*hash_of)(int idx),
+                       int (*match)(int idx, const void *key)) {
+    c->group_of = group_of;
+    c->heads.hash_of = hash_of;
+    c->heads.match = match;
+}
+
+/**
+ * @function chain_head: First record of a group's chain
+ * @param c: Chain index
+ * @param group_id: Group ID
+ * @return: Record index, -1 if the chain is empty
+ **/
+static int chain_head(chain_index_t *c, int group_id) {
+    return hidx_find(&c->heads, hash_int(group_id), &group_id);
+}
+
+/**
+ * @function chain_link: Append a record to the chain of its group
+ * @param c: Chain index
+ * @param idx: Record index
+ * @return: 0 on success, -1 if out of memory
+ **/
+static int chain_link(chain_index_t *c, int idx) {
+    if (table_reserve(&c->next, sizeof(int), idx + 1) == -1 ||
+        table_reserve(&c->prev, sizeof(int), idx + 1) == -1) {
+        return -1;
+    }
+    int head = chain_head(c, c->group_of(idx));
+    NEXT(c, idx) = -1;
+    if (head == -1) {
+        PREV(c, idx) = idx;
+        return hidx_insert(&c->heads, idx);
+    }
+    int tail = PREV(c, head);
+    NEXT(c, tail) = idx;
+    PREV(c, idx) = tail;
+    PREV(c, head) = idx;
+    return 0;
+}
+
+/**
+ * @function chain_unlink: Take a record out of the chain of its group
+ * @param c: Chain index
+ * @param idx: Record index, still holding its group_id
+ **/
+static void chain_unlink(chain_index_t *c, int idx) {
+    int head = chain_head(c, c->group_of(idx));
+    int next = NEXT(c, idx);
+
+    if (idx == head) {
+        if (next == -1) {
+            hidx_remove(&c->heads, idx);
+        } else {
+            PREV(c, next) = PREV(c, idx);
+            hidx_replace(&c->heads, idx, next);
+        }
+        return;
+    }
+
+    int prev = PREV(c, idx);
+    NEXT(c, prev) = next;
+    if (next != -1) {
+        PREV(c, next) = prev;
+    } else {
+        PREV(c, head) = prev;   /* idx was the tail */
+    }
+}
+
+/**
+ * @function chain_move: Follow a record that was copied to another slot
+ * @param c: Chain index
+ * @param from: Old record index (still linked)
+ * @param to: New record index, already holding a copy of the record
+ **/
+static void chain_move(chain_index_t *c, int from, int to) {
+    int head = chain_head(c, c->group_of(to));
+    int next = NEXT(c, from);
+
+    if (from == head) {
+        hidx_replace(&c->heads, from, to);
+        PREV(c, to) = PREV(c, from) == from ? to : PREV(c, from);
+        head = to;
+    } else {
+        PREV(c, to) = PREV(c, from);
+        NEXT(c, PREV(c, from)) = to;
+    }
+
+    NEXT(c, to) = next;
+    if (next != -1) {
+        PREV(c, next) = to;
+    } else if (head != to) {
+        PREV(c, head) = to;     /* from was the tail */
+    }
+}
+
+/* ==================== GROUP VIEW ==================== */
+
+/*
+ * A copy of the groups table for readers that take no lock. Each group is an
+ * immutable record; the table of record pointers is open-addressed on
+ * group_id. Writers (holding group_mutex) publish a record with one atomic
+ * store into a free slot, delete by storing GROUP_TOMBSTONE, and build a
+ * bigger table when tombstones and records fill half of it. Deleted records
+ * and replaced tables are freed through rcu_retire.
+ */
+#define GROUP_TOMBSTONE ((group_t *)1)
+
+typedef struct {
+    int capacity;           /* Power of two */
+    int used;               /* Records plus tombstones */
+    int live;               /* Records */
+    group_t *slots[];
+} group_view_t;
+
+static group_view_t *group_view = NULL;
+
+/**
+ * @function view_alloc: Build a table holding the live records of another
+ * @param old: Current table, NULL for none
+ * @param live: Records that will be in it (sizes the table)
+ * @return: New table, NULL if out of memory
+ **/
+static group_view_t *view_alloc(group_view_t *old, int live) {
+    int capacity = HASH_MIN_SLOTS;
+    while (capacity < live * 4) {
+        capacity *= 2;
+    }
+    group_view_t *v = calloc(1, sizeof(group_view_t) + capacity * sizeof(group_t *));
+    if (v == NULL) {
+        return NULL;
+    }
+    v->capacity = capacity;
+
+    unsigned mask = capacity - 1;
+    for (int i = 0; old != NULL && i < old->capacity; i++) {
+        group_t *g = old->slots[i];
+        if (g == NULL || g == GROUP_TOMBSTONE) {
+            continue;
+        }
+        unsigned j = hash_int(g->group_id) & mask;
+        while (v->slots[j] != NULL) {
+            j = (j + 1) & mask;
+        }
+        v->slots[j] = g;
+        v->used++;
+        v->live++;
+    }
+    return v;
+}
+
+/**
+ * @function view_insert: Publish a group to lock-free readers (group_mutex)
+ * @param group: Group to copy (its ID is not in the view yet)
+ * @return: 0 on success, -1 if out of memory
+ **/
+static int view_insert(const group_t *group) {
+    group_view_t *v = group_view;
+    if (v == NULL || (v->used + 1) * 2 > v->capacity) {
+        group_view_t *bigger = view_alloc(v, v ? v->live + 1 : 1);
+        if (bigger == NULL) {
+            return -1;
+        }
+        __atomic_store_n(&group_view, bigger, __ATOMIC_SEQ_CST);
+        if (v != NULL) {
+            rcu_retire(v, free);
+        }
+        v = bigger;
+    }
+
+    group_t *g = malloc(sizeof(group_t));
+    if (g == NULL) {
+        return -1;
+    }
+    *g = *group;
+
+    unsigned mask = v->capacity - 1;
+    unsigned i = hash_int(g->group_id) & mask;
+    while (v->slots[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    __atomic_store_n(&v->slots[i], g, __ATOMIC_RELEASE);
+    v->used++;
+    v->live++;
+    return 0;
+}
+
+/**
+ * @function view_remove: Withdraw a group from lock-free readers (group_mutex)
+ * @param group_id: Group ID
+ **/
+static void view_remove(int group_id) {
+    group_view_t *v = group_view;
+    if (v == NULL) {
+        return;
+    }
+    unsigned mask = v->capacity - 1;
+    for (unsigned i = hash_int(group_id) & mask; v->slots[i] != NULL; i = (i + 1) & mask) {
+        group_t *g = v->slots[i];
+        if (g != GROUP_TOMBSTONE && g->group_id == group_id) {
+            __atomic_store_n(&v->slots[i], GROUP_TOMBSTONE, __ATOMIC_RELEASE);
+            v->live--;
+            rcu_retire(g, free);
+            return;
+        }
+    }
+}
+
+/**
+ * @function view_find: Find a group in the view
+ * @param group_id: Group ID
+ * @return: Immutable record, NULL if no such group
+ * @note: Caller is inside rcu_read_lock and copies what it needs before leaving
+ **/
+static const group_t *view_find(int group_id) {
+    group_view_t *v = __atomic_load_n(&group_view, __ATOMIC_SEQ_CST);
+    if (v == NULL) {
+        return NULL;
+    }
+    unsigned mask = v->capacity - 1;
+    for (unsigned i = hash_int(group_id) & mask; ; i = (i + 1) & mask) {
+        group_t *g = __atomic_load_n(&v->slots[i], __ATOMIC_ACQUIRE);
+        if (g == NULL) {
+            return NULL;
+        }
+        if (g != GROUP_TOMBSTONE && g->group_id == group_id) {
+            return g;
+        }
+    }
+}
+
+/**
+ * @function store_group_name: Copy a group's name without taking a lock
+ * @param group_id: Group ID
+ * @param name: Buffer of MAX_GROUPNAME bytes
+ * @return: 0 on success, -1 if no such group (name is then "")
+ **/
+int store_group_name(int group_id, char *name) {
+    rcu_read_lock();
+    const group_t *g = view_find(group_id);
+    if (g != NULL) {
+        memcpy(name, g->group_name, MAX_GROUPNAME);
+    } else {
+        name[0] = '\0';
+    }
+    rcu_read_unlock();
+    return g != NULL ? 0 : -1;
+}
+
+/**
+ * @function store_group_leader_is: Check a group's leader without taking a lock
+ * @param group_id: Group ID
+ * @param username: Username
+ * @return: 1 if username leads the group, 0 otherwise
+ **/
+int store_group_leader_is(int group_id, const char *username) {
+    rcu_read_lock();
+    const group_t *g = view_find(group_id);
+    int is_leader = g != NULL && strcmp(g->leader, username) == 0;
+    rcu_read_unlock();
+    return is_leader;
+}
+
+/* ==================== INDEXES ==================== */
+
+static unsigned account_name_hash(int idx) { return hash_str(ACCOUNT(idx).username); }
+static int account_name_match(int idx, const void *key) { return strcmp(ACCOUNT(idx).username, key) == 0; }
+static unsigned account_group_hash(int idx) { return hash_int(ACCOUNT(idx).group_id); }
+static int account_group_match(int idx, const void *key) { return ACCOUNT(idx).group_id == *(const int *)key; }
+static int account_group(int idx) { return ACCOUNT(idx).group_id; }
+
+static unsigned group_id_hash(int idx) { return hash_int(GROUP(idx).group_id); }
+static int group_id_match(int idx, const void *key) { return GROUP(idx).group_id == *(const int *)key; }
+static unsigned group_name_hash(int idx) { return hash_str(GROUP(idx).group_name); }
+static int group_name_match(int idx, const void *key) { return strcmp(GROUP(idx).group_name, key) == 0; }
+
+static unsigned request_group_hash(int idx) { return hash_int(REQUEST(idx).group_id); }
+static int request_group_match(int idx, const void *key) { return REQUEST(idx).group_id == *(const int *)key; }
+static int request_group(int idx) { return REQUEST(idx).group_id; }
+
+static unsigned invite_group_hash(int idx) { return hash_int(INVITE(idx).group_id); }
+static int invite_group_match(int idx, const void *key) { return INVITE(idx).group_id == *(const int *)key; }
+static int invite_group(int idx) { return INVITE(idx).group_id; }
+
+/* account_mutex */
+static hash_index_t account_by_name = { NULL, 0, 0, account_name_hash, account_name_match };
+static chain_index_t members;          /* Key functions set by store_build_indexes */
+
+/* Bumped whenever an account's group changes; sessions poll it without a lock */
+static table_t membership_version;     /* unsigned, parallel to accounts */
+#define VERSION(idx) TABLE_AT(membership_version, unsigned, idx)
+
+/* group_mutex */
+static hash_index_t group_by_id = { NULL, 0, 0, group_id_hash, group_id_match };
+static hash_index_t group_by_name = { NULL, 0, 0, group_name_hash, group_name_match };
+static int next_group_id = 1;
+
+/* request_mutex */
+static chain_index_t request_chains;
+
+/* invite_mutex */
+static chain_index_t invite_chains;
+
+/**
+ * @function store_build_indexes: Index the tables filled by load_*
+ * @return: 0 on success, -1 if out of memory
+ * @note: Called once at startup, before any client is accepted
+ **/
+int store_build_indexes() {
+    chain_init(&members, account_group, account_group_hash, account_group_match);
+    chain_init(&request_chains, request_group, request_group_hash, request_group_match);
+    chain_init(&invite_chains, invite_group, invite_group_hash, invite_group_match);
+
+    hidx_clear(&account_by_name);
+    hidx_clear(&members.heads);
+    if (table_reserve(&membership_version, sizeof(unsigned), account_count) == -1) {
+        return -1;
+    }
+    for (int i = 0; i < account_count; i++) {
+        if (hidx_insert(&account_by_name, i) == -1) {
+            return -1;
+        }
+        if (ACCOUNT(i).group_id != -1 && chain_link(&members, i) == -1) {
+            return -1;
+        }
+    }
+
+    hidx_clear(&group_by_id);
+    hidx_clear(&group_by_name);
+    next_group_id = 1;
+    for (int i = 0; i < group_count; i++) {
+        if (hidx_insert(&group_by_id, i) == -1 || hidx_insert(&group_by_name, i) == -1 ||
+            view_insert(&GROUP(i)) == -1) {
+            return -1;
+        }
+        if (GROUP(i).group_id >= next_group_id) {
+            next_group_id = GROUP(i).group_id + 1;
+        }
+    }
+
+    hidx_clear(&request_chains.heads);
+    for (int i = 0; i < request_count; i++) {
+        if (chain_link(&request_chains, i) == -1) {
+            return -1;
+        }
+    }
+
+    hidx_clear(&invite_chains.heads);
+    for (int i = 0; i < invite_count; i++) {
+        if (chain_link(&invite_chains, i) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ==================== ACCOUNTS (account_mutex) ==================== */
+
+/**
+ * @function store_find_account: Look up an account by username
+ * @param username: Username
+ * @return: Index into accounts, -1 if no such account
+ **/
+int store_find_account(const char *username) {
+    return hidx_find(&account_by_name, hash_str(username), username);
+}
+
+/**
+ * @function store_add_account: Append a new account outside any group
+ * @param username: Username (not registered yet)
+ * @param password: Password
+ * @return: Index into accounts, -1 if out of memory
+ **/
+int store_add_account(const char *username, const char *password) {
+    int idx = account_count;
+    if (table_reserve(&accounts, sizeof(account_t), idx + 1) == -1 ||
+        table_reserve(&membership_version, sizeof(unsigned), idx + 1) == -1) {
+        return -1;
+    }
+
+    strcpy(ACCOUNT(idx).username, username);
+    strcpy(ACCOUNT(idx).password, password);
+    ACCOUNT(idx).group_id = -1;
+    ACCOUNT(idx).is_logged_in = 0;
+    if (hidx_insert(&account_by_name, idx) == -1) {
+        return -1;
+    }
+    account_count++;
+    return idx;
+}
+
+/**
+ * @function store_set_account_group: Move an account to another group
+ * @param idx: Index into accounts
+ * @param group_id: New group, -1 for none
+ * @return: 0 on success, -1 if out of memory
+ **/
+int store_set_account_group(int idx, int group_id) {
+    if (ACCOUNT(idx).group_id == group_id) {
+        return 0;
+    }
+    if (ACCOUNT(idx).group_id != -1) {
+        chain_unlink(&members, idx);
+    }
+    /* Read without account_mutex by sync_user_group_id: group_id first,
+     * then the version that tells sessions to re-read it */
+    __atomic_store_n(&ACCOUNT(idx).group_id, group_id, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&VERSION(idx), 1, __ATOMIC_RELEASE);
+    if (group_id != -1 && chain_link(&members, idx) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @function store_membership_version: Current membership version of an account
+ * @param idx: Index into accounts
+ * @return: Version; it changes whenever the account's group_id changes
+ * @note: Takes no lock
+ **/
+unsigned store_membership_version(int idx) {
+    return __atomic_load_n(&VERSION(idx), __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @function store_first_member: First account of a group, in join order
+ * @param group_id: Group ID
+ * @return: Index into accounts, -1 if the group has no members
+ **/
+int store_first_member(int group_id) {
+    return chain_head(&members, group_id);
+}
+
+/**
+ * @function store_next_member: Next account of the same group
+ * @param idx: Index returned by store_first_member/store_next_member
+ * @return: Index into accounts, -1 at the end
+ **/
+int store_next_member(int idx) {
+    return NEXT(&members, idx);
+}
+
+/* ==================== GROUPS (group_mutex) ==================== */
+
+/**
+ * @function store_find_group: Look up a group by ID
+ * @param group_id: Group ID
+ * @return: Index into groups, -1 if no such group
+ **/
+int store_find_group(int group_id) {
+    return hidx_find(&group_by_id, hash_int(group_id), &group_id);
+}
+
+/**
+ * @function store_find_group_by_name: Look up a group by name
+ * @param group_name: Group name
+ * @return: Index into groups, -1 if no such group
+ **/
+int store_find_group_by_name(const char *group_name) {
+    return hidx_find(&group_by_name, hash_str(group_name), group_name);
+}
+
+/**
+ * @function group_insert: Append a group with a given ID
+ * @param group_id: Group ID (not taken yet)
+ * @param group_name: Group name (not taken yet)
+ * @param leader: Username of the leader
+ * @return: 0 on success, -1 if out of memory
+ **/
+static int group_insert(int group_id, const char *group_name, const char *leader) {
+    int idx = group_count;
+    if (table_reserve(&groups, sizeof(group_t), idx + 1) == -1) {
+        return -1;
+    }
+
+    GROUP(idx).group_id = group_id;
+    strcpy(GROUP(idx).group_name, group_name);
+    strcpy(GROUP(idx).leader, leader);
+    if (hidx_insert(&group_by_id, idx) == -1) {
+        return -1;
+    }
+    if (hidx_insert(&group_by_name, idx) == -1) {
+        hidx_remove(&group_by_id, idx);
+        return -1;
+    }
+    if (view_insert(&GROUP(idx)) == -1) {
+        hidx_remove(&group_by_name, idx);
+        hidx_remove(&group_by_id, idx);
+        return -1;
+    }
+    group_count++;
+    if (group_id >= next_group_id) {
+        next_group_id = group_id + 1;
+    }
+    return 0;
+}
+
+/**
+ * @function store_add_group: Create a group with a fresh ID
+ * @param group_name: Group name (not taken yet)
+ * @param leader: Username of the leader
+ * @return: New group ID, -1 if out of memory
+ * @note: IDs are not handed out twice while the server runs
+ **/
+int store_add_group(const char *group_name, const char *leader) {
+    int group_id = next_group_id;
+    if (group_insert(group_id, group_name, leader) == -1) {
+        return -1;
+    }
+    return group_id;
+}
+
+/**
+ * @function store_restore_group: Re-create a group with its recorded ID
+ * @param group_id: Group ID (not taken yet)
+ * @param group_name: Group name (not taken yet)
+ * @param leader: Username of the leader
+ * @return: 0 on success, -1 if out of memory
+ **/
+int store_restore_group(int group_id, const char *group_name, const char *leader) {
+    return group_insert(group_id, group_name, leader);
+}
+
+/**
+ * @function store_remove_group: Delete a group
+ * @param group_id: Group ID
+ * @note: The last group takes the freed slot, so the order of groups changes
+ **/
+void store_remove_group(int group_id) {
+    int idx = store_find_group(group_id);
+    if (idx == -1) {
+        return;
+    }
+
+    view_remove(group_id);
+    hidx_remove(&group_by_id, idx);
+    hidx_remove(&group_by_name, idx);
+
+    int last = group_count - 1;
+    if (idx != last) {
+        GROUP(idx) = GROUP(last);
+        hidx_replace(&group_by_id, last, idx);
+        hidx_replace(&group_by_name, last, idx);
+    }
+    group_count--;
+}
+
+/* ==================== REQUESTS AND INVITES ==================== */
+
+/**
+ * @function pending_find: Find a user's entry in a group's chain
+ * @param c: Chain index
+ * @param table: requests or invites (same layout)
+ * @param username: Username
+ * @param group_id: Group ID
+ * @return: Record index, -1 if absent
+ **/
+static int pending_find(chain_index_t *c, table_t *table, const char *username, int group_id) {
+    for (int i = chain_head(c, group_id); i != -1; i = NEXT(c, i)) {
+        if (strcmp(TABLE_AT(*table, request_t, i).username, username) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @function pending_add: Append an entry to a table and its group chain
+ * @param c: Chain index
+ * @param table: requests or invites
+ * @param count: Entry count of the table
+ * @param username: Username
+ * @param group_id: Group ID
+ * @return: Record index, -1 if out of memory
+ **/
+static int pending_add(chain_index_t *c, table_t *table, int *count,
+                       const char *username, int group_id) {
+    int idx = *count;
+    if (table_reserve(table, sizeof(request_t), idx + 1) == -1) {
+        return -1;
+    }
+    strcpy(TABLE_AT(*table, request_t, idx).username, username);
+    TABLE_AT(*table, request_t, idx).group_id = group_id;
+    if (chain_link(c, idx) == -1) {
+        return -1;
+    }
+    (*count)++;
+    return idx;
+}
+
+/**
+ * @function pending_remove: Delete an entry, filling its slot with the last one
+ * @param c: Chain index
+ * @param table: requests or invites
+ * @param count: Entry count of the table
+ * @param idx: Record index
+ **/
+static void pending_remove(chain_index_t *c, table_t *table, int *count, int idx) {
+    chain_unlink(c, idx);
+    int last = *count - 1;
+    if (idx != last) {
+        TABLE_AT(*table, request_t, idx) = TABLE_AT(*table, request_t, last);
+        chain_move(c, last, idx);
+    }
+    (*count)--;
+}
+
+/**
+ * @function pending_purge: Delete every entry of a group
+ * @param c: Chain index
+ * @param table: requests or invites
+ * @param count: Entry count of the table
+ * @param group_id: Group ID
+ * @return: Number of entries deleted
+ **/
+static int pending_purge(chain_index_t *c, table_t *table, int *count, int group_id) {
+    int purged = 0;
+    int idx;
+    while ((idx = chain_head(c, group_id)) != -1) {
+        pending_remove(c, table, count, idx);
+        purged++;
+    }
+    return purged;
+}
+
+/* invite_t has the layout of request_t, so both tables share the helpers above */
+
+/**
+ * @function store_find_request: Find a user's join request to a group (request_mutex)
+ * @param username: Username
+ * @param group_id: Group ID
+ * @return: Index into requests, -1 if none
+ **/
+int store_find_request(const char *username, int group_id) {
+    return pending_find(&request_chains, &requests, username, group_id);
+}
+
+/**
+ * @function store_add_request: Record a join request (request_mutex)
+ * @param username: Username
+ * @param group_id: Group ID
+ * @return: Index into requests, -1 if out of memory
+ **/
+int store_add_request(const char *username, int group_id) {
+    return pending_add(&request_chains, &requests, &request_count, username, group_id);
+}
+
+/**
+ * @function store_remove_request: Delete a join request (request_mutex)
+ * @param idx: Index into requests
+ **/
+void store_remove_request(int idx) {
+    pending_remove(&request_chains, &requests, &request_count, idx);
+}
+
+/**
+ * @function store_purge_requests: Delete all join requests to a group (request_mutex)
+ * @param group_id: Group ID
+ * @return: Number of requests deleted
+ **/
+int store_purge_requests(int group_id) {
+    return pending_purge(&request_chains, &requests, &request_count, group_id);
+}
+
+/**
+ * @function store_first_request: Oldest join request to a group (request_mutex)
+ * @param group_id: Group ID
+ * @return: Index into requests, -1 if none
+ **/
+int store_first_request(int group_id) {
+    return chain_head(&request_chains, group_id);
+}
+
+/**
+ * @function store_next_request: Next join request to the same group (request_mutex)
+ * @param idx: Index returned by store_first_request/store_next_request
+ * @return: Index into requests, -1 at the end
+ **/
+int store_next_request(int idx) {
+    return NEXT(&request_chains, idx);
+}
+
+/**
+ * @function store_find_invite: Find a group's invite for a user (invite_mutex)
+ * @param username: Username
+ * @param group_id: Group ID
+ * @return: Index into invites, -1 if none
+ **/
+int store_find_invite(const char *username, int group_id) {
+    return pending_find(&invite_chains, &invites, username, group_id);
+}
+
+/**
+ * @function store_add_invite: Record an invite (invite_mutex)
+ * @param username: Username
+ * @param group_id: Group ID
+ * @return: Index into invites, -1 if out of memory
+ **/
+int store_add_invite(const char *username, int group_id) {
+    return pending_add(&invite_chains, &invites, &invite_count, username, group_id);
+}
+
+/**
+ * @function store_remove_invite: Delete an invite (invite_mutex)
+ * @param idx: Index into invites
+ **/
+void store_remove_invite(int idx) {
+    pending_remove(&invite_chains, &invites, &invite_count, idx);
+}
+
+/**
+ * @function store_purge_invites: Delete all invites of a group (invite_mutex)
+ * @param group_id: Group ID
+ * @return: Number of invites deleted
+ **/
+int store_purge_invites(int group_id) {
+    return pending_purge(&invite_chains, &invites, &invite_count, group_id);
+}
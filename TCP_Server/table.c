@@ -0,0 +1,75 @@
+#include "common.h"
+
+/*
+ * Growable record tables. A table is a fixed directory of TABLE_MAX_CHUNKS
+ * chunk pointers; each chunk holds TABLE_CHUNK_RECORDS records and is
+ * allocated the first time a record in its range is needed. Growing never
+ * moves or copies a record, so an index stays valid for the life of the
+ * record and threads reading a field without the table's mutex (an
+ * account's group_id, see store.c) keep reading the right memory while the
+ * table grows under them.
+ *
+ * Chunks are only freed at exit; a table that shrinks keeps its chunks for
+ * the next records.
+ */
+
+/**
+ * @function table_reserve: Make room for a number of records
+ * @param t: Table
+ * @param record_size: Size of one record
+ * @param count: Records the table must be able to hold
+ * @return: 0 on success, -1 if out of memory or past TABLE_MAX_RECORDS
+ * @note: Caller holds the table's mutex; new records are zero-filled
+ **/
+int table_reserve(table_t *t, size_t record_size, int count) {
+    if (count > TABLE_MAX_RECORDS) {
+        return -1;
+    }
+    while (t->chunks * TABLE_CHUNK_RECORDS < count) {
+        void *chunk = calloc(TABLE_CHUNK_RECORDS, record_size);
+        if (chunk == NULL) {
+            return -1;
+        }
+        /* Published before any index into it is handed out */
+        __atomic_store_n(&t->chunk[t->chunks], chunk, __ATOMIC_RELEASE);
+        t->chunks++;
+    }
+    return 0;
+}
+
+/**
+ * @function table_copy_out: Copy the first records of a table into a flat array
+ * @param t: Table
+ * @param record_size: Size of one record
+ * @param dst: Array of count records
+ * @param count: Records to copy (all reserved)
+ **/
+void table_copy_out(const table_t *t, size_t record_size, void *dst, int count) {
+    for (int c = 0; count > 0; c++) {
+        int n = count < TABLE_CHUNK_RECORDS ? count : TABLE_CHUNK_RECORDS;
+        memcpy(dst, t->chunk[c], n * record_size);
+        dst = (char *)dst + n * record_size;
+        count -= n;
+    }
+}
+
+/**
+ * @function table_copy_in: Fill the first records of a table from a flat array
+ * @param t: Table
+ * @param record_size: Size of one record
+ * @param src: Array of count records
+ * @param count: Records to copy
+ * @return: 0 on success, -1 if out of memory
+ **/
+int table_copy_in(table_t *t, size_t record_size, const void *src, int count) {
+    if (table_reserve(t, record_size, count) == -1) {
+        return -1;
+    }
+    for (int c = 0; count > 0; c++) {
+        int n = count < TABLE_CHUNK_RECORDS ? count : TABLE_CHUNK_RECORDS;
+        memcpy(t->chunk[c], src, n * record_size);
+        src = (const char *)src + n * record_size;
+        count -= n;
+    }
+    return 0;
+}
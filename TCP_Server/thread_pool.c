@@ -0,0 +1,206 @@
+#include "common.h"
+
+/* ==================== HELPERS ==================== */
+
+/**
+ * @function now_ns: Read the monotonic clock
+ * @return: Current monotonic time in nanoseconds
+ **/
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ==================== WORKER THREAD ==================== */
+
+/**
+ * @function pool_worker: Worker thread body, runs queued tasks until shutdown
+ * @param arg: Pointer to the owning thread_pool_t
+ * @return: NULL on shutdown
+ **/
+static void *pool_worker(void *arg) {
+    thread_pool_t *pool = (thread_pool_t *)arg;
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->count == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        }
+        if (pool->count == 0 && pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        task_t task = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+
+        /* Time spent queued, i.e. how long a command waited for a worker */
+        long long waited = now_ns() - task.enqueued_ns;
+        pool->wait_ns_total += waited;
+        if (waited > pool->wait_ns_max) {
+            pool->wait_ns_max = waited;
+        }
+        pool->started++;
+
+        pthread_cond_signal(&pool->not_full);
+        pthread_mutex_unlock(&pool->lock);
+
+        task.fn(task.arg);
+    }
+
+    return NULL;
+}
+
+/* ==================== POOL API ==================== */
+
+/**
+ * @function thread_pool_init: Start a fixed-size worker pool with a bounded queue
+ * @param pool: Pool to initialize
+ * @param thread_count: Number of worker threads (<= 0 means one per online core)
+ * @param queue_size: Maximum number of queued tasks before submitters block
+ * @return: 0 on success, -1 on failure
+ **/
+int thread_pool_init(thread_pool_t *pool, int thread_count, int queue_size) {
+    memset(pool, 0, sizeof(thread_pool_t));
+
+    if (thread_count <= 0) {
+        thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (thread_count <= 0) {
+            thread_count = 1;
+        }
+    }
+    if (queue_size <= 0) {
+        queue_size = POOL_QUEUE_SIZE;
+    }
+
+    pool->queue = malloc(queue_size * sizeof(task_t));
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if (pool->queue == NULL || pool->threads == NULL) {
+        free(pool->queue);
+        free(pool->threads);
+        return -1;
+    }
+    pool->capacity = queue_size;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+    pthread_cond_init(&pool->not_full, NULL);
+
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+            perror("pthread_create() error");
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    return pool->thread_count > 0 ? 0 : -1;
+}
+
+/**
+ * @function pool_enqueue: Append a task to a pool's queue
+ * @param pool: Target pool, locked by the caller, with a free slot
+ * @param fn: Function to run on a worker
+ * @param arg: Argument passed to fn
+ **/
+static void pool_enqueue(thread_pool_t *pool, task_fn_t fn, void *arg) {
+    task_t *task = &pool->queue[pool->tail];
+    task->fn = fn;
+    task->arg = arg;
+    task->enqueued_ns = now_ns();
+    pool->tail = (pool->tail + 1) % pool->capacity;
+    pool->count++;
+    pool->submitted++;
+    if (pool->count > pool->depth_max) {
+        pool->depth_max = pool->count;
+    }
+
+    pthread_cond_signal(&pool->not_empty);
+}
+
+/**
+ * @function thread_pool_submit: Queue a task, blocking while the queue is full
+ * @param pool: Target pool
+ * @param fn: Function to run on a worker
+ * @param arg: Argument passed to fn
+ * @return: 0 on success, -1 if the pool is shutting down
+ **/
+int thread_pool_submit(thread_pool_t *pool, task_fn_t fn, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->count == pool->capacity) {
+        pool->full_waits++;
+        while (pool->count == pool->capacity && !pool->shutdown) {
+            pthread_cond_wait(&pool->not_full, &pool->lock);
+        }
+    }
+    if (pool->shutdown) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    pool_enqueue(pool, fn, arg);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/**
+ * @function thread_pool_try_submit: Queue a task unless the queue is full
+ * @param pool: Target pool
+ * @param fn: Function to run on a worker
+ * @param arg: Argument passed to fn
+ * @return: 0 on success, -1 if the queue is full or the pool is shutting down
+ * @note: For the reactor threads, which must never wait on the workers
+ **/
+int thread_pool_try_submit(thread_pool_t *pool, task_fn_t fn, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->count == pool->capacity || pool->shutdown) {
+        pool->rejected++;
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    pool_enqueue(pool, fn, arg);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/**
+ * @function thread_pool_shutdown: Drain the queue and join all workers
+ * @param pool: Pool to stop
+ **/
+void thread_pool_shutdown(thread_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_cond_broadcast(&pool->not_full);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->queue);
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_cond_destroy(&pool->not_full);
+}
+
+/**
+ * @function thread_pool_print_stats: Print queue depth and wait time figures
+ * @param pool: Pool to report on
+ * @param name: Label printed in front of the figures
+ **/
+void thread_pool_print_stats(thread_pool_t *pool, const char *name) {
+    pthread_mutex_lock(&pool->lock);
+    long long avg_us = pool->started ? pool->wait_ns_total / pool->started / 1000 : 0;
+    printf("[%s] workers=%d queue=%d/%d max_depth=%d submitted=%lld "
+           "queue_full_waits=%lld rejected=%lld wait_avg=%lldus wait_max=%lldus\n",
+           name, pool->thread_count, pool->count, pool->capacity, pool->depth_max,
+           pool->submitted, pool->full_waits, pool->rejected, avg_us, pool->wait_ns_max / 1000);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,439 @@
+#include "common.h"
+#include <fcntl.h>
+#include <sys/random.h>
+
+/*
+ * Chunked upload sessions: one file sent over several connections at once.
+ *
+ *   UPLOAD_BEGIN <path> <size>             -> 143 <id>
+ *   UPLOAD_CHUNK <id> <offset> <length>    -> 144, <length> raw bytes, 145
+ *   UPLOAD_COMMIT <id>                     -> 140 [<digest>]
+ *
+ * UPLOAD_BEGIN creates a hidden "<dir>/.<name>.<id>.upload" file and allocates
+ * the full size. Every chunk is written straight to its offset with the positional
+ * receive engines (pwrite/splice/io_uring at an offset), so chunks of one
+ * upload can arrive in any order and in parallel. UPLOAD_COMMIT checks that
+ * the received chunks cover the whole file and renames it over the target,
+ * so the file appears complete or not at all.
+ *
+ * The id is 128 random bits and is the only credential UPLOAD_CHUNK needs:
+ * the extra connections do not LOGIN (an account can only be logged in
+ * once). BEGIN and COMMIT stay with the member who started the upload.
+ *
+ * Sessions live in memory only. One left idle for UPLOAD_SESSION_TIMEOUT
+ * seconds is dropped, with its file, by the next UPLOAD_BEGIN or by the
+ * upload sweeper's check every minute; the files of sessions lost with
+ * a restart are deleted when the server starts (upload_sweeper_start).
+ */
+
+#define UPLOAD_MAX_SESSIONS 64
+#define UPLOAD_SESSION_TIMEOUT 600
+#define UPLOAD_ID_LEN 32                /* Hex digits */
+
+typedef struct {
+    char id[UPLOAD_ID_LEN + 1];
+    char owner[MAX_USERNAME];           /* Account that began it; only it may commit */
+    int group_id;
+    int fd;
+    long long size;
+    char filepath[MAX_PATH];
+    char upload_path[MAX_PATH];
+    int writers;                        /* Chunks being received */
+    time_t last_used;
+    long long (*ranges)[2];             /* Received [start, end), sorted, disjoint */
+    int range_count;
+    int range_capacity;
+} upload_session_t;
+
+static upload_session_t *sessions[UPLOAD_MAX_SESSIONS];
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Statistics, protected by sessions_lock */
+static long long sessions_begun = 0;
+static long long sessions_committed = 0;
+static long long sessions_expired = 0;
+static long long chunks_received = 0;
+static long long chunk_bytes = 0;
+
+/* ==================== SESSION TABLE ==================== */
+
+/**
+ * @function session_free: Close a session and free it
+ * @param s: Session (already out of the table)
+ * @param discard: Non-zero to delete the upload file as well
+ **/
+static void session_free(upload_session_t *s, int discard) {
+    if (discard) {
+        unlink(s->upload_path);
+    }
+    close(s->fd);
+    free(s->ranges);
+    free(s);
+}
+
+/**
+ * @function session_find: Look a session up by id
+ * @param id: Upload id
+ * @return: Slot index, -1 if there is no such session
+ * @note: Caller holds sessions_lock
+ **/
+static int session_find(const char *id) {
+    for (int i = 0; i < UPLOAD_MAX_SESSIONS; i++) {
+        if (sessions[i] != NULL && strcmp(sessions[i]->id, id) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @function session_expire: Drop sessions nobody has used for a while
+ * @param now: Current time
+ * @note: Caller holds sessions_lock; sessions with a chunk in flight are kept
+ **/
+static void session_expire(time_t now) {
+    for (int i = 0; i < UPLOAD_MAX_SESSIONS; i++) {
+        upload_session_t *s = sessions[i];
+        if (s != NULL && s->writers == 0 && now - s->last_used > UPLOAD_SESSION_TIMEOUT) {
+            sessions[i] = NULL;
+            sessions_expired++;
+            session_free(s, 1);
+        }
+    }
+}
+
+/**
+ * @function session_add_range: Record a received chunk
+ * @param s: Session
+ * @param start: First byte of the chunk
+ * @param end: One past the last byte of the chunk
+ * @return: 0 on success, -1 if out of memory
+ * @note: Caller holds sessions_lock; overlapping and touching ranges merge,
+ *        so a file sent in order stays a single range
+ **/
+static int session_add_range(upload_session_t *s, long long start, long long end) {
+    int first = 0;
+    while (first < s->range_count && s->ranges[first][1] < start) {
+        first++;
+    }
+    int last = first;
+    while (last < s->range_count && s->ranges[last][0] <= end) {
+        if (s->ranges[last][0] < start) {
+            start = s->ranges[last][0];
+        }
+        if (s->ranges[last][1] > end) {
+            end = s->ranges[last][1];
+        }
+        last++;
+    }
+
+    /* Ranges first..last-1 collapse into one */
+    if (first == last) {
+        if (s->range_count == s->range_capacity) {
+            int capacity = s->range_capacity ? s->range_capacity * 2 : 16;
+            void *grown = realloc(s->ranges, capacity * sizeof(s->ranges[0]));
+            if (grown == NULL) {
+                return -1;
+            }
+            s->ranges = grown;
+            s->range_capacity = capacity;
+        }
+        memmove(&s->ranges[first + 1], &s->ranges[first],
+                (s->range_count - first) * sizeof(s->ranges[0]));
+        s->range_count++;
+    } else if (last - first > 1) {
+        memmove(&s->ranges[first + 1], &s->ranges[last],
+                (s->range_count - last) * sizeof(s->ranges[0]));
+        s->range_count -= last - first - 1;
+    }
+    s->ranges[first][0] = start;
+    s->ranges[first][1] = end;
+    return 0;
+}
+
+/**
+ * @function session_missing: First byte no chunk has covered yet
+ * @param s: Session
+ * @return: Offset of the first missing byte, -1 if the file is complete
+ * @note: Caller holds sessions_lock
+ **/
+static long long session_missing(const upload_session_t *s) {
+    if (s->range_count == 0 || s->ranges[0][0] > 0) {
+        return s->size > 0 ? 0 : -1;
+    }
+    return s->ranges[0][1] < s->size ? s->ranges[0][1] : -1;
+}
+
+/**
+ * @function upload_sessions_expire: Drop idle sessions, with their files
+ * @note: Called periodically by the upload sweeper
+ **/
+void upload_sessions_expire() {
+    pthread_mutex_lock(&sessions_lock);
+    session_expire(time(NULL));
+    pthread_mutex_unlock(&sessions_lock);
+}
+
+/* ==================== COMMAND HANDLERS ==================== */
+
+/**
+ * @function handle_upload_begin: Handle UPLOAD_BEGIN command
+ * @param state: Connection state
+ * @param command: Command string "UPLOAD_BEGIN <path> <size>"
+ * Response codes:
+ *   143 <id>: Upload session opened; send chunks with UPLOAD_CHUNK <id>
+ *   400: Not logged in
+ *   404: Not in any group
+ *   502: File write error
+ *   504: Too many uploads in progress
+ *   300: Syntax error, or path too long
+ **/
+void handle_upload_begin(conn_state_t *state, char *command) {
+    char filename[MAX_PATH];
+    long long filesize;
+
+    if (sscanf(command, "UPLOAD_BEGIN %s %lld", filename, &filesize) != 2 || filesize <= 0) {
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Syntax error");
+        return;
+    }
+
+    upload_session_t *s = calloc(1, sizeof(upload_session_t));
+    if (s == NULL) {
+        tcp_send(state->sockfd, "504");
+        write_log_detailed(state->client_addr, command, "-ERR Out of memory");
+        return;
+    }
+
+    unsigned char raw[UPLOAD_ID_LEN / 2];
+    if (getrandom(raw, sizeof(raw), 0) != sizeof(raw)) {
+        free(s);
+        tcp_send(state->sockfd, "504");
+        write_log_detailed(state->client_addr, command, "-ERR No random id");
+        return;
+    }
+    for (int i = 0; i < (int)sizeof(raw); i++) {
+        snprintf(s->id + 2 * i, 3, "%02x", raw[i]);
+    }
+
+    char group_folder[MAX_PATH];
+    get_group_folder_path(state->user_group_id, group_folder, sizeof(group_folder));
+    int n = snprintf(s->filepath, sizeof(s->filepath), "%s/%s", group_folder, filename);
+    if (n >= 0 && n < (int)sizeof(s->filepath)) {
+        const char *slash = strrchr(s->filepath, '/');
+        int dir_len = slash ? slash - s->filepath + 1 : 0;
+        n = snprintf(s->upload_path, sizeof(s->upload_path), "%.*s.%s.%s.upload",
+                     dir_len, s->filepath, s->filepath + dir_len, s->id);
+    }
+    if (n < 0 || n >= (int)sizeof(s->upload_path)) {
+        free(s);
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Path too long");
+        return;
+    }
+
+    s->fd = open(s->upload_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (s->fd == -1 || upload_preallocate(s->fd, filesize, 0) == -1) {
+        if (s->fd != -1) {
+            close(s->fd);
+            unlink(s->upload_path);
+        }
+        free(s);
+        tcp_send(state->sockfd, "502");
+        write_log_detailed(state->client_addr, command, "-ERR File write error");
+        return;
+    }
+    snprintf(s->owner, sizeof(s->owner), "%s", state->logged_user);
+    s->group_id = state->user_group_id;
+    s->size = filesize;
+    s->last_used = time(NULL);
+
+    pthread_mutex_lock(&sessions_lock);
+    session_expire(s->last_used);
+    int slot = 0;
+    while (slot < UPLOAD_MAX_SESSIONS && sessions[slot] != NULL) {
+        slot++;
+    }
+    if (slot < UPLOAD_MAX_SESSIONS) {
+        sessions[slot] = s;
+        sessions_begun++;
+    }
+    pthread_mutex_unlock(&sessions_lock);
+
+    if (slot == UPLOAD_MAX_SESSIONS) {
+        session_free(s, 1);
+        tcp_send(state->sockfd, "504");
+        write_log_detailed(state->client_addr, command, "-ERR Too many uploads in progress");
+        return;
+    }
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "143 %s", s->id);
+    tcp_send(state->sockfd, msg);
+    write_log_detailed(state->client_addr, command, "+OK Upload session opened");
+}
+
+/**
+ * @function handle_upload_chunk: Handle UPLOAD_CHUNK command
+ * @param state: Connection state
+ * @param command: Command string "UPLOAD_CHUNK <id> <offset> <length>"
+ * Response codes:
+ *   144: Ready to receive <length> bytes
+ *   145: Chunk stored
+ *   500: No such upload session
+ *   502: File write error
+ *   300: Syntax error, or chunk outside the file
+ * @note: Needs no LOGIN; the upload id stands for the member who opened it
+ **/
+void handle_upload_chunk(conn_state_t *state, char *command) {
+    char id[UPLOAD_ID_LEN + 2];
+    long long offset, length;
+
+    if (sscanf(command, "UPLOAD_CHUNK %33s %lld %lld", id, &offset, &length) != 3 ||
+        offset < 0 || length <= 0) {
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Syntax error");
+        return;
+    }
+
+    pthread_mutex_lock(&sessions_lock);
+    int slot = session_find(id);
+    upload_session_t *s = slot == -1 ? NULL : sessions[slot];
+    int fits = s != NULL && length <= s->size - offset;
+    if (fits) {
+        /* Keeps the session (and its fd) alive until the chunk is in */
+        s->writers++;
+        s->last_used = time(NULL);
+    }
+    pthread_mutex_unlock(&sessions_lock);
+
+    if (s == NULL) {
+        tcp_send(state->sockfd, "500");
+        write_log_detailed(state->client_addr, command, "-ERR No such upload session");
+        return;
+    }
+    if (!fits) {
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Chunk outside the file");
+        return;
+    }
+
+    tcp_send(state->sockfd, "144");
+    int ret = receive_file_content(state->sockfd, state, s->fd, offset, offset + length, NULL);
+
+    pthread_mutex_lock(&sessions_lock);
+    if (ret == 0) {
+        ret = session_add_range(s, offset, offset + length);
+        chunks_received++;
+        chunk_bytes += length;
+    }
+    s->writers--;
+    s->last_used = time(NULL);
+    pthread_mutex_unlock(&sessions_lock);
+
+    if (ret == 0) {
+        tcp_send(state->sockfd, "145");
+        write_log_detailed(state->client_addr, command, "+OK Chunk stored");
+    } else if (ret == -1) {
+        tcp_send(state->sockfd, "502");
+        write_log_detailed(state->client_addr, command, "-ERR File write error");
+    } else {
+        write_log_detailed(state->client_addr, command, "-ERR Connection lost");
+    }
+}
+
+/**
+ * @function handle_upload_commit: Handle UPLOAD_COMMIT command
+ * @param state: Connection state
+ * @param command: Command string "UPLOAD_COMMIT <id>"
+ * Response codes:
+ *   140 [<digest>]: Upload successful, the file is published (digest unless -H none)
+ *   505 <offset>: Incomplete, <offset> is the first byte not received yet
+ *                 (<size> if all arrived but a chunk is still in flight);
+ *                 the session stays open
+ *   400: Not logged in
+ *   404: Not in any group
+ *   500: No such upload session, or it was begun by another account
+ *   502: File write error
+ *   300: Syntax error
+ **/
+void handle_upload_commit(conn_state_t *state, char *command) {
+    char id[UPLOAD_ID_LEN + 2];
+
+    if (sscanf(command, "UPLOAD_COMMIT %33s", id) != 1) {
+        tcp_send(state->sockfd, "300");
+        write_log_detailed(state->client_addr, command, "-ERR Syntax error");
+        return;
+    }
+
+    pthread_mutex_lock(&sessions_lock);
+    int slot = session_find(id);
+    upload_session_t *s = NULL;
+    long long missing = 0;
+    if (slot != -1 && sessions[slot]->group_id == state->user_group_id &&
+        strcmp(sessions[slot]->owner, state->logged_user) == 0) {
+        s = sessions[slot];
+        missing = session_missing(s);
+        if (missing == -1 && s->writers > 0) {
+            missing = s->size;
+        }
+        if (missing == -1) {
+            sessions[slot] = NULL;
+            sessions_committed++;
+        }
+    }
+    pthread_mutex_unlock(&sessions_lock);
+
+    if (s == NULL) {
+        tcp_send(state->sockfd, "500");
+        write_log_detailed(state->client_addr, command, "-ERR No such upload session");
+        return;
+    }
+    if (missing != -1) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "505 %lld", missing);
+        tcp_send(state->sockfd, msg);
+        write_log_detailed(state->client_addr, command, "-ERR Upload incomplete");
+        return;
+    }
+
+    /* Out of the table: no chunk can touch the file any more. Chunks came in
+     * any order, so the digest is taken over the finished file */
+    digest_t digest;
+    char digest_text[DIGEST_TEXT_SIZE];
+    digest_init(&digest, digest_algo);
+    int ret = digest_file(s->fd, 0, s->size, &digest);
+    if (ret == 0) {
+        digest_final(&digest, digest_text, sizeof(digest_text));
+        digest_store(s->fd, digest_text);
+        ret = upload_publish(s->fd, s->upload_path, s->filepath, digest_text);
+    }
+    if (ret == -1) {
+        perror("Publishing upload failed");
+        session_free(s, 1);
+        tcp_send(state->sockfd, "502");
+        write_log_detailed(state->client_addr, command, "-ERR File write error");
+        return;
+    }
+
+    tcp_send_digest(state->sockfd, "140", digest_text);
+    write_log_detailed(state->client_addr, command, "+OK Successful upload");
+    TRACE(TRACE_INFO, "Upload complete: %s by %s (%lld bytes, chunked) %s\n",
+          s->filepath, state->logged_user, s->size, digest_text);
+    session_free(s, 0);
+}
+
+/**
+ * @function upload_print_stats: Print chunked upload session counters
+ **/
+void upload_print_stats() {
+    pthread_mutex_lock(&sessions_lock);
+    int open_sessions = 0;
+    for (int i = 0; i < UPLOAD_MAX_SESSIONS; i++) {
+        open_sessions += sessions[i] != NULL;
+    }
+    printf("[upload] sessions open=%d begun=%lld committed=%lld expired=%lld chunks=%lld chunk_bytes=%lld\n",
+           open_sessions, sessions_begun, sessions_committed, sessions_expired,
+           chunks_received, chunk_bytes);
+    pthread_mutex_unlock(&sessions_lock);
+}
@@ -0,0 +1,403 @@
+#include "common.h"
+
+#ifdef USE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define URING_DEPTH 8                   /* Buffers in flight per batch */
+#define URING_BUF_SIZE (128 * 1024)     /* Size of each registered buffer */
+
+/* One submission/completion ring with its registered buffers */
+typedef struct {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    char *bufs;                         /* URING_DEPTH * URING_BUF_SIZE bytes */
+} uring_t;
+
+/* Rings are per worker thread and live as long as the worker */
+static __thread uring_t *thread_ring = NULL;
+static __thread int thread_ring_failed = 0;
+
+/* ==================== RING SETUP ==================== */
+
+/**
+ * @function uring_create: Set up a ring and register its transfer buffers
+ * @return: New ring, NULL if io_uring is not usable
+ **/
+static uring_t *uring_create() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = (int)syscall(__NR_io_uring_setup, URING_DEPTH * 2, &p);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && cq_len > sq_len) {
+        sq_len = cq_len;
+    }
+
+    char *sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    char *cq = sq;
+    if (!single_mmap) {
+        cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            munmap(sq, sq_len);
+            close(fd);
+            return NULL;
+        }
+    }
+    size_t sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+
+    uring_t *ring = calloc(1, sizeof(uring_t));
+    char *bufs = aligned_alloc(4096, URING_DEPTH * URING_BUF_SIZE);
+    if (sqes == MAP_FAILED || ring == NULL || bufs == NULL) {
+        goto fail;
+    }
+
+    /* Registered once, so the kernel does not pin pages on every read/write */
+    struct iovec iov[URING_DEPTH];
+    for (int i = 0; i < URING_DEPTH; i++) {
+        iov[i].iov_base = bufs + i * URING_BUF_SIZE;
+        iov[i].iov_len = URING_BUF_SIZE;
+    }
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, URING_DEPTH) == -1) {
+        goto fail;
+    }
+
+    ring->fd = fd;
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->sqes = sqes;
+    ring->bufs = bufs;
+    return ring;
+
+fail:
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqes_len);
+    }
+    if (!single_mmap) {
+        munmap(cq, cq_len);
+    }
+    munmap(sq, sq_len);
+    close(fd);
+    free(ring);
+    free(bufs);
+    return NULL;
+}
+
+/**
+ * @function uring_get: Get the calling thread's ring, creating it on first use
+ * @return: Ring, NULL if io_uring is not usable on this thread
+ **/
+static uring_t *uring_get() {
+    if (thread_ring == NULL && !thread_ring_failed) {
+        thread_ring = uring_create();
+        thread_ring_failed = (thread_ring == NULL);
+    }
+    return thread_ring;
+}
+
+/* ==================== SUBMISSION ==================== */
+
+/**
+ * @function uring_prep: Queue one operation on buffer slot index
+ * @param ring: Ring
+ * @param op: IORING_OP_* opcode
+ * @param fd: File or socket descriptor
+ * @param index: Buffer slot, also used as user_data to match the completion
+ * @param len: Bytes to transfer
+ * @param offset: File offset (ignored for sockets)
+ * @param link: Non-zero to run the next queued operation only after this one
+ **/
+static void uring_prep(uring_t *ring, int op, int fd, int index, unsigned len,
+                       long long offset, int link) {
+    unsigned tail = *ring->sq_tail;
+    unsigned slot = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[slot];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)(ring->bufs + index * URING_BUF_SIZE);
+    sqe->len = len;
+    sqe->user_data = index;
+    if (op == IORING_OP_READ_FIXED || op == IORING_OP_WRITE_FIXED) {
+        sqe->off = offset;
+        sqe->buf_index = index;
+    } else {
+        /* Full buffer or failure, so a short transfer breaks the link chain */
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    }
+    if (link) {
+        sqe->flags = IOSQE_IO_LINK;
+    }
+
+    ring->sq_array[slot] = slot;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @function uring_run: Submit queued operations and wait for all of them
+ * @param ring: Ring
+ * @param count: Number of operations queued since the last run
+ * @param res: Receives the result of each operation, indexed by buffer slot
+ * @param syscalls: Incremented for every io_uring_enter
+ * @return: 0 on success, -1 if the ring failed
+ **/
+static int uring_run(uring_t *ring, unsigned count, int *res, long long *syscalls) {
+    unsigned to_submit = count;
+
+    while (1) {
+        unsigned ready = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - *ring->cq_head;
+        if (to_submit == 0 && ready >= count) {
+            break;
+        }
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, to_submit,
+                               ready >= count ? 0 : count - ready,
+                               IORING_ENTER_GETEVENTS, NULL, 0);
+        (*syscalls)++;
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        to_submit -= (unsigned)ret;
+    }
+
+    unsigned head = *ring->cq_head;
+    for (unsigned i = 0; i < count; i++, head++) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        res[cqe->user_data] = cqe->res;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @function uring_batch: Split the next part of a transfer over the buffer slots
+ * @param remaining: Bytes left to transfer
+ * @param lens: Receives the length of each slot
+ * @return: Number of slots used
+ **/
+static unsigned uring_batch(long long remaining, unsigned *lens) {
+    unsigned n = 0;
+    while (n < URING_DEPTH && remaining > 0) {
+        lens[n] = remaining < URING_BUF_SIZE ? (unsigned)remaining : URING_BUF_SIZE;
+        remaining -= lens[n];
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @function uring_retryable: Whether a failed socket op can be finished by the blocking path
+ * @param res: Completion result
+ * @return: 1 for short transfers, EAGAIN, EINTR and ops cancelled by a broken link
+ **/
+static int uring_retryable(int res) {
+    return res > 0 || res == -EAGAIN || res == -EINTR || res == -ECANCELED;
+}
+
+/* ==================== TRANSFER ENGINE ==================== */
+
+/**
+ * @function uring_available: Probe whether the kernel allows io_uring
+ * @return: 1 if the io_uring engine can be used, 0 otherwise
+ **/
+int uring_available() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    int fd = (int)syscall(__NR_io_uring_setup, 1, &p);
+    if (fd == -1) {
+        return 0;   /* ENOSYS, or disabled by sysctl/seccomp */
+    }
+    close(fd);
+    return 1;
+}
+
+/**
+ * @function uring_send_file: Send a file range to a socket through io_uring
+ * @param sockfd: Socket descriptor
+ * @param fd: File descriptor (locked by the caller)
+ * @param offset: First byte to send
+ * @param length: Number of bytes to send
+ * @param digest: Updated with every byte sent (NULL: no hashing)
+ * @param syscalls: Incremented for every syscall issued
+ * @return: 0 on success, -1 on file error, -2 on connection error,
+ *          TRANSFER_UNSUPPORTED if no ring could be set up
+ * @note: Each round reads up to URING_DEPTH buffers with one io_uring_enter,
+ *        then sends them with one more as a linked chain so the stream stays
+ *        ordered. A chain cut short (full socket buffer) is finished with send_all.
+ **/
+int uring_send_file(int sockfd, int fd, long long offset, long long length, digest_t *digest,
+                    long long *syscalls) {
+    uring_t *ring = uring_get();
+    unsigned lens[URING_DEPTH];
+    int res[URING_DEPTH];
+
+    if (ring == NULL) {
+        return TRANSFER_UNSUPPORTED;
+    }
+
+    while (length > 0) {
+        unsigned n = uring_batch(length, lens);
+        long long pos = offset;
+
+        for (unsigned i = 0; i < n; i++) {
+            uring_prep(ring, IORING_OP_READ_FIXED, fd, i, lens[i], pos, 0);
+            pos += lens[i];
+        }
+        if (uring_run(ring, n, res, syscalls) == -1) {
+            return -1;
+        }
+        for (unsigned i = 0; i < n; i++) {
+            if (res[i] != (int)lens[i]) {
+                return -1;  /* Read error or file shrank under us */
+            }
+            digest_update(digest, ring->bufs + i * URING_BUF_SIZE, lens[i]);
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+            uring_prep(ring, IORING_OP_SEND, sockfd, i, lens[i], 0, i + 1 < n);
+        }
+        if (uring_run(ring, n, res, syscalls) == -1) {
+            return -2;
+        }
+        for (unsigned i = 0; i < n; i++) {
+            if (res[i] == (int)lens[i]) {
+                continue;
+            }
+            if (!uring_retryable(res[i])) {
+                return -2;
+            }
+            int done = res[i] > 0 ? res[i] : 0;
+            (*syscalls)++;
+            if (send_all(sockfd, ring->bufs + i * URING_BUF_SIZE + done, lens[i] - done) == -1) {
+                return -2;
+            }
+        }
+
+        length -= pos - offset;
+        offset = pos;
+    }
+
+    return 0;
+}
+
+/**
+ * @function uring_receive_file: Receive bytes from a socket into a file through io_uring
+ * @param sockfd: Socket descriptor
+ * @param fd: File descriptor (locked by the caller)
+ * @param offset: File offset of the first received byte
+ * @param length: Number of bytes to receive
+ * @param digest: Updated with every byte received (NULL: no hashing)
+ * @param syscalls: Incremented for every syscall issued
+ * @return: 0 on success, -1 on file error, -2 on connection error,
+ *          TRANSFER_UNSUPPORTED if no ring could be set up
+ **/
+int uring_receive_file(int sockfd, int fd, long long offset, long long length, digest_t *digest,
+                       long long *syscalls) {
+    uring_t *ring = uring_get();
+    unsigned lens[URING_DEPTH];
+    int res[URING_DEPTH];
+
+    if (ring == NULL) {
+        return TRANSFER_UNSUPPORTED;
+    }
+
+    while (length > 0) {
+        unsigned n = uring_batch(length, lens);
+
+        for (unsigned i = 0; i < n; i++) {
+            uring_prep(ring, IORING_OP_RECV, sockfd, i, lens[i], 0, i + 1 < n);
+        }
+        if (uring_run(ring, n, res, syscalls) == -1) {
+            return -2;
+        }
+        for (unsigned i = 0; i < n; i++) {
+            if (res[i] == (int)lens[i]) {
+                continue;
+            }
+            if (res[i] == 0 || !uring_retryable(res[i])) {
+                return -2;  /* Peer closed or socket error */
+            }
+            int done = res[i] > 0 ? res[i] : 0;
+            (*syscalls)++;
+            if (recv_all(sockfd, ring->bufs + i * URING_BUF_SIZE + done, lens[i] - done) == -1) {
+                return -2;
+            }
+        }
+        for (unsigned i = 0; i < n; i++) {
+            digest_update(digest, ring->bufs + i * URING_BUF_SIZE, lens[i]);
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+            uring_prep(ring, IORING_OP_WRITE_FIXED, fd, i, lens[i],
+                       offset + (long long)i * URING_BUF_SIZE, 0);
+        }
+        if (uring_run(ring, n, res, syscalls) == -1) {
+            return -1;
+        }
+        for (unsigned i = 0; i < n; i++) {
+            if (res[i] != (int)lens[i]) {
+                return -1;
+            }
+        }
+
+        for (unsigned i = 0; i < n; i++) {
+            offset += lens[i];
+            length -= lens[i];
+        }
+    }
+
+    return 0;
+}
+
+#else /* !USE_IO_URING */
+
+/* Built without io_uring: callers fall back to the blocking copy engine */
+
+int uring_available() {
+    return 0;
+}
+
+int uring_send_file(int sockfd, int fd, long long offset, long long length, digest_t *digest,
+                    long long *syscalls) {
+    return TRANSFER_UNSUPPORTED;
+}
+
+int uring_receive_file(int sockfd, int fd, long long offset, long long length, digest_t *digest,
+                       long long *syscalls) {
+    return TRANSFER_UNSUPPORTED;
+}
+
+#endif /* USE_IO_URING */
@@ -2,25 +2,25 @@
 
 /* ==================== GLOBAL VARIABLES DEFINITION ==================== */
 
-account_t accounts[MAX_ACCOUNTS];
+table_t accounts;
 int account_count = 0;
 pthread_mutex_t account_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-group_t groups[MAX_GROUPS];
+table_t groups;
 int group_count = 0;
 pthread_mutex_t group_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-request_t requests[MAX_REQUESTS];
+table_t requests;
 int request_count = 0;
 pthread_mutex_t request_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-invite_t invites[MAX_INVITES];
+table_t invites;
 int invite_count = 0;
 pthread_mutex_t invite_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 pthread_mutex_t file_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* ==================== DATA LOADING/SAVING FUNCTIONS ==================== */
+/* ==================== LEGACY TEXT IMPORT ==================== */
 
 /**
  * @function load_accounts: Load user accounts from file into memory
@@ -33,14 +33,16 @@ void load_accounts() {
         exit(1);
     }
     
+    account_t account;
     account_count = 0;
     while (fscanf(f, "%s %s %d", 
-                  accounts[account_count].username,
-                  accounts[account_count].password,
-                  &accounts[account_count].group_id) == 3) {
-        accounts[account_count].is_logged_in = 0;
+                  account.username,
+                  account.password,
+                  &account.group_id) == 3) {
+        if (table_reserve(&accounts, sizeof(account_t), account_count + 1) == -1) break;
+        account.is_logged_in = 0;
+        ACCOUNT(account_count) = account;
         account_count++;
-        if (account_count >= MAX_ACCOUNTS) break;
     }
     
     fclose(f);
@@ -62,13 +64,15 @@ void load_groups() {
         return;
     }
     
+    group_t group;
     group_count = 0;
     while (fscanf(f, "%d %s %s",
-                  &groups[group_count].group_id,
-                  groups[group_count].group_name,
-                  groups[group_count].leader) == 3) {
+                  &group.group_id,
+                  group.group_name,
+                  group.leader) == 3) {
+        if (table_reserve(&groups, sizeof(group_t), group_count + 1) == -1) break;
+        GROUP(group_count) = group;
         group_count++;
-        if (group_count >= MAX_GROUPS) break;
     }
     
     fclose(f);
@@ -90,12 +94,14 @@ void load_requests() {
         return;
     }
     
+    request_t request;
     request_count = 0;
     while (fscanf(f, "%s %d",
-                  requests[request_count].username,
-                  &requests[request_count].group_id) == 2) {
+                  request.username,
+                  &request.group_id) == 2) {
+        if (table_reserve(&requests, sizeof(request_t), request_count + 1) == -1) break;
+        REQUEST(request_count) = request;
         request_count++;
-        if (request_count >= MAX_REQUESTS) break;
     }
     
     fclose(f);
@@ -117,164 +123,20 @@ void load_invites() {
         return;
     }
     
+    invite_t invite;
     invite_count = 0;
     while (fscanf(f, "%s %d",
-                  invites[invite_count].username,
-                  &invites[invite_count].group_id) == 2) {
+                  invite.username,
+                  &invite.group_id) == 2) {
+        if (table_reserve(&invites, sizeof(invite_t), invite_count + 1) == -1) break;
+        INVITE(invite_count) = invite;
         invite_count++;
-        if (invite_count >= MAX_INVITES) break;
     }
     
     fclose(f);
     printf("Loaded %d invites\n", invite_count);
 }
 
-/**
- * @function save_accounts: Save accounts from memory to file
- * @return: None
- **/
-void save_accounts() {
-    FILE *f = fopen("data/accounts.txt", "w");
-    if (f == NULL) {
-        perror("Cannot write to accounts.txt");
-        return;
-    }
-    
-    for (int i = 0; i < account_count; i++) {
-        fprintf(f, "%s %s %d\n",
-                accounts[i].username,
-                accounts[i].password,
-                accounts[i].group_id);
-    }
-    
-    fclose(f);
-}
-
-/**
- * @function save_groups: Save groups from memory to file
- * @return: None
- **/
-void save_groups() {
-    FILE *f = fopen("data/groups.txt", "w");
-    if (f == NULL) {
-        perror("Cannot write to groups.txt");
-        return;
-    }
-    
-    for (int i = 0; i < group_count; i++) {
-        fprintf(f, "%d %s %s\n",
-                groups[i].group_id,
-                groups[i].group_name,
-                groups[i].leader);
-    }
-    
-    fclose(f);
-}
-
-/**
- * @function save_requests: Save requests from memory to file
- * @return: None
- **/
-void save_requests() {
-    FILE *f = fopen("data/requests.txt", "w");
-    if (f == NULL) {
-        perror("Cannot write to requests.txt");
-        return;
-    }
-    
-    for (int i = 0; i < request_count; i++) {
-        fprintf(f, "%s %d\n",
-                requests[i].username,
-                requests[i].group_id);
-    }
-    
-    fclose(f);
-}
-
-/**
- * @function save_invites: Save invites from memory to file
- * @return: None
- **/
-void save_invites() {
-    FILE *f = fopen("data/invites.txt", "w");
-    if (f == NULL) {
-        perror("Cannot write to invites.txt");
-        return;
-    }
-    
-    for (int i = 0; i < invite_count; i++) {
-        fprintf(f, "%s %d\n",
-                invites[i].username,
-                invites[i].group_id);
-    }
-    
-    fclose(f);
-}
-
-/**
- * @function get_log_filename: Generate log filename based on current date
- * @param filename: Buffer to store the filename
- * @param size: Size of the buffer
- **/
-void get_log_filename(char *filename, size_t size) {
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    snprintf(filename, size, "logs/log_%04d%02d%02d.txt", 
-             t->tm_year + 1900, t->tm_mon + 1, t->tm_mday);
-}
-
-/**
- * @function write_log_detailed: Write detailed log entry to daily log file
- * @param client_addr: Client address in format IP:Port
- * @param request: Request received from client
- * @param result: Result/response sent to client
- **/
-void write_log_detailed(const char *client_addr, const char *request, const char *result) {
-    /* Ensure log directory exists */
-    struct stat st = {0};
-    if (stat("logs", &st) == -1) {
-        mkdir("logs", 0755);
-    }
-    
-    /* Get current time */
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    
-    /* Get log filename */
-    char log_filename[256];
-    get_log_filename(log_filename, sizeof(log_filename));
-    
-    /* Format timestamp */
-    char timestamp[30];
-    snprintf(timestamp, sizeof(timestamp), "[%02d/%02d/%04d %02d:%02d:%02d]",
-             t->tm_mday, t->tm_mon + 1, t->tm_year + 1900,
-             t->tm_hour, t->tm_min, t->tm_sec);
-    
-    FILE *f = fopen(log_filename, "a");
-    if (f != NULL) {
-        if (request == NULL || strlen(request) == 0) {
-            fprintf(f, "%s$%s$%s\n", timestamp, client_addr, result);
-        } else {
-            fprintf(f, "%s$%s$%s\\r\\n$%s\n", timestamp, client_addr, request, result);
-        }
-        fclose(f);
-    }
-}
-
-/**
- * @function get_next_group_id: Get the next available group ID
- * @return: Next group ID
- **/
-int get_next_group_id() {
-    int max_id = 0;
-    for (int i = 0; i < group_count; i++) {
-        if (groups[i].group_id > max_id) {
-            max_id = groups[i].group_id;
-        }
-    }
-    return max_id + 1;
-}
-
 /**
  * @function get_group_folder_path: Get the folder path for a group
  * @param group_id: Group ID
@@ -283,14 +145,13 @@ int get_next_group_id() {
  * @return: Pointer to buffer
  **/
 char* get_group_folder_path(int group_id, char *buffer, int buf_size) {
-    /* Find group name */
-    for (int i = 0; i < group_count; i++) {
-        if (groups[i].group_id == group_id) {
-            snprintf(buffer, buf_size, "groups/%s", groups[i].group_name);
-            return buffer;
-        }
+    char group_name[MAX_GROUPNAME];
+    
+    if (store_group_name(group_id, group_name) == 0) {
+        snprintf(buffer, buf_size, "groups/%s", group_name);
+    } else {
+        buffer[0] = '\0';
     }
-    buffer[0] = '\0';
     return buffer;
 }
 
@@ -301,25 +162,19 @@ char* get_group_folder_path(int group_id, char *buffer, int buf_size) {
  * @return: 1 if leader, 0 otherwise
  **/
 int is_group_leader(const char *username, int group_id) {
-    for (int i = 0; i < group_count; i++) {
-        if (groups[i].group_id == group_id) {
-            return strcmp(groups[i].leader, username) == 0;
-        }
-    }
-    return 0;
+    return store_group_leader_is(group_id, username);
 }
 
 /**
  * @function count_group_members: Count number of members in a group
  * @param group_id: Group ID
  * @return: Number of members
+ * @note: Caller holds account_mutex
  **/
 int count_group_members(int group_id) {
     int count = 0;
-    for (int i = 0; i < account_count; i++) {
-        if (accounts[i].group_id == group_id) {
-            count++;
-        }
+    for (int i = store_first_member(group_id); i != -1; i = store_next_member(i)) {
+        count++;
     }
     return count;
 }
@@ -327,32 +182,35 @@ int count_group_members(int group_id) {
 /**
  * @function sync_user_group_id: Sync user's group_id from accounts to state
  * @param state: Connection state
- * @note: Called automatically by RBAC to refresh group membership
+ * @note: Called automatically by RBAC to refresh group membership. Only
+ *        re-reads the account (and the leader check) when APPROVE, ACCEPT,
+ *        KICK, LEAVE or CREATE bumped its membership version. Takes no lock
  **/
 void sync_user_group_id(conn_state_t *state) {
     if (!state->is_logged_in) {
         return;
     }
     
-    pthread_mutex_lock(&account_mutex);
-    for (int i = 0; i < account_count; i++) {
-        if (strcmp(accounts[i].username, state->logged_user) == 0) {
-            state->user_group_id = accounts[i].group_id;
-            break;
-        }
+    unsigned version = store_membership_version(state->account_idx);
+    if (version == state->membership_version) {
+        return;
     }
-    pthread_mutex_unlock(&account_mutex);
+    
+    state->membership_version = version;
+    state->user_group_id = __atomic_load_n(&ACCOUNT(state->account_idx).group_id, __ATOMIC_ACQUIRE);
+    state->is_group_leader = state->user_group_id != -1 &&
+                             is_group_leader(state->logged_user, state->user_group_id);
 }
 
 /**
- * @function role_based_access_control: Check if user has permission to execute command
- * @param command: Command string (first word only, e.g., "UPLOAD", "DOWNLOAD")
+ * @function role_based_access_control: Check that a client holds the role a command requires
+ * @param role: Role from the command table (ROLE_ANONYMOUS .. ROLE_LEADER)
  * @param state: Connection state of the client
  * @return: NULL if allowed, error code string ("400", "404", "406") if not allowed
  **/
-char* role_based_access_control(const char *command, conn_state_t *state) {
+char* role_based_access_control(int role, conn_state_t *state) {
     /* Don't require login */
-    if (strcmp(command, "LOGIN") == 0 || strcmp(command, "REGISTER") == 0) {
+    if (role == ROLE_ANONYMOUS) {
         return NULL;
     }
     
@@ -361,56 +219,21 @@ char* role_based_access_control(const char *command, conn_state_t *state) {
         return "400";
     }
     
-    /* Sync group_id from accounts to prevent stale state */
+    /* Refresh the cached group_id if the membership changed */
     sync_user_group_id(state);
     
-    /* Only require login */
-    if (strcmp(command, "JOIN") == 0 ||
-        strcmp(command, "ACCEPT") == 0 ||
-        strcmp(command, "CREATE") == 0 ||
-        strcmp(command, "LIST_GROUPS") == 0 ||
-        strcmp(command, "LOGOUT") == 0) {
+    if (role == ROLE_LOGGED_IN) {
         return NULL;
     }
     
-    /* Require login + being in a group */
-    if (strcmp(command, "UPLOAD") == 0 ||
-        strcmp(command, "DOWNLOAD") == 0 ||
-        strcmp(command, "LEAVE") == 0 ||
-        strcmp(command, "LIST_MEMBERS") == 0 ||
-        strcmp(command, "COPY_FILE") == 0 ||
-        strcmp(command, "MOVE_FILE") == 0 ||
-        strcmp(command, "MKDIR") == 0 ||
-        strcmp(command, "COPY_FOLDER") == 0 ||
-        strcmp(command, "MOVE_FOLDER") == 0 ||
-        strcmp(command, "LIST_CONTENT") == 0) {
-        
-        if (state->user_group_id == -1) {
-            return "404";
-        }
-        return NULL;
+    /* Require being in a group */
+    if (state->user_group_id == -1) {
+        return "404";
     }
     
-    /* Require login + being in a group + being group leader */
-    if (strcmp(command, "APPROVE") == 0 ||
-        strcmp(command, "INVITE") == 0 ||
-        strcmp(command, "KICK") == 0 ||
-        strcmp(command, "LIST_REQUESTS") == 0 ||
-        strcmp(command, "RENAME_FILE") == 0 ||
-        strcmp(command, "DELETE_FILE") == 0 ||
-        strcmp(command, "RENAME_FOLDER") == 0 ||
-        strcmp(command, "RMDIR") == 0) {
-        
-        if (state->user_group_id == -1) {
-            return "404";
-        }
-        if (!is_group_leader(state->logged_user, state->user_group_id)) {
-            return "406";
-        }
-        return NULL;
+    /* Require being group leader */
+    if (role == ROLE_LEADER && !state->is_group_leader) {
+        return "406";
     }
-    
-    /* Unknown command - allow (will be handled by command processor) */
     return NULL;
 }
-
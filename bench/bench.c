@@ -0,0 +1,560 @@
+#include "bench.h"
+
+/* ==================== CLOCK AND ENVIRONMENT ==================== */
+
+/**
+ * @function bench_now_ns: Read the monotonic clock
+ * @return: Current monotonic time in nanoseconds
+ **/
+long long bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @function bench_cpu_count: Count the CPUs this process may run on
+ * @return: Number of CPUs in the affinity mask (at least 1)
+ **/
+int bench_cpu_count() {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        return CPU_COUNT(&set);
+    }
+    return 1;
+}
+
+/**
+ * @function bench_raise_nofile: Lift the open file limit to its hard maximum
+ * @note: The server inherits it, so benches with many sockets need this
+ *        before bench_server_start
+ **/
+void bench_raise_nofile() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+/**
+ * @function bench_parse_list: Parse a comma separated list of non-negative numbers
+ * @param text: List such as "1,2,4"
+ * @param values: Receives the numbers
+ * @param max: Capacity of values
+ * @return: Number of values parsed, -1 on a malformed list
+ **/
+int bench_parse_list(const char *text, int *values, int max) {
+    int count = 0;
+    while (*text != '\0' && count < max) {
+        char *end;
+        long v = strtol(text, &end, 10);
+        if (end == text || v < 0 || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        values[count++] = (int)v;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+/* ==================== SERVER PROCESS ==================== */
+
+/**
+ * @function bench_server_path: Locate the server binary
+ * @param path: Receives the path
+ * @param size: Size of path
+ * @note: $FS_BENCH_SERVER, else ../TCP_Server/server next to this binary
+ **/
+static void bench_server_path(char *path, size_t size) {
+    const char *env = getenv("FS_BENCH_SERVER");
+    if (env != NULL) {
+        snprintf(path, size, "%s", env);
+        return;
+    }
+
+    char self[512];
+    ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (n <= 0) {
+        snprintf(path, size, "../TCP_Server/server");
+        return;
+    }
+    self[n] = '\0';
+    char *slash = strrchr(self, '/');
+    if (slash != NULL) {
+        *slash = '\0';
+    }
+    snprintf(path, size, "%s/../TCP_Server/server", self);
+}
+
+/**
+ * @function bench_server_init: Create a scratch directory laid out like a server's
+ * @param s: Server to set up (not started)
+ * @param name: Bench name, part of the directory name
+ * @return: 0 on success, -1 on error
+ **/
+int bench_server_init(bench_server_t *s, const char *name) {
+    static const char *files[] = { "accounts.txt", "groups.txt", "requests.txt", "invites.txt" };
+    const char *base = getenv("FS_BENCH_DIR");
+    char path[600];
+
+    memset(s, 0, sizeof(*s));
+    s->pid = -1;
+    snprintf(s->dir, sizeof(s->dir), "%s/fs_bench_%s_%d", base ? base : "/tmp", name, (int)getpid());
+    snprintf(path, sizeof(path), "%s/data", s->dir);
+    if (mkdir(s->dir, 0755) == -1 || mkdir(path, 0755) == -1) {
+        perror(s->dir);
+        return -1;
+    }
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/data/%s", s->dir, files[i]);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            perror(path);
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+/**
+ * @function bench_server_start: Run the server in its scratch directory and wait until it accepts
+ * @param s: Server set up by bench_server_init
+ * @param args: NULL-terminated server options (the port is appended)
+ * @return: 0 once a connection succeeds, -1 if the server exited or never came up
+ * @note: A random port is tried; if the server exits (port taken) another one is
+ **/
+int bench_server_start(bench_server_t *s, char *const args[]) {
+    char server[600], port_text[16], out[600];
+    char *argv[BENCH_MAX_ARGS + 3];
+    int argc = 0;
+
+    bench_server_path(server, sizeof(server));
+    snprintf(out, sizeof(out), "%s/server.out", s->dir);
+    argv[argc++] = server;
+    for (int i = 0; args != NULL && args[i] != NULL && argc < BENCH_MAX_ARGS + 1; i++) {
+        argv[argc++] = args[i];
+    }
+    argv[argc++] = port_text;
+    argv[argc] = NULL;
+
+    srand((unsigned)(getpid() ^ bench_now_ns()));
+    for (int attempt = 0; attempt < 5; attempt++) {
+        s->port = 20000 + rand() % 40000;
+        snprintf(port_text, sizeof(port_text), "%d", s->port);
+
+        s->pid = fork();
+        if (s->pid == -1) {
+            perror("fork");
+            return -1;
+        }
+        if (s->pid == 0) {
+            int fd = open(out, O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (chdir(s->dir) == -1 || fd == -1) {
+                _exit(127);
+            }
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            setenv("FS_TRACE", getenv("FS_TRACE") ? getenv("FS_TRACE") : "warn", 1);
+            execv(server, argv);
+            _exit(127);
+        }
+
+        /* Poll until it accepts; startup can take seconds on large data/ */
+        for (int waited = 0; waited < 120000; waited++) {
+            int status;
+            if (waitpid(s->pid, &status, WNOHANG) == s->pid) {
+                s->pid = -1;
+                break;
+            }
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(s->port) };
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+            close(fd);
+            if (ok) {
+                return 0;
+            }
+            usleep(1000);
+        }
+        if (s->pid != -1) {
+            bench_server_stop(s);
+            break;
+        }
+    }
+
+    fprintf(stderr, "Server %s did not start, see %s\n", server, out);
+    return -1;
+}
+
+/**
+ * @function bench_server_stop: Terminate the server and reap it
+ * @param s: Running server
+ **/
+void bench_server_stop(bench_server_t *s) {
+    if (s->pid > 0) {
+        kill(s->pid, SIGTERM);
+        waitpid(s->pid, NULL, 0);
+        s->pid = -1;
+    }
+}
+
+/**
+ * @function bench_server_cleanup: Stop the server and remove its scratch directory
+ * @param s: Server
+ * @note: $FS_BENCH_KEEP keeps the directory for inspection
+ **/
+void bench_server_cleanup(bench_server_t *s) {
+    bench_server_stop(s);
+    if (getenv("FS_BENCH_KEEP") != NULL || s->dir[0] == '\0') {
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        execlp("rm", "rm", "-rf", s->dir, (char *)NULL);
+        _exit(127);
+    }
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+    }
+}
+
+/**
+ * @function bench_server_rss_kb: Read the resident set size of the server
+ * @param s: Running server
+ * @return: VmRSS in KB, -1 if unavailable
+ **/
+long bench_server_rss_kb(const bench_server_t *s) {
+    char path[64], line[256];
+    long rss = -1;
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)s->pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "VmRSS: %ld", &rss) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return rss;
+}
+
+/**
+ * @function bench_server_cpu_ns: Read the CPU time the server has used
+ * @param s: Running server
+ * @return: User plus system time of all its threads in nanoseconds, -1 if unavailable
+ * @note: The kernel counts in clock ticks (usually 10 ms)
+ **/
+long long bench_server_cpu_ns(const bench_server_t *s) {
+    char path[64], line[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)s->pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char *end = fgets(line, sizeof(line), f) != NULL ? strrchr(line, ')') : NULL;
+    fclose(f);
+
+    /* Fields after "(comm)": state is field 3, utime 14 and stime 15 */
+    unsigned long long utime, stime;
+    if (end == NULL || sscanf(end + 2, "%*c %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu %llu",
+                              &utime, &stime) != 2) {
+        return -1;
+    }
+    return (long long)((utime + stime) * (1000000000.0 / sysconf(_SC_CLK_TCK)));
+}
+
+/**
+ * @function bench_server_engines: Read the server's transfer engine counters
+ * @param s: Running server
+ * @param engines: Receives one entry per engine
+ * @param max: Size of engines
+ * @return: Number of engines read, -1 if the report did not show up
+ * @note: Sends SIGUSR1 and parses the "[transfer <name>]" lines of the new
+ *        report in server.out; the reactor prints it within a second
+ **/
+int bench_server_engines(const bench_server_t *s, bench_engine_t *engines, int max) {
+    char path[600], line[512];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/server.out", s->dir);
+    long long start = stat(path, &st) == 0 ? st.st_size : 0;
+    kill(s->pid, SIGUSR1);
+
+    for (int waited = 0; waited < 500; waited++) {
+        usleep(10000);
+        FILE *f = fopen(path, "r");
+        if (f == NULL || fseek(f, start, SEEK_SET) == -1) {
+            if (f != NULL) {
+                fclose(f);
+            }
+            continue;
+        }
+        int count = 0, done = 0;
+        while (!done && fgets(line, sizeof(line), f) != NULL) {
+            bench_engine_t *e = &engines[count];
+            if (count < max && sscanf(line, "[transfer %15[^]]] files=%*d bytes=%lld rate=%*fMB/s syscalls=%lld",
+                                      e->name, &e->bytes, &e->syscalls) == 3) {
+                count++;
+            } else if (strcmp(line, "=======================================\n") == 0) {
+                done = 1;
+            }
+        }
+        fclose(f);
+        if (done) {
+            return count;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @function bench_engine_delta: Compare two readings of the engine counters
+ * @param before: First reading
+ * @param after: Second reading
+ * @param count: Engines in both
+ * @param syscalls: Receives the syscalls all engines issued in between
+ * @return: Index of the engine that moved the most bytes in between
+ **/
+int bench_engine_delta(const bench_engine_t *before, const bench_engine_t *after, int count,
+                       long long *syscalls) {
+    int busiest = 0;
+    long long moved = 0;
+    *syscalls = 0;
+    for (int i = 0; i < count; i++) {
+        *syscalls += after[i].syscalls - before[i].syscalls;
+        if (after[i].bytes - before[i].bytes > moved) {
+            moved = after[i].bytes - before[i].bytes;
+            busiest = i;
+        }
+    }
+    return busiest;
+}
+
+/* ==================== PROTOCOL CLIENT ==================== */
+
+/**
+ * @function bench_connect: Connect to the server and read its greeting
+ * @param c: Connection to open
+ * @param port: Server port on loopback
+ * @return: 0 on success, -1 on error
+ **/
+int bench_connect(bench_conn_t *c, int port) {
+    char greeting[128];
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    c->len = 0;
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (c->fd == -1) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        bench_line(c, greeting, sizeof(greeting)) == -1 || strncmp(greeting, "100", 3) != 0) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @function bench_send_raw: Send bytes as they are
+ * @param c: Connection
+ * @param data: Bytes to send
+ * @param length: Number of bytes
+ * @return: 0 on success, -1 on error
+ **/
+int bench_send_raw(bench_conn_t *c, const void *data, long long length) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t n = send(c->fd, p, length, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/**
+ * @function bench_send: Send one command line, "\r\n" appended
+ * @param c: Connection
+ * @param fmt: printf format of the command
+ * @return: 0 on success, -1 on error
+ **/
+int bench_send(bench_conn_t *c, const char *fmt, ...) {
+    char line[4096];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line) - 2, fmt, ap);
+    va_end(ap);
+    if (n < 0 || n >= (int)sizeof(line) - 2) {
+        return -1;
+    }
+    memcpy(line + n, "\r\n", 2);
+    return bench_send_raw(c, line, n + 2);
+}
+
+/**
+ * @function bench_line: Read one "\r\n" terminated reply
+ * @param c: Connection
+ * @param out: Receives the reply without "\r\n" (may be NULL)
+ * @param size: Size of out
+ * @return: Length of the reply, -1 on error or a reply longer than the buffer
+ **/
+int bench_line(bench_conn_t *c, char *out, int size) {
+    while (1) {
+        char *end = c->len > 1 ? memmem(c->buf, c->len, "\r\n", 2) : NULL;
+        if (end != NULL) {
+            int n = end - c->buf;
+            if (out != NULL) {
+                int copy = n < size - 1 ? n : size - 1;
+                memcpy(out, c->buf, copy);
+                out[copy] = '\0';
+            }
+            c->len -= n + 2;
+            memmove(c->buf, end + 2, c->len);
+            return n;
+        }
+        if (c->len == (int)sizeof(c->buf)) {
+            return -1;
+        }
+        ssize_t r = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        c->len += r;
+    }
+}
+
+/**
+ * @function bench_cmd: Send a command and read its reply
+ * @param c: Connection
+ * @param out: Receives the reply (may be NULL)
+ * @param size: Size of out
+ * @param fmt: printf format of the command
+ * @return: Numeric reply code, -1 on error
+ **/
+int bench_cmd(bench_conn_t *c, char *out, int size, const char *fmt, ...) {
+    char line[4096], reply[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n < 0 || n >= (int)sizeof(line) || bench_send(c, "%s", line) == -1) {
+        return -1;
+    }
+    if (out == NULL) {
+        out = reply;
+        size = sizeof(reply);
+    }
+    if (bench_line(c, out, size) == -1) {
+        return -1;
+    }
+    return atoi(out);
+}
+
+/**
+ * @function bench_recv_discard: Read raw bytes (a file body) and drop them
+ * @param c: Connection
+ * @param length: Number of bytes
+ * @return: 0 on success, -1 on error
+ **/
+int bench_recv_discard(bench_conn_t *c, long long length) {
+    /* Bytes that arrived with the last reply line come first */
+    long long held = c->len < length ? c->len : length;
+    c->len -= held;
+    memmove(c->buf, c->buf + held, c->len);
+    length -= held;
+
+    while (length > 0) {
+        ssize_t r = recv(c->fd, c->buf, length < (long long)sizeof(c->buf) ? length : (long long)sizeof(c->buf), 0);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return -1;
+        }
+        length -= r;
+    }
+    return 0;
+}
+
+#define BENCH_SEND_SIZE (1 << 20)
+
+static char bench_filler[BENCH_SEND_SIZE];
+static pthread_once_t bench_filler_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @function bench_fill: Fill the upload buffer with non-zero bytes (once)
+ **/
+static void bench_fill() {
+    for (int i = 0; i < BENCH_SEND_SIZE; i++) {
+        bench_filler[i] = (char)(i * 2654435761u >> 24);
+    }
+}
+
+/**
+ * @function bench_upload: UPLOAD a file of filler bytes
+ * @param c: Logged-in connection
+ * @param path: Path in the group folder
+ * @param size: File size
+ * @return: 0 once the server answered 140, -1 otherwise
+ **/
+int bench_upload(bench_conn_t *c, const char *path, long long size) {
+    char reply[256];
+    pthread_once(&bench_filler_once, bench_fill);
+    if (bench_cmd(c, reply, sizeof(reply), "UPLOAD %s %lld", path, size) != 141) {
+        fprintf(stderr, "UPLOAD answered %s\n", reply);
+        return -1;
+    }
+    for (long long sent = 0; sent < size; sent += BENCH_SEND_SIZE) {
+        if (bench_send_raw(c, bench_filler, size - sent < BENCH_SEND_SIZE ? size - sent : BENCH_SEND_SIZE) == -1) {
+            return -1;
+        }
+    }
+    return bench_line(c, reply, sizeof(reply)) != -1 && atoi(reply) == 140 ? 0 : -1;
+}
+
+/**
+ * @function bench_download: DOWNLOAD a whole file and drop its bytes
+ * @param c: Logged-in connection
+ * @param path: Path in the group folder
+ * @return: 0 once the server answered 150, -1 otherwise
+ **/
+int bench_download(bench_conn_t *c, const char *path) {
+    char reply[256];
+    long long size;
+    if (bench_cmd(c, reply, sizeof(reply), "DOWNLOAD %s", path) != 151 ||
+        sscanf(reply, "151 %lld", &size) != 1) {
+        fprintf(stderr, "DOWNLOAD answered %s\n", reply);
+        return -1;
+    }
+    if (bench_recv_discard(c, size) == -1) {
+        return -1;
+    }
+    return bench_line(c, reply, sizeof(reply)) != -1 && atoi(reply) == 150 ? 0 : -1;
+}
+
+/**
+ * @function bench_close: Close a connection
+ * @param c: Connection
+ **/
+void bench_close(bench_conn_t *c) {
+    if (c->fd != -1) {
+        close(c->fd);
+        c->fd = -1;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/* ==================== BENCHMARK HARNESS ==================== */
+
+/*
+ * Every end-to-end benchmark starts its own server (../TCP_Server/server
+ * next to the bench binaries, or $FS_BENCH_SERVER) in a scratch directory
+ * under $FS_BENCH_DIR (default /tmp) with empty data/ files, talks the
+ * text protocol to it over loopback, and removes the directory afterwards
+ * unless $FS_BENCH_KEEP is set. The server's console goes to server.out
+ * in that directory.
+ */
+
+#define BENCH_LINE_SIZE 65536   /* Longest reply a bench reads */
+#define BENCH_MAX_ARGS 16
+
+typedef struct {
+    pid_t pid;
+    int port;
+    char dir[512];              /* Scratch working directory of the server */
+} bench_server_t;
+
+typedef struct {
+    char name[16];              /* Transfer engine, as in "[transfer <name>]" */
+    long long bytes;
+    long long syscalls;
+} bench_engine_t;
+
+#define BENCH_MAX_ENGINES 8
+
+typedef struct {
+    int fd;
+    int len;                    /* Bytes buffered */
+    char buf[BENCH_LINE_SIZE];
+} bench_conn_t;
+
+/* Clock and environment */
+long long bench_now_ns();
+int bench_cpu_count();
+void bench_raise_nofile();
+int bench_parse_list(const char *text, int *values, int max);
+
+/* Server process */
+int bench_server_init(bench_server_t *s, const char *name);
+int bench_server_start(bench_server_t *s, char *const args[]);
+void bench_server_stop(bench_server_t *s);
+void bench_server_cleanup(bench_server_t *s);
+long bench_server_rss_kb(const bench_server_t *s);
+long long bench_server_cpu_ns(const bench_server_t *s);
+int bench_server_engines(const bench_server_t *s, bench_engine_t *engines, int max);
+int bench_engine_delta(const bench_engine_t *before, const bench_engine_t *after, int count,
+                       long long *syscalls);
+
+/* Protocol client */
+int bench_connect(bench_conn_t *c, int port);
+int bench_send(bench_conn_t *c, const char *fmt, ...);
+int bench_send_raw(bench_conn_t *c, const void *data, long long length);
+int bench_line(bench_conn_t *c, char *out, int size);
+int bench_cmd(bench_conn_t *c, char *out, int size, const char *fmt, ...);
+int bench_recv_discard(bench_conn_t *c, long long length);
+int bench_upload(bench_conn_t *c, const char *path, long long size);
+int bench_download(bench_conn_t *c, const char *path);
+void bench_close(bench_conn_t *c);
+
+#endif /* BENCH_H */
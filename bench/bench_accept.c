@@ -0,0 +1,147 @@
+#include "bench.h"
+
+/*
+ * Accept rate against the number of reactors (-r).
+ *
+ * Client threads connect, wait for the "100" greeting and drop the
+ * connection with a RST (so the client side does not run out of ports to
+ * TIME_WAIT), as fast as they can for a fixed time. One server is started
+ * per reactor count.
+ *
+ *   bench_accept [-r 1,2,4] [-c client_threads] [-t seconds]
+ */
+
+#define MAX_POINTS 16
+
+typedef struct {
+    int port;
+    volatile int *stop;
+    long long accepted;
+    long long failed;
+} accept_worker_t;
+
+/**
+ * @function accept_worker: Connect, read the greeting and reset, until stopped
+ * @param arg: Pointer to the thread's accept_worker_t
+ * @return: NULL
+ **/
+static void *accept_worker(void *arg) {
+    accept_worker_t *w = (accept_worker_t *)arg;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(w->port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct linger reset = { 1, 0 };
+    char greeting[64];
+
+    while (!*w->stop) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            w->failed++;
+            continue;
+        }
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+            recv(fd, greeting, sizeof(greeting), 0) >= 3 && strncmp(greeting, "100", 3) == 0) {
+            w->accepted++;
+        } else {
+            w->failed++;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * @function run_point: Measure accepts per second for one reactor count
+ * @param reactors: Value passed to -r
+ * @param clients: Number of client threads
+ * @param seconds: Length of the run
+ * @return: 0 on success, -1 if the server could not be started
+ **/
+static int run_point(int reactors, int clients, int seconds) {
+    bench_server_t server;
+    char reactor_text[16];
+    snprintf(reactor_text, sizeof(reactor_text), "%d", reactors);
+    char *args[] = { "-r", reactor_text, NULL };
+
+    if (bench_server_init(&server, "accept") == -1 || bench_server_start(&server, args) == -1) {
+        bench_server_cleanup(&server);
+        return -1;
+    }
+
+    volatile int stop = 0;
+    accept_worker_t *workers = calloc(clients, sizeof(accept_worker_t));
+    pthread_t *tids = calloc(clients, sizeof(pthread_t));
+    long long start = bench_now_ns();
+    for (int i = 0; i < clients; i++) {
+        workers[i].port = server.port;
+        workers[i].stop = &stop;
+        pthread_create(&tids[i], NULL, accept_worker, &workers[i]);
+    }
+    sleep(seconds);
+    stop = 1;
+
+    long long accepted = 0, failed = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(tids[i], NULL);
+        accepted += workers[i].accepted;
+        failed += workers[i].failed;
+    }
+    double elapsed = (bench_now_ns() - start) / 1e9;
+
+    printf("%-9d %-9d %-12lld %-12.0f %lld\n", reactors, clients, accepted, accepted / elapsed, failed);
+    fflush(stdout);
+
+    free(workers);
+    free(tids);
+    bench_server_cleanup(&server);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int points[MAX_POINTS];
+    int point_count = 0;
+    int clients = 8;
+    int seconds = 3;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:c:t:")) != -1) {
+        switch (opt) {
+            case 'r':
+                point_count = bench_parse_list(optarg, points, MAX_POINTS);
+                break;
+            case 'c':
+                clients = atoi(optarg);
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            default:
+                point_count = -1;
+        }
+    }
+    if (point_count < 0 || clients <= 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s [-r 1,2,4] [-c client_threads] [-t seconds]\n", argv[0]);
+        return 2;
+    }
+
+    /* Default: 1, 2, 4, ... up to the CPUs we may use */
+    int cpus = bench_cpu_count();
+    if (point_count == 0) {
+        for (int r = 1; point_count < MAX_POINTS; r *= 2) {
+            points[point_count++] = r < cpus ? r : cpus;
+            if (r >= cpus) {
+                break;
+            }
+        }
+    }
+
+    bench_raise_nofile();
+    printf("# accepts/s by reactor count, %d CPUs available\n", cpus);
+    printf("%-9s %-9s %-12s %-12s %s\n", "reactors", "clients", "accepted", "accepts/s", "failed");
+    for (int i = 0; i < point_count; i++) {
+        if (run_point(points[i], clients, seconds) == -1) {
+            return 1;
+        }
+    }
+    return 0;
+}
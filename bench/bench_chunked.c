@@ -0,0 +1,163 @@
+#include "bench.h"
+
+/*
+ * Multi-stream upload throughput against the stream count.
+ *
+ * One file of -s MB is uploaded with UPLOAD_BEGIN, then split into equal
+ * slices, each sent by its own connection as UPLOAD_CHUNKs of at most
+ * -k MB, then published with UPLOAD_COMMIT (which hashes the file unless
+ * the server runs with -H none). The file is deleted after each run.
+ *
+ *   bench_chunked [-n 1,2,4,8] [-s size_mb] [-k chunk_mb] [-- server options]
+ */
+
+#define MAX_POINTS 16
+#define MAX_STREAMS 64
+#define SEND_BUF_SIZE (1 << 20)
+
+typedef struct {
+    int port;
+    const char *id;
+    long long offset;
+    long long length;
+    long long chunk;
+    int failed;
+} stream_t;
+
+static char send_buf[SEND_BUF_SIZE];
+
+/**
+ * @function stream_upload: Send one slice of the file as UPLOAD_CHUNKs
+ * @param arg: Pointer to the thread's stream_t
+ * @return: NULL
+ **/
+static void *stream_upload(void *arg) {
+    stream_t *st = (stream_t *)arg;
+    static __thread bench_conn_t c;
+
+    if (bench_connect(&c, st->port) == -1) {
+        st->failed = 1;
+        return NULL;
+    }
+    for (long long off = st->offset; off < st->offset + st->length && !st->failed; off += st->chunk) {
+        long long len = st->offset + st->length - off < st->chunk ? st->offset + st->length - off : st->chunk;
+        if (bench_cmd(&c, NULL, 0, "UPLOAD_CHUNK %s %lld %lld", st->id, off, len) != 144) {
+            st->failed = 1;
+            break;
+        }
+        for (long long sent = 0; sent < len; sent += SEND_BUF_SIZE) {
+            long long n = len - sent < SEND_BUF_SIZE ? len - sent : SEND_BUF_SIZE;
+            if (bench_send_raw(&c, send_buf, n) == -1) {
+                st->failed = 1;
+                break;
+            }
+        }
+        char reply[64];
+        if (st->failed || bench_line(&c, reply, sizeof(reply)) == -1 || atoi(reply) != 145) {
+            st->failed = 1;
+        }
+    }
+    bench_close(&c);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int points[MAX_POINTS] = { 1, 2, 4, 8 };
+    int point_count = 4;
+    long long size_mb = 512, chunk_mb = 16;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:k:")) != -1) {
+        switch (opt) {
+            case 'n':
+                point_count = bench_parse_list(optarg, points, MAX_POINTS);
+                break;
+            case 's':
+                size_mb = atoll(optarg);
+                break;
+            case 'k':
+                chunk_mb = atoll(optarg);
+                break;
+            default:
+                point_count = -1;
+        }
+    }
+    for (int i = 0; i < point_count; i++) {
+        if (points[i] <= 0 || points[i] > MAX_STREAMS) {
+            point_count = -1;
+        }
+    }
+    if (point_count <= 0 || size_mb <= 0 || chunk_mb <= 0) {
+        fprintf(stderr, "Usage: %s [-n 1,2,4,8] [-s size_mb] [-k chunk_mb] [-- server options]\n", argv[0]);
+        return 2;
+    }
+
+    bench_server_t server;
+    if (bench_server_init(&server, "chunked") == -1 || bench_server_start(&server, argv + optind) == -1) {
+        bench_server_cleanup(&server);
+        return 1;
+    }
+    static bench_conn_t owner;
+    if (bench_connect(&owner, server.port) == -1 ||
+        bench_cmd(&owner, NULL, 0, "REGISTER owner pw") != 120 ||
+        bench_cmd(&owner, NULL, 0, "LOGIN owner pw") != 110 ||
+        bench_cmd(&owner, NULL, 0, "CREATE team") != 202) {
+        fprintf(stderr, "Setup failed\n");
+        bench_server_cleanup(&server);
+        return 1;
+    }
+    for (int i = 0; i < SEND_BUF_SIZE; i++) {
+        send_buf[i] = (char)(i * 2654435761u >> 24);
+    }
+
+    long long size = size_mb << 20;
+    int ret = 0;
+    printf("# %lld MB file, chunks of up to %lld MB\n", size_mb, chunk_mb);
+    printf("%-9s %-12s %-14s %-12s %-12s %s\n", "streams", "transfer_s", "transfer_MB/s",
+           "commit_ms", "total_s", "MB/s");
+    for (int p = 0; p < point_count && ret == 0; p++) {
+        char reply[256], id[128];
+        long long start = bench_now_ns();
+        if (bench_cmd(&owner, reply, sizeof(reply), "UPLOAD_BEGIN big%d.bin %lld", p, size) != 143 ||
+            sscanf(reply, "143 %127s", id) != 1) {
+            fprintf(stderr, "UPLOAD_BEGIN answered %s\n", reply);
+            ret = 1;
+            break;
+        }
+
+        int streams = points[p];
+        stream_t st[MAX_STREAMS];
+        pthread_t tids[MAX_STREAMS];
+        long long slice = (size + streams - 1) / streams;
+        for (int i = 0; i < streams; i++) {
+            st[i].port = server.port;
+            st[i].id = id;
+            st[i].offset = i * slice;
+            st[i].length = st[i].offset + slice > size ? size - st[i].offset : slice;
+            st[i].chunk = chunk_mb << 20;
+            st[i].failed = 0;
+            pthread_create(&tids[i], NULL, stream_upload, &st[i]);
+        }
+        for (int i = 0; i < streams; i++) {
+            pthread_join(tids[i], NULL);
+            ret |= st[i].failed;
+        }
+        long long sent = bench_now_ns();
+        if (ret != 0 || bench_cmd(&owner, reply, sizeof(reply), "UPLOAD_COMMIT %s", id) != 140) {
+            fprintf(stderr, "Upload with %d streams failed\n", streams);
+            ret = 1;
+            break;
+        }
+        long long done = bench_now_ns();
+
+        double total = (done - start) / 1e9;
+        printf("%-9d %-12.2f %-14.0f %-12.1f %-12.2f %.0f\n", streams, (sent - start) / 1e9,
+               size_mb / ((sent - start) / 1e9), (done - sent) / 1e6, total, size_mb / total);
+        fflush(stdout);
+        bench_cmd(&owner, NULL, 0, "DELETE_FILE big%d.bin", p);
+    }
+
+    bench_close(&owner);
+    bench_server_cleanup(&server);
+    return ret;
+}
@@ -0,0 +1,267 @@
+#include "bench.h"
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+/*
+ * File copy strategies against the file size.
+ *
+ * For each size a source file is written into the group folder of a
+ * running server, then copied in-process on the same filesystem with each
+ * strategy COPY_FILE can use, plus the old 4 KB fread/fwrite loop:
+ *
+ *   stdio_4k         fread/fwrite through a 4 KB buffer (the old handler)
+ *   buffered         pread/pwrite through a 1 MB buffer
+ *   copy_file_range  1 GB extents per call
+ *   reflink          ioctl(FICLONE); "-" where the filesystem has no reflinks
+ *
+ * and finally end to end with COPY_FILE, whose 212 reply names the
+ * strategy the server picked. Times are the best of -r runs, with the
+ * source in the page cache and without syncing the copy.
+ *
+ *   bench_copy [-n 1,64,512] [-r repeats] [-- server options]
+ */
+
+#define MAX_POINTS 16
+#define STDIO_BUFFER_SIZE 4096
+#define BUFFERED_SIZE (1024 * 1024)
+#define RANGE_EXTENT (1LL << 30)
+#define STRATEGIES 4
+
+static const char *strategy_names[STRATEGIES] = { "stdio_4k", "buffered", "copy_file_range", "reflink" };
+
+/**
+ * @function copy_stdio: Copy with fread/fwrite through a 4 KB buffer
+ * @param src: Source path
+ * @param dest: Destination path
+ * @return: 0 on success, -1 on error
+ **/
+static int copy_stdio(const char *src, const char *dest) {
+    FILE *in = fopen(src, "rb"), *out = fopen(dest, "wb");
+    char buf[STDIO_BUFFER_SIZE];
+    size_t n;
+    int ret = (in != NULL && out != NULL) ? 0 : -1;
+    while (ret == 0 && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) {
+            ret = -1;
+        }
+    }
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out != NULL && fclose(out) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/**
+ * @function copy_fds: Copy between open files with one of the fd strategies
+ * @param strategy: 1 buffered, 2 copy_file_range, 3 reflink
+ * @param in_fd: Source
+ * @param out_fd: Destination, empty
+ * @param size: Bytes to copy
+ * @return: 0 on success, 1 if the filesystem cannot do it, -1 on error
+ **/
+static int copy_fds(int strategy, int in_fd, int out_fd, long long size) {
+    if (strategy == 3) {
+        if (ioctl(out_fd, FICLONE, in_fd) == 0) {
+            return 0;
+        }
+        return (errno == EOPNOTSUPP || errno == ENOTTY || errno == EXDEV || errno == EINVAL) ? 1 : -1;
+    }
+    if (strategy == 2) {
+        loff_t off_in = 0, off_out = 0;
+        while (off_in < size) {
+            long long want = size - off_in < RANGE_EXTENT ? size - off_in : RANGE_EXTENT;
+            ssize_t n = copy_file_range(in_fd, &off_in, out_fd, &off_out, want, 0);
+            if (n <= 0) {
+                return (n == -1 && off_in == 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP)) ? 1 : -1;
+            }
+        }
+        return 0;
+    }
+
+    static char buf[BUFFERED_SIZE];
+    for (long long off = 0; off < size; ) {
+        ssize_t n = pread(in_fd, buf, sizeof(buf), off);
+        if (n <= 0) {
+            return -1;
+        }
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = pwrite(out_fd, buf + done, n - done, off + done);
+            if (w <= 0) {
+                return -1;
+            }
+            done += w;
+        }
+        off += n;
+    }
+    return 0;
+}
+
+/**
+ * @function time_strategy: Copy src to dest once with a strategy
+ * @param strategy: Index in strategy_names
+ * @param src: Source path
+ * @param dest: Destination path, removed before and after
+ * @param size: Size of the source
+ * @return: Elapsed ms, -2 if the filesystem cannot do it, -1 on error
+ **/
+static double time_strategy(int strategy, const char *src, const char *dest, long long size) {
+    unlink(dest);
+    long long start = bench_now_ns();
+    int ret;
+    if (strategy == 0) {
+        ret = copy_stdio(src, dest);
+    } else {
+        int in_fd = open(src, O_RDONLY);
+        int out_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ret = (in_fd == -1 || out_fd == -1) ? -1 : copy_fds(strategy, in_fd, out_fd, size);
+        if (in_fd != -1) {
+            close(in_fd);
+        }
+        if (out_fd != -1 && close(out_fd) == -1) {
+            ret = -1;
+        }
+    }
+    double ms = (bench_now_ns() - start) / 1e6;
+    unlink(dest);
+    return ret == 0 ? ms : (ret == 1 ? -2 : -1);
+}
+
+/**
+ * @function write_source: Write a file of size bytes of non-zero data
+ * @param path: File to create
+ * @param size: Bytes to write
+ * @return: 0 on success, -1 on error
+ **/
+static int write_source(const char *path, long long size) {
+    static char buf[BUFFERED_SIZE];
+    for (int i = 0; i < BUFFERED_SIZE; i++) {
+        buf[i] = (char)(i * 2654435761u >> 24);
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(path);
+        return -1;
+    }
+    for (long long off = 0; off < size; off += BUFFERED_SIZE) {
+        long long n = size - off < BUFFERED_SIZE ? size - off : BUFFERED_SIZE;
+        if (write(fd, buf, n) != n) {
+            close(fd);
+            return -1;
+        }
+    }
+    return close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    int points[MAX_POINTS] = { 1, 64, 512 };
+    int point_count = 3;
+    int repeats = 3;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                point_count = bench_parse_list(optarg, points, MAX_POINTS);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            default:
+                point_count = -1;
+        }
+    }
+    for (int i = 0; i < point_count; i++) {
+        if (points[i] <= 0) {
+            point_count = -1;
+        }
+    }
+    if (point_count <= 0 || repeats <= 0) {
+        fprintf(stderr, "Usage: %s [-n 1,64,512 (MB)] [-r repeats] [-- server options]\n", argv[0]);
+        return 2;
+    }
+
+    bench_server_t server;
+    static bench_conn_t c;
+    if (bench_server_init(&server, "copy") == -1 || bench_server_start(&server, argv + optind) == -1) {
+        bench_server_cleanup(&server);
+        return 1;
+    }
+    if (bench_connect(&c, server.port) == -1 ||
+        bench_cmd(&c, NULL, 0, "REGISTER owner pw") != 120 ||
+        bench_cmd(&c, NULL, 0, "LOGIN owner pw") != 110 ||
+        bench_cmd(&c, NULL, 0, "CREATE team") != 202) {
+        fprintf(stderr, "Setup failed\n");
+        bench_server_cleanup(&server);
+        return 1;
+    }
+
+    int ret = 0;
+    printf("# copy time in ms, best of %d (\"-\": not supported by this filesystem)\n", repeats);
+    printf("%-8s %-10s %-10s %-16s %-10s %s\n", "size_mb", strategy_names[0], strategy_names[1],
+           strategy_names[2], strategy_names[3], "COPY_FILE");
+    for (int p = 0; p < point_count && ret == 0; p++) {
+        char src[700], dest[700];
+        long long size = (long long)points[p] << 20;
+        snprintf(src, sizeof(src), "%s/groups/team/src%d.bin", server.dir, p);
+        snprintf(dest, sizeof(dest), "%s/groups/team/dest%d.bin", server.dir, p);
+        if (write_source(src, size) == -1) {
+            ret = 1;
+            break;
+        }
+
+        double best[STRATEGIES];
+        for (int s = 0; s < STRATEGIES; s++) {
+            best[s] = -1;
+            for (int r = 0; r < repeats; r++) {
+                double ms = time_strategy(s, src, dest, size);
+                if (ms < 0) {
+                    best[s] = ms;
+                    break;
+                }
+                best[s] = (best[s] < 0 || ms < best[s]) ? ms : best[s];
+            }
+            if (best[s] == -1) {
+                fprintf(stderr, "%s copy of %d MB failed\n", strategy_names[s], points[p]);
+                ret = 1;
+            }
+        }
+
+        double remote = -1;
+        char reply[128] = "", strategy[64] = "?";
+        for (int r = 0; r < repeats && ret == 0; r++) {
+            long long start = bench_now_ns();
+            if (bench_cmd(&c, reply, sizeof(reply), "COPY_FILE src%d.bin dest%d.bin", p, p) != 212) {
+                fprintf(stderr, "COPY_FILE answered %s\n", reply);
+                ret = 1;
+                break;
+            }
+            double ms = (bench_now_ns() - start) / 1e6;
+            remote = (remote < 0 || ms < remote) ? ms : remote;
+            sscanf(reply, "212 %63s", strategy);
+            bench_cmd(&c, NULL, 0, "DELETE_FILE dest%d.bin", p);
+        }
+        if (ret != 0) {
+            break;
+        }
+
+        char cells[STRATEGIES][32];
+        for (int s = 0; s < STRATEGIES; s++) {
+            if (best[s] == -2) {
+                snprintf(cells[s], sizeof(cells[s]), "-");
+            } else {
+                snprintf(cells[s], sizeof(cells[s]), "%.1f", best[s]);
+            }
+        }
+        printf("%-8d %-10s %-10s %-16s %-10s %.1f (%s)\n", points[p], cells[0], cells[1], cells[2],
+               cells[3], remote, strategy);
+        fflush(stdout);
+        unlink(src);
+    }
+
+    bench_close(&c);
+    bench_server_cleanup(&server);
+    return ret;
+}
@@ -0,0 +1,173 @@
+#include "bench.h"
+
+/*
+ * COPY_FOLDER against cp -r on a tree of many small files.
+ *
+ * A source folder of -f files of -s bytes, -p per subfolder, is written
+ * into a group folder. Each run times COPY_FOLDER of it (whose 223 reply
+ * carries the files and bytes copied) and then `cp -r` of the same tree
+ * to a folder next to it; both copies are removed before the next run and
+ * the best of -r runs is printed. Server options (e.g. -c copy_workers)
+ * go after "--".
+ *
+ *   bench_copy_folder [-f files] [-s file_bytes] [-p files_per_folder] [-r repeats] [-- server options]
+ */
+
+/**
+ * @function run_command: Run a program and wait for it
+ * @param argv: NULL-terminated program and arguments
+ * @return: Its exit status, -1 if it could not run or was killed
+ **/
+static int run_command(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+/**
+ * @function build_tree: Write the source folder
+ * @param root: Folder to create
+ * @param files: Number of files
+ * @param size: Bytes per file
+ * @param per_folder: Files per subfolder
+ * @return: 0 on success, -1 on error
+ **/
+static int build_tree(const char *root, long files, int size, int per_folder) {
+    char path[800];
+    char *buf = malloc(size > 0 ? size : 1);
+    if (buf == NULL || mkdir(root, 0755) == -1) {
+        perror(root);
+        free(buf);
+        return -1;
+    }
+    for (int i = 0; i < size; i++) {
+        buf[i] = (char)(i * 2654435761u >> 24);
+    }
+    for (long i = 0; i < files; i++) {
+        if (i % per_folder == 0) {
+            snprintf(path, sizeof(path), "%s/d%ld", root, i / per_folder);
+            if (mkdir(path, 0755) == -1) {
+                perror(path);
+                free(buf);
+                return -1;
+            }
+        }
+        snprintf(path, sizeof(path), "%s/d%ld/f%ld", root, i / per_folder, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || write(fd, buf, size) != size || close(fd) == -1) {
+            perror(path);
+            free(buf);
+            return -1;
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long files = 100000;
+    int size = 4096;
+    int per_folder = 1000;
+    int repeats = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:s:p:r:")) != -1) {
+        switch (opt) {
+            case 'f':
+                files = atol(optarg);
+                break;
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'p':
+                per_folder = atoi(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            default:
+                files = -1;
+        }
+    }
+    if (files <= 0 || size < 0 || per_folder <= 0 || repeats <= 0) {
+        fprintf(stderr, "Usage: %s [-f files] [-s file_bytes] [-p files_per_folder] [-r repeats] "
+                "[-- server options]\n", argv[0]);
+        return 2;
+    }
+
+    bench_server_t server;
+    static bench_conn_t c;
+    if (bench_server_init(&server, "copy_folder") == -1 || bench_server_start(&server, argv + optind) == -1) {
+        bench_server_cleanup(&server);
+        return 1;
+    }
+    char src[700], cp_dest[700];
+    snprintf(src, sizeof(src), "%s/groups/team/src", server.dir);
+    snprintf(cp_dest, sizeof(cp_dest), "%s/groups/team/cp_copy", server.dir);
+    if (bench_connect(&c, server.port) == -1 ||
+        bench_cmd(&c, NULL, 0, "REGISTER owner pw") != 120 ||
+        bench_cmd(&c, NULL, 0, "LOGIN owner pw") != 110 ||
+        bench_cmd(&c, NULL, 0, "CREATE team") != 202 ||
+        build_tree(src, files, size, per_folder) == -1) {
+        fprintf(stderr, "Setup failed\n");
+        bench_server_cleanup(&server);
+        return 1;
+    }
+    sync();
+
+    char *cp_argv[] = { "cp", "-r", src, cp_dest, NULL };
+    char *rm_argv[] = { "rm", "-rf", cp_dest, NULL };
+    double server_s = -1, cp_s = -1;
+    long long copied_files = 0, copied_bytes = 0;
+    int ret = 0;
+    for (int r = 0; r < repeats && ret == 0; r++) {
+        char reply[128] = "";
+        long long start = bench_now_ns();
+        if (bench_cmd(&c, reply, sizeof(reply), "COPY_FOLDER src copy") != 223 ||
+            sscanf(reply, "223 %lld %lld", &copied_files, &copied_bytes) != 2) {
+            fprintf(stderr, "COPY_FOLDER answered %s\n", reply);
+            ret = 1;
+            break;
+        }
+        double s = (bench_now_ns() - start) / 1e9;
+        server_s = (server_s < 0 || s < server_s) ? s : server_s;
+
+        start = bench_now_ns();
+        if (run_command(cp_argv) != 0) {
+            fprintf(stderr, "cp -r failed\n");
+            ret = 1;
+            break;
+        }
+        s = (bench_now_ns() - start) / 1e9;
+        cp_s = (cp_s < 0 || s < cp_s) ? s : cp_s;
+
+        if (bench_cmd(&c, NULL, 0, "RMDIR copy") != 222 || run_command(rm_argv) != 0) {
+            ret = 1;
+        }
+        sync();
+    }
+
+    if (ret == 0) {
+        printf("# %ld files of %d bytes, %d per folder, best of %d\n", files, size, per_folder, repeats);
+        printf("%-12s %-10s %-12s %s\n", "", "seconds", "files/s", "reply");
+        printf("%-12s %-10.2f %-12.0f 223 %lld %lld\n", "COPY_FOLDER", server_s, files / server_s,
+               copied_files, copied_bytes);
+        printf("%-12s %-10.2f %-12.0f\n", "cp -r", cp_s, files / cp_s);
+        printf("%-12s %.2fx\n", "speedup", cp_s / server_s);
+        if (copied_files != files || copied_bytes != (long long)files * size) {
+            fprintf(stderr, "COPY_FOLDER copied %lld files, %lld bytes\n", copied_files, copied_bytes);
+            ret = 1;
+        }
+    }
+
+    bench_close(&c);
+    bench_server_cleanup(&server);
+    return ret;
+}
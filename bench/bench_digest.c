@@ -0,0 +1,107 @@
+#include "bench.h"
+
+/*
+ * Cost of the upload digest against raw transfer throughput.
+ *
+ * For each digest (-H crc32c, -H sha256, then -H none) a server is started,
+ * one client uploads a file of -s MB -n times and then downloads it -n
+ * times. For each direction it prints the throughput, the server CPU time
+ * per GB, the engine that moved the bytes (from the SIGUSR1 report) and the
+ * throughput as a share of -H none. A digest has to see every byte, so
+ * with -H crc32c or sha256 uploads go through the read/write loop and only
+ * -H none can splice the socket into the file; downloads never hash and
+ * use sendfile either way. Further server options go after "--" (e.g.
+ * "-- -b uring").
+ *
+ *   bench_digest [-s size_mb] [-n rounds] [-- server options]
+ */
+
+#define MAX_SERVER_ARGS 12
+#define DIGESTS 3
+
+static const char *digests[DIGESTS] = { "crc32c", "sha256", "none" };
+
+int main(int argc, char *argv[]) {
+    long long size_mb = 256;
+    int rounds = 4;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+        switch (opt) {
+            case 's':
+                size_mb = atoll(optarg);
+                break;
+            case 'n':
+                rounds = atoi(optarg);
+                break;
+            default:
+                rounds = -1;
+        }
+    }
+    if (size_mb <= 0 || rounds <= 0 || argc - optind > MAX_SERVER_ARGS) {
+        fprintf(stderr, "Usage: %s [-s size_mb] [-n rounds] [-- server options]\n", argv[0]);
+        return 2;
+    }
+
+    long long size = size_mb << 20;
+    double mb = (double)(size * rounds) / 1048576.0;
+    double rate[DIGESTS][2], cpu_per_gb[DIGESTS][2];
+    char engine[DIGESTS][2][16];
+    int ret = 0;
+    for (int d = 0; d < DIGESTS && ret == 0; d++) {
+        bench_server_t server;
+        char *args[MAX_SERVER_ARGS + 3] = { "-H", (char *)digests[d] };
+        for (int i = optind; i < argc; i++) {
+            args[2 + i - optind] = argv[i];
+        }
+        static bench_conn_t c;
+        if (bench_server_init(&server, "digest") == -1 || bench_server_start(&server, args) == -1 ||
+            bench_connect(&c, server.port) == -1 ||
+            bench_cmd(&c, NULL, 0, "REGISTER owner pw") != 120 ||
+            bench_cmd(&c, NULL, 0, "LOGIN owner pw") != 110 ||
+            bench_cmd(&c, NULL, 0, "CREATE team") != 202) {
+            fprintf(stderr, "Setup failed\n");
+            bench_server_cleanup(&server);
+            return 1;
+        }
+
+        bench_engine_t before[BENCH_MAX_ENGINES], after[BENCH_MAX_ENGINES];
+        for (int phase = 0; phase < 2 && ret == 0; phase++) {
+            int count = bench_server_engines(&server, before, BENCH_MAX_ENGINES);
+            long long cpu = bench_server_cpu_ns(&server);
+            long long start = bench_now_ns();
+            for (int r = 0; r < rounds && ret == 0; r++) {
+                ret = phase == 0 ? bench_upload(&c, "big.bin", size) : bench_download(&c, "big.bin");
+            }
+            long long ns = bench_now_ns() - start;
+            cpu = bench_server_cpu_ns(&server) - cpu;
+            if (ret != 0 || count <= 0 || bench_server_engines(&server, after, BENCH_MAX_ENGINES) != count) {
+                fprintf(stderr, "%s with -H %s failed\n", phase == 0 ? "Upload" : "Download", digests[d]);
+                ret = 1;
+                break;
+            }
+            long long syscalls;
+            int busiest = bench_engine_delta(before, after, count, &syscalls);
+            snprintf(engine[d][phase], sizeof(engine[d][phase]), "%s", after[busiest].name);
+            rate[d][phase] = mb / (ns / 1e9);
+            cpu_per_gb[d][phase] = cpu / 1e6 / (mb / 1024);
+        }
+        bench_close(&c);
+        bench_server_cleanup(&server);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    printf("# %d x %lld MB each way over loopback, %d CPUs\n", rounds, size_mb, bench_cpu_count());
+    printf("%-8s %-9s %-10s %-10s %-12s %s\n", "digest", "direction", "engine", "MB/s", "cpu_ms/GB",
+           "vs_none");
+    for (int d = 0; d < DIGESTS; d++) {
+        for (int phase = 0; phase < 2; phase++) {
+            printf("%-8s %-9s %-10s %-10.0f %-12.0f %.0f%%\n", digests[d], phase == 0 ? "upload" : "download",
+                   engine[d][phase], rate[d][phase], cpu_per_gb[d][phase],
+                   100 * rate[d][phase] / rate[DIGESTS - 1][phase]);
+        }
+    }
+    return 0;
+}
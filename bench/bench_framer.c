@@ -0,0 +1,191 @@
+#include "bench.h"
+#include "framer.h"
+
+/*
+ * Commands framed per second, TCP_Common/framer.c against the scanner it
+ * replaced (rescan the buffer from byte 0 for "\r\n", copy the command
+ * out, memmove the rest to the front).
+ *
+ * A stream of pipelined commands is built in memory and fed to both in
+ * segments of a fixed size, the way recv() would hand them over; no
+ * sockets are involved.
+ *
+ *   bench_framer [-n commands] [-s 64,1460,16384,65536]
+ */
+
+#define FRAMER_BUF_SIZE 65536   /* BUFF_SIZE of the server */
+#define MAX_POINTS 16
+
+static const char *sample_commands[] = {
+    "LIST_CONTENT",
+    "LIST_CONTENT docs/reports/2024",
+    "DOWNLOAD docs/reports/2024/q3-summary.pdf",
+    "UPLOAD_CHUNK 5f0c2a9d31b84e67a1c09d2f7e6b3a48 1048576 1048576",
+    "LOGIN alice secret",
+    "COPY_FILE docs/template.docx drafts/template-copy.docx",
+    "LIST_MEMBERS",
+    "MOVE_FILE drafts/old.txt archive/old.txt",
+};
+
+/**
+ * @function build_stream: Concatenate n commands, each ended by "\r\n"
+ * @param n: Number of commands
+ * @param length: Receives the stream length
+ * @return: Stream (malloc'd), NULL on allocation failure
+ **/
+static char *build_stream(long n, long long *length) {
+    int kinds = sizeof(sample_commands) / sizeof(sample_commands[0]);
+    long long total = 0;
+    for (long i = 0; i < n; i++) {
+        total += strlen(sample_commands[i % kinds]) + 2;
+    }
+
+    char *stream = malloc(total);
+    if (stream == NULL) {
+        return NULL;
+    }
+    char *p = stream;
+    for (long i = 0; i < n; i++) {
+        size_t len = strlen(sample_commands[i % kinds]);
+        memcpy(p, sample_commands[i % kinds], len);
+        memcpy(p + len, "\r\n", 2);
+        p += len + 2;
+    }
+    *length = total;
+    return stream;
+}
+
+/**
+ * @function run_framer: Frame the stream with framer_t
+ * @param stream: Input bytes
+ * @param length: Input length
+ * @param segment: Bytes delivered per simulated recv()
+ * @param checksum: Receives the sum of command lengths (keeps the work observable)
+ * @return: Number of commands framed
+ **/
+static long run_framer(const char *stream, long long length, int segment, long long *checksum) {
+    static char storage[FRAMER_BUF_SIZE];
+    framer_t f;
+    long long pos = 0;
+    long commands = 0;
+    char *line;
+    int len;
+
+    framer_init(&f, storage, sizeof(storage));
+    *checksum = 0;
+    while (pos < length) {
+        int avail;
+        char *space = framer_space(&f, &avail);
+        int n = segment < avail ? segment : avail;
+        if (n > length - pos) {
+            n = length - pos;
+        }
+        memcpy(space, stream + pos, n);
+        framer_commit(&f, n);
+        pos += n;
+
+        while ((len = framer_next(&f, &line)) >= 0) {
+            *checksum += len + line[0];
+            commands++;
+        }
+    }
+    return commands;
+}
+
+/**
+ * @function run_rescan: Frame the stream the way tcp_receive used to
+ * @param stream: Input bytes
+ * @param length: Input length
+ * @param segment: Bytes delivered per simulated recv()
+ * @param checksum: Receives the sum of command lengths
+ * @return: Number of commands framed
+ **/
+static long run_rescan(const char *stream, long long length, int segment, long long *checksum) {
+    static char recv_buffer[FRAMER_BUF_SIZE];
+    char command[FRAMER_BUF_SIZE];
+    int buffer_pos = 0;
+    long long pos = 0;
+    long commands = 0;
+
+    *checksum = 0;
+    while (pos < length) {
+        int n = FRAMER_BUF_SIZE - 1 - buffer_pos;
+        if (n > segment) {
+            n = segment;
+        }
+        if (n > length - pos) {
+            n = length - pos;
+        }
+        memcpy(recv_buffer + buffer_pos, stream + pos, n);
+        buffer_pos += n;
+        pos += n;
+
+        /* extract_message until no complete message is left */
+        int found = 1;
+        while (found) {
+            found = 0;
+            for (int i = 0; i < buffer_pos - 1; i++) {
+                if (recv_buffer[i] == '\r' && recv_buffer[i + 1] == '\n') {
+                    memcpy(command, recv_buffer, i);
+                    command[i] = '\0';
+                    buffer_pos -= i + 2;
+                    memmove(recv_buffer, recv_buffer + i + 2, buffer_pos);
+                    *checksum += i + command[0];
+                    commands++;
+                    found = 1;
+                    break;
+                }
+            }
+        }
+    }
+    return commands;
+}
+
+int main(int argc, char *argv[]) {
+    int segments[MAX_POINTS] = { 64, 1460, 16384, 65536 };
+    int segment_count = 4;
+    long n = 2000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 's':
+                segment_count = bench_parse_list(optarg, segments, MAX_POINTS);
+                break;
+            default:
+                segment_count = -1;
+        }
+    }
+    if (segment_count <= 0 || n <= 0) {
+        fprintf(stderr, "Usage: %s [-n commands] [-s 64,1460,16384,65536]\n", argv[0]);
+        return 2;
+    }
+
+    long long length;
+    char *stream = build_stream(n, &length);
+    if (stream == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    printf("# %ld pipelined commands, %.1f MB\n", n, length / 1e6);
+    printf("%-9s %-8s %-14s %-10s %s\n", "segment", "framer", "commands/s", "MB/s", "check");
+    for (int i = 0; i < segment_count; i++) {
+        for (int impl = 0; impl < 2; impl++) {
+            long long checksum;
+            long long start = bench_now_ns();
+            long framed = impl == 0 ? run_framer(stream, length, segments[i], &checksum)
+                                    : run_rescan(stream, length, segments[i], &checksum);
+            double elapsed = (bench_now_ns() - start) / 1e9;
+            printf("%-9d %-8s %-14.0f %-10.1f %s\n", segments[i], impl == 0 ? "framer" : "rescan",
+                   framed / elapsed, length / elapsed / 1e6, framed == n ? "ok" : "MISSED");
+            fflush(stdout);
+        }
+    }
+
+    free(stream);
+    return 0;
+}
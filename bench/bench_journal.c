@@ -0,0 +1,162 @@
+#include "bench.h"
+
+/*
+ * Metadata mutation latency against the size of data/.
+ *
+ * The account table is grown in steps with pipelined REGISTERs. At each
+ * step, one connection times REGISTERs of new users and another times a
+ * CREATE + LEAVE cycle (a group created and dropped by its leader), one
+ * round trip at a time. With a journal the latency should not depend on
+ * how many records data/ already holds.
+ *
+ *   bench_journal [-n 0,10000,100000,500000] [-m mutations_per_step]
+ */
+
+#define MAX_POINTS 16
+#define PIPELINE 1000           /* REGISTERs in flight while growing the table */
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @function grow_accounts: Register users until the table holds target accounts
+ * @param c: Connection (logged out)
+ * @param next_user: Next unused user number; advanced
+ * @param target: Account count to reach
+ * @return: 0 on success, -1 on an unexpected reply
+ **/
+static int grow_accounts(bench_conn_t *c, long *next_user, long target) {
+    char reply[64];
+    while (*next_user < target) {
+        long batch = target - *next_user < PIPELINE ? target - *next_user : PIPELINE;
+        for (long i = 0; i < batch; i++) {
+            if (bench_send(c, "REGISTER bulk%ld pw", *next_user + i) == -1) {
+                return -1;
+            }
+        }
+        for (long i = 0; i < batch; i++) {
+            if (bench_line(c, reply, sizeof(reply)) == -1 || strcmp(reply, "120") != 0) {
+                return -1;
+            }
+        }
+        *next_user += batch;
+    }
+    return 0;
+}
+
+/**
+ * @function data_size_kb: Size of the server's data/ directory files
+ * @param s: Server
+ * @return: Size in KB of journal.log plus metadata.snap
+ **/
+static long data_size_kb(const bench_server_t *s) {
+    static const char *files[] = { "journal.log", "journal.old", "metadata.snap" };
+    char path[600];
+    struct stat st;
+    long long total = 0;
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/data/%s", s->dir, files[i]);
+        if (stat(path, &st) == 0) {
+            total += st.st_size;
+        }
+    }
+    return total / 1024;
+}
+
+int main(int argc, char *argv[]) {
+    int points[MAX_POINTS] = { 0, 10000, 100000, 500000 };
+    int point_count = 4;
+    int mutations = 2000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+        switch (opt) {
+            case 'n':
+                point_count = bench_parse_list(optarg, points, MAX_POINTS);
+                break;
+            case 'm':
+                mutations = atoi(optarg);
+                break;
+            default:
+                point_count = -1;
+        }
+    }
+    if (point_count <= 0 || mutations <= 0) {
+        fprintf(stderr, "Usage: %s [-n 0,10000,100000,500000] [-m mutations_per_step]\n", argv[0]);
+        return 2;
+    }
+
+    bench_server_t server;
+    static bench_conn_t bulk, reg, leader;
+    if (bench_server_init(&server, "journal") == -1 || bench_server_start(&server, NULL) == -1) {
+        bench_server_cleanup(&server);
+        return 1;
+    }
+    if (bench_connect(&bulk, server.port) == -1 || bench_connect(&reg, server.port) == -1 ||
+        bench_connect(&leader, server.port) == -1 ||
+        bench_cmd(&leader, NULL, 0, "REGISTER leader pw") != 120 ||
+        bench_cmd(&leader, NULL, 0, "LOGIN leader pw") != 110) {
+        fprintf(stderr, "Cannot set up connections\n");
+        bench_server_cleanup(&server);
+        return 1;
+    }
+
+    long long *reg_ns = malloc(mutations * sizeof(long long));
+    long long *grp_ns = malloc(mutations * sizeof(long long));
+    long next_bulk = 0, next_user = 0, next_group = 0;
+    int ret = 0;
+
+    printf("# mutation latency (one round trip at a time) as data/ grows\n");
+    printf("%-10s %-10s %-13s %-13s %-17s %s\n", "accounts", "data_kb",
+           "register_avg", "register_p99", "create+leave_avg", "create+leave_p99");
+    for (int p = 0; p < point_count && ret == 0; p++) {
+        if (grow_accounts(&bulk, &next_bulk, points[p]) == -1) {
+            fprintf(stderr, "Bulk REGISTER failed\n");
+            ret = 1;
+            break;
+        }
+
+        for (int i = 0; i < mutations && ret == 0; i++) {
+            long long start = bench_now_ns();
+            if (bench_cmd(&reg, NULL, 0, "REGISTER timed%ld pw", next_user++) != 120) {
+                ret = 1;
+            }
+            reg_ns[i] = bench_now_ns() - start;
+
+            start = bench_now_ns();
+            if (bench_cmd(&leader, NULL, 0, "CREATE grp%ld", next_group++) != 202 ||
+                bench_cmd(&leader, NULL, 0, "LEAVE") != 200) {
+                ret = 1;
+            }
+            grp_ns[i] = bench_now_ns() - start;
+        }
+        if (ret != 0) {
+            fprintf(stderr, "Timed mutation failed\n");
+            break;
+        }
+
+        long long reg_sum = 0, grp_sum = 0;
+        for (int i = 0; i < mutations; i++) {
+            reg_sum += reg_ns[i];
+            grp_sum += grp_ns[i];
+        }
+        qsort(reg_ns, mutations, sizeof(long long), cmp_ll);
+        qsort(grp_ns, mutations, sizeof(long long), cmp_ll);
+        int p99 = mutations * 99 / 100;
+        printf("%-10ld %-10ld %-13.1f %-13.1f %-17.1f %.1f   (us)\n",
+               next_bulk + next_user + 1, data_size_kb(&server),
+               reg_sum / 1e3 / mutations, reg_ns[p99] / 1e3,
+               grp_sum / 1e3 / mutations, grp_ns[p99] / 1e3);
+        fflush(stdout);
+    }
+
+    free(reg_ns);
+    free(grp_ns);
+    bench_close(&bulk);
+    bench_close(&reg);
+    bench_close(&leader);
+    bench_server_cleanup(&server);
+    return ret;
+}
@@ -0,0 +1,204 @@
+#include "bench.h"
+
+/*
+ * Group read path under membership churn.
+ *
+ * Reader threads, each logged in as a member of one group, loop on
+ * LIST_CONTENT (role check, group lookup and path resolution on every
+ * call). Each reader count is measured twice: alone, then while a writer
+ * cycles CREATE, JOIN, APPROVE, KICK and LEAVE on other groups. With the
+ * lock-free read path the readers should not slow down when the writer
+ * runs, and should scale with the command workers (-w) and cores.
+ *
+ *   bench_rcu [-n 1,2,4,8] [-w workers] [-t seconds]
+ */
+
+#define MAX_POINTS 16
+#define MAX_READERS 256
+
+typedef struct {
+    bench_conn_t conn;
+    volatile int *stop;
+    long long ops;
+    int failed;
+} rcu_worker_t;
+
+static rcu_worker_t readers[MAX_READERS];
+static rcu_worker_t writer;
+static bench_conn_t churn_member;
+
+/**
+ * @function reader_loop: LIST_CONTENT until stopped
+ * @param arg: Pointer to the thread's rcu_worker_t
+ * @return: NULL
+ **/
+static void *reader_loop(void *arg) {
+    rcu_worker_t *w = (rcu_worker_t *)arg;
+    char reply[BENCH_LINE_SIZE];
+    while (!*w->stop) {
+        if (bench_cmd(&w->conn, reply, sizeof(reply), "LIST_CONTENT") != 225) {
+            w->failed = 1;
+            break;
+        }
+        w->ops++;
+    }
+    return NULL;
+}
+
+/**
+ * @function writer_loop: Create a group, let a member in, kick it, drop the group
+ * @param arg: Pointer to the writer's rcu_worker_t
+ * @return: NULL
+ * @note: ops counts mutations (5 per cycle)
+ **/
+static void *writer_loop(void *arg) {
+    rcu_worker_t *w = (rcu_worker_t *)arg;
+    static long cycle = 0;
+    while (!*w->stop) {
+        cycle++;
+        if (bench_cmd(&w->conn, NULL, 0, "CREATE churn%ld", cycle) != 202 ||
+            bench_cmd(&churn_member, NULL, 0, "JOIN churn%ld", cycle) != 160 ||
+            bench_cmd(&w->conn, NULL, 0, "APPROVE member") != 170 ||
+            bench_cmd(&w->conn, NULL, 0, "KICK member") != 201 ||
+            bench_cmd(&w->conn, NULL, 0, "LEAVE") != 200) {
+            w->failed = 1;
+            break;
+        }
+        w->ops += 5;
+    }
+    return NULL;
+}
+
+/**
+ * @function measure: Run readers (and optionally the writer) for a while
+ * @param reader_count: Number of reader threads
+ * @param with_writer: Run the writer alongside
+ * @param seconds: Length of the run
+ * @param writer_rate: Receives writer mutations per second
+ * @return: Reader LIST_CONTENT per second, -1 on failure
+ **/
+static double measure(int reader_count, int with_writer, int seconds, double *writer_rate) {
+    volatile int stop = 0;
+    pthread_t tids[MAX_READERS], wtid;
+
+    for (int i = 0; i < reader_count; i++) {
+        readers[i].stop = &stop;
+        readers[i].ops = 0;
+        pthread_create(&tids[i], NULL, reader_loop, &readers[i]);
+    }
+    writer.stop = &stop;
+    writer.ops = 0;
+    if (with_writer) {
+        pthread_create(&wtid, NULL, writer_loop, &writer);
+    }
+
+    long long start = bench_now_ns();
+    sleep(seconds);
+    stop = 1;
+
+    long long ops = 0;
+    int failed = 0;
+    for (int i = 0; i < reader_count; i++) {
+        pthread_join(tids[i], NULL);
+        ops += readers[i].ops;
+        failed |= readers[i].failed;
+    }
+    if (with_writer) {
+        pthread_join(wtid, NULL);
+        failed |= writer.failed;
+    }
+    double elapsed = (bench_now_ns() - start) / 1e9;
+    *writer_rate = writer.ops / elapsed;
+    return failed ? -1 : ops / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    int points[MAX_POINTS] = { 1, 2, 4, 8 };
+    int point_count = 4;
+    int seconds = 2;
+    char *workers = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w:t:")) != -1) {
+        switch (opt) {
+            case 'n':
+                point_count = bench_parse_list(optarg, points, MAX_POINTS);
+                break;
+            case 'w':
+                workers = optarg;
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            default:
+                point_count = -1;
+        }
+    }
+    int max_readers = 0;
+    for (int i = 0; i < point_count; i++) {
+        if (points[i] > max_readers) {
+            max_readers = points[i];
+        }
+    }
+    if (point_count <= 0 || max_readers <= 0 || max_readers > MAX_READERS || seconds <= 0) {
+        fprintf(stderr, "Usage: %s [-n 1,2,4,8] [-w workers] [-t seconds]\n", argv[0]);
+        return 2;
+    }
+
+    bench_server_t server;
+    char *args[] = { "-w", workers, NULL };
+    if (bench_server_init(&server, "rcu") == -1 ||
+        bench_server_start(&server, workers != NULL ? args : NULL) == -1) {
+        bench_server_cleanup(&server);
+        return 1;
+    }
+
+    /* One group read by everyone, with some entries to list */
+    static bench_conn_t leader;
+    int ok = bench_connect(&leader, server.port) == 0 &&
+             bench_cmd(&leader, NULL, 0, "REGISTER owner pw") == 120 &&
+             bench_cmd(&leader, NULL, 0, "LOGIN owner pw") == 110 &&
+             bench_cmd(&leader, NULL, 0, "CREATE team") == 202;
+    for (int i = 0; ok && i < 8; i++) {
+        ok = bench_cmd(&leader, NULL, 0, "MKDIR folder%d", i) == 220;
+    }
+    for (int i = 0; ok && i < max_readers; i++) {
+        bench_conn_t *c = &readers[i].conn;
+        ok = bench_connect(c, server.port) == 0 &&
+             bench_cmd(c, NULL, 0, "REGISTER reader%d pw", i) == 120 &&
+             bench_cmd(c, NULL, 0, "LOGIN reader%d pw", i) == 110 &&
+             bench_cmd(c, NULL, 0, "JOIN team") == 160 &&
+             bench_cmd(&leader, NULL, 0, "APPROVE reader%d", i) == 170;
+    }
+    ok = ok && bench_connect(&writer.conn, server.port) == 0 &&
+         bench_cmd(&writer.conn, NULL, 0, "REGISTER churn pw") == 120 &&
+         bench_cmd(&writer.conn, NULL, 0, "LOGIN churn pw") == 110 &&
+         bench_connect(&churn_member, server.port) == 0 &&
+         bench_cmd(&churn_member, NULL, 0, "REGISTER member pw") == 120 &&
+         bench_cmd(&churn_member, NULL, 0, "LOGIN member pw") == 110;
+    if (!ok) {
+        fprintf(stderr, "Setup failed\n");
+        bench_server_cleanup(&server);
+        return 1;
+    }
+
+    int ret = 0;
+    printf("# LIST_CONTENT/s by reader connections, %d CPUs, workers %s\n",
+           bench_cpu_count(), workers != NULL ? workers : "default");
+    printf("%-9s %-14s %-14s %-9s %s\n", "readers", "alone", "with_writer", "ratio", "writer_mutations/s");
+    for (int p = 0; p < point_count; p++) {
+        double writer_rate;
+        double alone = measure(points[p], 0, seconds, &writer_rate);
+        double mixed = alone < 0 ? -1 : measure(points[p], 1, seconds, &writer_rate);
+        if (mixed < 0) {
+            fprintf(stderr, "A command failed during the run\n");
+            ret = 1;
+            break;
+        }
+        printf("%-9d %-14.0f %-14.0f %-9.2f %.0f\n", points[p], alone, mixed, mixed / alone, writer_rate);
+        fflush(stdout);
+    }
+
+    bench_server_cleanup(&server);
+    return ret;
+}
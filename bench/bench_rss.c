@@ -0,0 +1,111 @@
+#include "bench.h"
+
+/*
+ * Server memory per idle connection.
+ *
+ * Connections are opened in steps; each reads the greeting and runs one
+ * command (so its receive buffer has been borrowed and given back) and
+ * then stays idle. The server's VmRSS growth divided by the number of
+ * connections added is the cost of an idle connection.
+ *
+ *   bench_rss [-n 1000,5000,10000]
+ */
+
+#define MAX_POINTS 16
+#define WARMUP_CONNS 64         /* Open before the baseline: first slabs, thread stacks */
+
+/**
+ * @function open_idle: Open a connection, run one command and leave it idle
+ * @param port: Server port
+ * @return: Socket, -1 on error
+ **/
+static int open_idle(int port) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    char reply[256];
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        recv(fd, reply, sizeof(reply), 0) < 3 ||
+        send(fd, "LIST_GROUPS\r\n", 13, MSG_NOSIGNAL) != 13 ||
+        recv(fd, reply, sizeof(reply), 0) < 3) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    int points[MAX_POINTS] = { 1000, 5000, 10000 };
+    int point_count = 3;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                point_count = bench_parse_list(optarg, points, MAX_POINTS);
+                break;
+            default:
+                point_count = -1;
+        }
+    }
+    if (point_count <= 0) {
+        fprintf(stderr, "Usage: %s [-n 1000,5000,10000]\n", argv[0]);
+        return 2;
+    }
+
+    int max_conns = WARMUP_CONNS;
+    for (int i = 0; i < point_count; i++) {
+        if (points[i] + WARMUP_CONNS > max_conns) {
+            max_conns = points[i] + WARMUP_CONNS;
+        }
+    }
+
+    bench_raise_nofile();
+    bench_server_t server;
+    if (bench_server_init(&server, "rss") == -1 || bench_server_start(&server, NULL) == -1) {
+        bench_server_cleanup(&server);
+        return 1;
+    }
+
+    int *fds = malloc(max_conns * sizeof(int));
+    int open_count = 0;
+    int ret = 0;
+    while (open_count < WARMUP_CONNS && (fds[open_count] = open_idle(server.port)) != -1) {
+        open_count++;
+    }
+    usleep(200000);
+    long base_kb = bench_server_rss_kb(&server);
+
+    printf("# server RSS with idle connections (baseline %ld KB after %d warm-up connections)\n",
+           base_kb, WARMUP_CONNS);
+    printf("%-12s %-12s %s\n", "connections", "rss_kb", "bytes/conn");
+    for (int i = 0; i < point_count && ret == 0; i++) {
+        while (open_count < points[i] + WARMUP_CONNS) {
+            fds[open_count] = open_idle(server.port);
+            if (fds[open_count] == -1) {
+                fprintf(stderr, "Connection %d failed (%s); raise ulimit -n\n", open_count, strerror(errno));
+                ret = 1;
+                break;
+            }
+            open_count++;
+        }
+        if (ret != 0) {
+            break;
+        }
+        usleep(200000);
+        long rss_kb = bench_server_rss_kb(&server);
+        printf("%-12d %-12ld %.0f\n", points[i], rss_kb, (rss_kb - base_kb) * 1024.0 / points[i]);
+        fflush(stdout);
+    }
+
+    for (int i = 0; i < open_count; i++) {
+        close(fds[i]);
+    }
+    free(fds);
+    bench_server_cleanup(&server);
+    return ret;
+}
@@ -0,0 +1,164 @@
+#include "bench.h"
+
+/*
+ * Metadata tables at company scale.
+ *
+ * Registers -u users, then has the first -g of them each log in, create
+ * a group and log out, all pipelined over -c connections. Prints the rate
+ * of each phase and the server's RSS, then restarts the server (from the
+ * snapshot the journal compactor wrote, plus the journal) and checks that
+ * the last user and the last group's leader can still log in.
+ *
+ *   bench_scale [-u users] [-g groups] [-c connections]
+ */
+
+#define MAX_CONNS 64
+#define PIPELINE 600            /* Commands in flight per connection */
+
+typedef struct {
+    bench_conn_t conn;
+    int index;                  /* Connection number */
+    int conns;                  /* Connection count: this one takes every conns-th item */
+    long items;
+    int phase;                  /* 0: REGISTER, 1: LOGIN + CREATE + LOGOUT */
+    long bad;
+} scale_worker_t;
+
+static scale_worker_t workers[MAX_CONNS];
+
+/**
+ * @function scale_loop: Pipeline one phase's commands for this connection's share
+ * @param arg: Pointer to the thread's scale_worker_t
+ * @return: NULL
+ **/
+static void *scale_loop(void *arg) {
+    scale_worker_t *w = (scale_worker_t *)arg;
+    static const char *create_codes[] = { "110", "202", "130" };
+    int per_item = w->phase == 0 ? 1 : 3;
+    char reply[256];
+
+    for (long first = w->index; first < w->items; first += (long)w->conns * (PIPELINE / per_item)) {
+        long sent = 0;
+        for (long u = first; u < w->items && sent < PIPELINE / per_item; u += w->conns, sent++) {
+            if (w->phase == 0) {
+                bench_send(&w->conn, "REGISTER user%ld pw", u);
+            } else {
+                bench_send(&w->conn, "LOGIN user%ld pw", u);
+                bench_send(&w->conn, "CREATE group%ld", u);
+                bench_send(&w->conn, "LOGOUT");
+            }
+        }
+        for (long i = 0; i < sent * per_item; i++) {
+            if (bench_line(&w->conn, reply, sizeof(reply)) == -1) {
+                w->bad += sent * per_item - i;
+                return NULL;
+            }
+            const char *want = w->phase == 0 ? "120" : create_codes[i % 3];
+            if (strcmp(reply, want) != 0) {
+                w->bad++;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @function run_phase: Run one phase over all connections
+ * @param conns: Number of connections
+ * @param items: Users or groups to create
+ * @param phase: 0 for REGISTER, 1 for CREATE
+ * @param bad: Receives the number of unexpected replies
+ * @return: Elapsed seconds
+ **/
+static double run_phase(int conns, long items, int phase, long *bad) {
+    pthread_t tids[MAX_CONNS];
+    long long start = bench_now_ns();
+    for (int i = 0; i < conns; i++) {
+        workers[i].index = i;
+        workers[i].conns = conns;
+        workers[i].items = items;
+        workers[i].phase = phase;
+        workers[i].bad = 0;
+        pthread_create(&tids[i], NULL, scale_loop, &workers[i]);
+    }
+    *bad = 0;
+    for (int i = 0; i < conns; i++) {
+        pthread_join(tids[i], NULL);
+        *bad += workers[i].bad;
+    }
+    return (bench_now_ns() - start) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    long users = 1000000;
+    long groups = 100000;
+    int conns = 8;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u:g:c:")) != -1) {
+        switch (opt) {
+            case 'u':
+                users = atol(optarg);
+                break;
+            case 'g':
+                groups = atol(optarg);
+                break;
+            case 'c':
+                conns = atoi(optarg);
+                break;
+            default:
+                users = -1;
+        }
+    }
+    if (users <= 0 || groups < 0 || groups > users || conns <= 0 || conns > MAX_CONNS) {
+        fprintf(stderr, "Usage: %s [-u users] [-g groups <= users] [-c connections]\n", argv[0]);
+        return 2;
+    }
+
+    bench_server_t server;
+    if (bench_server_init(&server, "scale") == -1 || bench_server_start(&server, NULL) == -1) {
+        bench_server_cleanup(&server);
+        return 1;
+    }
+    for (int i = 0; i < conns; i++) {
+        if (bench_connect(&workers[i].conn, server.port) == -1) {
+            fprintf(stderr, "Cannot connect\n");
+            bench_server_cleanup(&server);
+            return 1;
+        }
+    }
+
+    long bad_users, bad_groups;
+    printf("# %ld users, %ld groups over %d pipelined connections\n", users, groups, conns);
+    double t = run_phase(conns, users, 0, &bad_users);
+    printf("register      %-10.2f s  %-10.0f /s  bad=%ld\n", t, users / t, bad_users);
+    fflush(stdout);
+    t = run_phase(conns, groups, 1, &bad_groups);
+    printf("create group  %-10.2f s  %-10.0f /s  bad=%ld\n", t, groups / t, bad_groups);
+    printf("server rss    %ld KB\n", bench_server_rss_kb(&server));
+    fflush(stdout);
+
+    for (int i = 0; i < conns; i++) {
+        bench_close(&workers[i].conn);
+    }
+    bench_server_stop(&server);
+
+    long long start = bench_now_ns();
+    int ret = bench_server_start(&server, NULL);
+    double restart_ms = (bench_now_ns() - start) / 1e6;
+    bench_conn_t *c = &workers[0].conn;
+    int login = -1, members = groups > 0 ? -1 : 204;
+    if (ret == 0 && bench_connect(c, server.port) == 0) {
+        login = bench_cmd(c, NULL, 0, "LOGIN user%ld pw", users - 1);
+        if (groups > 0 && bench_cmd(c, NULL, 0, "LOGOUT") == 130 &&
+            bench_cmd(c, NULL, 0, "LOGIN user%ld pw", groups - 1) == 110) {
+            members = bench_cmd(c, NULL, 0, "LIST_MEMBERS");
+        }
+        bench_close(c);
+    }
+    printf("restart       %-10.1f ms LOGIN last user: %d, LIST_MEMBERS of last group: %d\n",
+           restart_ms, login, members);
+
+    bench_server_cleanup(&server);
+    return (bad_users == 0 && bad_groups == 0 && login == 110 && members == 204) ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include "bench.h"
+
+/*
+ * Server startup time against the number of accounts.
+ *
+ * For each size a legacy data/accounts.txt is written and the server is
+ * started twice: the first boot imports the text file (and writes
+ * data/metadata.snap), the second boots from the snapshot. Startup is the
+ * time from fork() until the listener accepts a connection; the last
+ * account is then logged in to check that it was loaded. Each pair runs
+ * -r times (the snapshot and journal are removed in between) and the best
+ * time of each kind is printed, as disk writeback makes single runs noisy.
+ *
+ *   bench_startup [-n 10000,100000,1000000] [-r repeats]
+ */
+
+#define MAX_POINTS 16
+
+/**
+ * @function write_accounts: Write a legacy accounts.txt with n users
+ * @param s: Server whose data/ is written
+ * @param n: Number of accounts
+ * @return: 0 on success, -1 on error
+ **/
+static int write_accounts(const bench_server_t *s, int n) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/data/accounts.txt", s->dir);
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "user%d pw%d -1\n", i, i);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/**
+ * @function remove_snapshot: Drop the snapshot and journal so the next boot imports
+ * @param s: Server (stopped)
+ **/
+static void remove_snapshot(const bench_server_t *s) {
+    static const char *files[] = { "metadata.snap", "journal.log", "journal.old" };
+    char path[600];
+    for (int i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/data/%s", s->dir, files[i]);
+        unlink(path);
+    }
+}
+
+/**
+ * @function timed_start: Start the server and check the last account
+ * @param s: Server
+ * @param n: Number of accounts it should hold
+ * @return: Startup time in ms, -1 on failure
+ **/
+static double timed_start(bench_server_t *s, int n) {
+    static bench_conn_t c;
+    long long start = bench_now_ns();
+    if (bench_server_start(s, NULL) == -1) {
+        return -1;
+    }
+    double ms = (bench_now_ns() - start) / 1e6;
+
+    int code = -1;
+    if (bench_connect(&c, s->port) == 0) {
+        code = bench_cmd(&c, NULL, 0, "LOGIN user%d pw%d", n - 1, n - 1);
+        bench_close(&c);
+    }
+    if (code != 110) {
+        fprintf(stderr, "LOGIN user%d after startup answered %d\n", n - 1, code);
+        return -1;
+    }
+    return ms;
+}
+
+int main(int argc, char *argv[]) {
+    int points[MAX_POINTS] = { 10000, 100000, 1000000 };
+    int point_count = 3;
+    int repeats = 3;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                point_count = bench_parse_list(optarg, points, MAX_POINTS);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            default:
+                point_count = -1;
+        }
+    }
+    if (point_count <= 0 || repeats <= 0) {
+        fprintf(stderr, "Usage: %s [-n 10000,100000,1000000] [-r repeats]\n", argv[0]);
+        return 2;
+    }
+
+    printf("# startup until the listener accepts, best of %d\n", repeats);
+    printf("%-10s %-16s %-16s %s\n", "accounts", "text_import_ms", "snapshot_ms", "snapshot_kb");
+    for (int p = 0; p < point_count; p++) {
+        bench_server_t server;
+        struct stat st;
+        char path[600];
+
+        if (points[p] <= 0 || bench_server_init(&server, "startup") == -1 ||
+            write_accounts(&server, points[p]) == -1) {
+            bench_server_cleanup(&server);
+            return 1;
+        }
+
+        double import_ms = -1, snapshot_ms = -1;
+        for (int r = 0; r < repeats; r++) {
+            remove_snapshot(&server);
+            double ms = timed_start(&server, points[p]);
+            bench_server_stop(&server);
+            if (ms < 0) {
+                bench_server_cleanup(&server);
+                return 1;
+            }
+            import_ms = (import_ms < 0 || ms < import_ms) ? ms : import_ms;
+
+            ms = timed_start(&server, points[p]);
+            bench_server_stop(&server);
+            if (ms < 0) {
+                bench_server_cleanup(&server);
+                return 1;
+            }
+            snapshot_ms = (snapshot_ms < 0 || ms < snapshot_ms) ? ms : snapshot_ms;
+        }
+
+        snprintf(path, sizeof(path), "%s/data/metadata.snap", server.dir);
+        long snap_kb = stat(path, &st) == 0 ? (long)(st.st_size / 1024) : -1;
+        bench_server_cleanup(&server);
+
+        printf("%-10d %-16.1f %-16.1f %ld\n", points[p], import_ms, snapshot_ms, snap_kb);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "bench.h"
+
+/*
+ * io_uring transfer backend against the default one.
+ *
+ * For each backend (-b copy, then -b uring) a server is started, one
+ * client uploads a file of -s MB -n times and then downloads it -n times.
+ * For each direction it prints the throughput, the server CPU time per GB
+ * (all threads, from /proc) and, from the server's SIGUSR1 report, the
+ * engine that moved the bytes and its syscalls per MB. With -b copy the
+ * default digest keeps uploads on the read/write loop (splice only runs
+ * under -H none) and downloads use sendfile. Further server options go
+ * after "--" (e.g. "-- -H none").
+ *
+ *   bench_uring [-s size_mb] [-n rounds] [-- server options]
+ */
+
+#define MAX_SERVER_ARGS 12
+
+/**
+ * @function print_phase: Print one direction's figures
+ * @param backend: -b value
+ * @param direction: "upload" or "download"
+ * @param bytes: Bytes moved by the client
+ * @param ns: Wall time
+ * @param cpu_ns: Server CPU time
+ * @param before: Engine counters before the phase
+ * @param after: Engine counters after the phase
+ * @param count: Number of engines in both
+ **/
+static void print_phase(const char *backend, const char *direction, long long bytes, long long ns,
+                        long long cpu_ns, const bench_engine_t *before, const bench_engine_t *after,
+                        int count) {
+    long long syscalls;
+    int engine = bench_engine_delta(before, after, count, &syscalls);
+    double mb = bytes / 1048576.0;
+    printf("%-8s %-9s %-10s %-10.0f %-12.0f %.2f\n", backend, direction, after[engine].name,
+           mb / (ns / 1e9), cpu_ns / 1e6 / (mb / 1024), syscalls / mb);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    long long size_mb = 256;
+    int rounds = 4;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+        switch (opt) {
+            case 's':
+                size_mb = atoll(optarg);
+                break;
+            case 'n':
+                rounds = atoi(optarg);
+                break;
+            default:
+                rounds = -1;
+        }
+    }
+    if (size_mb <= 0 || rounds <= 0 || argc - optind > MAX_SERVER_ARGS) {
+        fprintf(stderr, "Usage: %s [-s size_mb] [-n rounds] [-- server options]\n", argv[0]);
+        return 2;
+    }
+
+    static const char *backends[] = { "copy", "uring" };
+    long long size = size_mb << 20;
+    int ret = 0;
+    printf("# %d x %lld MB each way over loopback, %d CPUs\n", rounds, size_mb, bench_cpu_count());
+    printf("%-8s %-9s %-10s %-10s %-12s %s\n", "backend", "direction", "engine", "MB/s", "cpu_ms/GB",
+           "syscalls/MB");
+    for (int b = 0; b < 2 && ret == 0; b++) {
+        bench_server_t server;
+        char *args[MAX_SERVER_ARGS + 3] = { "-b", (char *)backends[b] };
+        for (int i = optind; i < argc; i++) {
+            args[2 + i - optind] = argv[i];
+        }
+        static bench_conn_t c;
+        if (bench_server_init(&server, "uring") == -1 || bench_server_start(&server, args) == -1 ||
+            bench_connect(&c, server.port) == -1 ||
+            bench_cmd(&c, NULL, 0, "REGISTER owner pw") != 120 ||
+            bench_cmd(&c, NULL, 0, "LOGIN owner pw") != 110 ||
+            bench_cmd(&c, NULL, 0, "CREATE team") != 202) {
+            fprintf(stderr, "Setup failed\n");
+            bench_server_cleanup(&server);
+            return 1;
+        }
+
+        bench_engine_t before[BENCH_MAX_ENGINES], after[BENCH_MAX_ENGINES];
+        for (int phase = 0; phase < 2 && ret == 0; phase++) {
+            int count = bench_server_engines(&server, before, BENCH_MAX_ENGINES);
+            long long cpu = bench_server_cpu_ns(&server);
+            long long start = bench_now_ns();
+            for (int r = 0; r < rounds && ret == 0; r++) {
+                ret = phase == 0 ? bench_upload(&c, "big.bin", size) : bench_download(&c, "big.bin");
+            }
+            long long ns = bench_now_ns() - start;
+            cpu = bench_server_cpu_ns(&server) - cpu;
+            if (ret != 0 || count <= 0 || bench_server_engines(&server, after, BENCH_MAX_ENGINES) != count) {
+                fprintf(stderr, "%s with -b %s failed\n", phase == 0 ? "Upload" : "Download", backends[b]);
+                ret = 1;
+                break;
+            }
+            print_phase(backends[b], phase == 0 ? "upload" : "download", size * rounds, ns, cpu,
+                        before, after, count);
+        }
+        bench_close(&c);
+        bench_server_cleanup(&server);
+    }
+    return ret;
+}